@@ -0,0 +1,22 @@
+#!/bin/sh
+# 用redis-benchmark测试cache_server的吞吐
+# 用法：cache_bench.sh <cache_server> <redis-benchmark>
+# 可用环境变量调整：PORT（默认6380）、THREADS（服务端subloop数，默认4）、
+#                   CLIENTS（默认50）、REQUESTS（默认1000000）、PIPELINE（默认16）
+set -e
+
+SERVER=$1
+BENCH=$2
+PORT=${PORT:-6380}
+THREADS=${THREADS:-4}
+CLIENTS=${CLIENTS:-50}
+REQUESTS=${REQUESTS:-1000000}
+PIPELINE=${PIPELINE:-16}
+
+"$SERVER" -p "$PORT" -t "$THREADS" > cache_server.log 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT
+sleep 1
+
+"$BENCH" -p "$PORT" -c "$CLIENTS" -n "$REQUESTS" -P "$PIPELINE" -r 100000 \
+    -t ping,set,get,incr,mset -q
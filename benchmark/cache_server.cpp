@@ -0,0 +1,729 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "RespCodec.h"
+#include "Logger.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <strings.h>
+#include <unistd.h>
+
+/**
+ * 分片的内存缓存服务器，兼容Redis协议（RESP2/RESP3），可以直接用redis-benchmark/redis-cli测试：
+ *   cache_server -p 6380 -t 4 [-r maxCommandsPerRound]
+ *   redis-benchmark -p 6380 -t ping,set,get,incr,mset -P 16 -q
+ *
+ * 每个subloop拥有一个键空间分片，分片只在所属loop线程中访问，不需要加锁。
+ * 键按哈希分配到分片：属于本loop的命令直接执行；属于其他分片的命令按目标分片分组，
+ * 一批流水线命令对每个分片只runInLoop一次，执行结果再runInLoop回连接所在的loop。
+ * 每条命令在连接上占一个应答槽，应答按命令顺序发送，不受跨分片执行先后的影响。
+ *
+ * 支持的命令：PING ECHO HELLO QUIT SELECT COMMAND CONFIG CLIENT INFO DBSIZE FLUSHDB FLUSHALL
+ *            GET SET(NX|XX) DEL EXISTS INCR DECR INCRBY DECRBY APPEND STRLEN MGET MSET
+ */
+class CacheServer
+{
+public:
+    CacheServer(EventLoop *loop, const InetAddress &addr, int numThreads, size_t readBudget)
+        : server_(loop, addr, "CacheServer")
+        , codec_(std::bind(&CacheServer::onCommands, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4))
+    {
+        server_.setConnectionCallback(
+            std::bind(&CacheServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(
+            std::bind(&RespCodec::onMessage, &codec_,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(numThreads);
+        // 每个连接每轮最多执行readBudget条命令，其余的留到下一轮，避免深度流水线的连接拖慢同loop的其他连接
+        server_.setReadBudget(0, readBudget);
+    }
+
+    void start()
+    {
+        server_.start();
+        // 每个IO loop一个分片；连接要在baseloop开始运行后才会被接受，此时分片已经建好
+        for (EventLoop *loop : server_.threadPool()->getAllLoops())
+        {
+            shards_.emplace_back(new Shard(loop));
+        }
+        LOG_INFO("CacheServer listening on %s with %d shards \n",
+            server_.ipPort().c_str(), static_cast<int>(shards_.size()));
+    }
+private:
+    // 键空间分片，只在loop_线程中访问（size_除外）
+    struct Shard
+    {
+        explicit Shard(EventLoop *l) : loop(l), size(0) {}
+
+        EventLoop *loop;
+        std::unordered_map<std::string, std::string> map;
+        std::atomic<size_t> size; // 供DBSIZE在其他线程读取
+    };
+
+    // 应答槽的类型：单条命令直接使用分片返回的应答；多键命令需要汇总各个部分
+    enum SlotKind
+    {
+        kReply,   // 单键命令和本地命令
+        kSum,     // 多键DEL/EXISTS：整数相加
+        kOk,      // MSET
+        kArray,   // MGET：按键的顺序拼接
+    };
+
+    struct Slot
+    {
+        SlotKind kind;
+        size_t remaining;          // 还没有返回的部分数
+        int64_t sum;
+        std::string reply;
+        std::vector<std::string> parts;
+    };
+
+    // 每个连接的状态，只在连接所在的loop中访问
+    struct Session
+    {
+        Session() : protover(2), localShard(0), firstSeq(0), quit(false) {}
+
+        int protover;
+        size_t localShard;
+        uint64_t firstSeq;         // slots.front()的序号
+        std::deque<Slot> slots;    // 还没有发送的应答，按命令顺序
+        bool quit;
+        Buffer scratch;
+    };
+
+    // 发往某个分片的单键子命令
+    struct SubCommand
+    {
+        uint64_t seq;
+        size_t part;
+        std::vector<std::string> args;
+    };
+
+    struct SubResult
+    {
+        uint64_t seq;
+        size_t part;
+        int64_t count;
+        std::string reply;
+    };
+
+    // 一批流水线命令中发往同一分片的子命令
+    struct RemoteBatch
+    {
+        TcpConnectionPtr conn;
+        int protover;
+        std::vector<SubCommand> commands;
+        std::vector<SubResult> results;
+    };
+    using RemoteBatchPtr = std::shared_ptr<RemoteBatch>;
+
+    static uint64_t hashKey(const StringPiece &key)
+    {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            h ^= static_cast<unsigned char>(key[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    size_t shardOf(const StringPiece &key) const
+    {
+        return static_cast<size_t>(hashKey(key) % shards_.size());
+    }
+
+    static bool parseInteger(const std::string &str, int64_t *value)
+    {
+        if (str.empty() || str.size() > 20)
+        {
+            return false;
+        }
+        char *end = nullptr;
+        errno = 0;
+        long long v = ::strtoll(str.c_str(), &end, 10);
+        if (errno != 0 || end != str.c_str() + str.size())
+        {
+            return false;
+        }
+        *value = v;
+        return true;
+    }
+
+    static void appendWrongArity(Buffer *out, const StringPiece &name)
+    {
+        std::string msg = "ERR wrong number of arguments for '" + name.asString() + "' command";
+        RespCodec::appendError(out, msg);
+    }
+
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            std::shared_ptr<Session> session = std::make_shared<Session>();
+            for (size_t i = 0; i < shards_.size(); ++i)
+            {
+                if (shards_[i]->loop == conn->getLoop())
+                {
+                    session->localShard = i;
+                }
+            }
+            conn->setContext(session);
+        }
+    }
+
+    // 一批流水线命令
+    void onCommands(const TcpConnectionPtr &conn, const RespCodec::Command *commands, size_t n, Timestamp)
+    {
+        Session *session = static_cast<Session*>(conn->getContext().get());
+        if (session == nullptr || session->quit)
+        {
+            return;
+        }
+        std::vector<RemoteBatchPtr> remote(shards_.size());
+        for (size_t i = 0; i < n && !session->quit; ++i)
+        {
+            dispatch(conn, session, commands[i], &remote);
+        }
+
+        for (size_t i = 0; i < remote.size(); ++i)
+        {
+            if (remote[i])
+            {
+                shards_[i]->loop->runInLoop(std::bind(&CacheServer::executeRemote, this, i, remote[i]));
+            }
+        }
+        flush(conn, session);
+    }
+
+    void dispatch(const TcpConnectionPtr &conn, Session *session, const RespCodec::Command &args,
+                  std::vector<RemoteBatchPtr> *remote)
+    {
+        const StringPiece &name = args[0];
+        const size_t argc = args.size();
+
+        // 单键命令：键属于本地分片且前面没有未完成的应答时，直接写入输出缓冲区
+        if (isKeyCommand(name))
+        {
+            if (argc < 2)
+            {
+                appendWrongArity(beginReply(conn, session), name);
+                endReply(session);
+                return;
+            }
+            size_t shard = shardOf(args[1]);
+            if (shard == session->localShard && session->slots.empty())
+            {
+                int64_t count = 0;
+                execute(*shards_[shard], args.data(), argc, session->protover, conn->outputBuffer(), &count);
+            }
+            else
+            {
+                uint64_t seq = pushSlot(session, kReply, 1);
+                routePart(conn, session, shard, seq, 0, args.data(), argc, remote);
+            }
+            return;
+        }
+
+        // 多键命令：拆成单键的子命令分别发往各自的分片
+        if (name.equalsIgnoreCase("MGET") || name.equalsIgnoreCase("DEL") || name.equalsIgnoreCase("EXISTS"))
+        {
+            if (argc < 2)
+            {
+                appendWrongArity(beginReply(conn, session), name);
+                endReply(session);
+                return;
+            }
+            const bool mget = name.equalsIgnoreCase("MGET");
+            uint64_t seq = pushSlot(session, mget ? kArray : kSum, argc - 1);
+            StringPiece sub[2] = { mget ? StringPiece("GET") : name, StringPiece() };
+            for (size_t i = 1; i < argc; ++i)
+            {
+                sub[1] = args[i];
+                routePart(conn, session, shardOf(args[i]), seq, i - 1, sub, 2, remote);
+            }
+            return;
+        }
+        if (name.equalsIgnoreCase("MSET"))
+        {
+            if (argc < 3 || argc % 2 != 1)
+            {
+                appendWrongArity(beginReply(conn, session), name);
+                endReply(session);
+                return;
+            }
+            uint64_t seq = pushSlot(session, kOk, (argc - 1) / 2);
+            StringPiece sub[3] = { StringPiece("SET"), StringPiece(), StringPiece() };
+            for (size_t i = 1; i < argc; i += 2)
+            {
+                sub[1] = args[i];
+                sub[2] = args[i + 1];
+                routePart(conn, session, shardOf(args[i]), seq, i / 2, sub, 3, remote);
+            }
+            return;
+        }
+
+        if (name.equalsIgnoreCase("FLUSHDB") || name.equalsIgnoreCase("FLUSHALL"))
+        {
+            // 作为子命令发往每个分片，和其他子命令走同一个批次：排在同一批流水线中之前发往该分片的写之后，
+            // 所有分片都清空后才应答OK
+            uint64_t seq = pushSlot(session, kOk, shards_.size());
+            StringPiece sub[1] = { StringPiece("FLUSHDB") };
+            for (size_t i = 0; i < shards_.size(); ++i)
+            {
+                routePart(conn, session, i, seq, i, sub, 1, remote);
+            }
+            return;
+        }
+
+        Buffer *out = beginReply(conn, session);
+        executeLocal(session, args, out);
+        endReply(session);
+    }
+
+    static bool isKeyCommand(const StringPiece &name)
+    {
+        static const char *const kCommands[] = {
+            "GET", "SET", "INCR", "DECR", "INCRBY", "DECRBY", "APPEND", "STRLEN",
+        };
+        for (const char *command : kCommands)
+        {
+            if (name.equalsIgnoreCase(command))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 不涉及键空间（或者只读取原子计数）的命令，在连接所在loop中执行
+    void executeLocal(Session *session, const RespCodec::Command &args, Buffer *out)
+    {
+        const StringPiece &name = args[0];
+        const size_t argc = args.size();
+        if (name.equalsIgnoreCase("PING"))
+        {
+            if (argc > 2)
+            {
+                appendWrongArity(out, name);
+            }
+            else if (argc == 2)
+            {
+                RespCodec::appendBulkString(out, args[1]);
+            }
+            else
+            {
+                RespCodec::appendSimpleString(out, "PONG");
+            }
+        }
+        else if (name.equalsIgnoreCase("ECHO"))
+        {
+            if (argc != 2)
+            {
+                appendWrongArity(out, name);
+            }
+            else
+            {
+                RespCodec::appendBulkString(out, args[1]);
+            }
+        }
+        else if (name.equalsIgnoreCase("HELLO"))
+        {
+            if (argc >= 2)
+            {
+                if (args[1] == "2" || args[1] == "3")
+                {
+                    session->protover = args[1][0] - '0';
+                }
+                else
+                {
+                    RespCodec::appendError(out, "NOPROTO unsupported protocol version");
+                    return;
+                }
+            }
+            RespCodec::appendMapHeader(out, 3, session->protover);
+            RespCodec::appendBulkString(out, "server");
+            RespCodec::appendBulkString(out, "mymuduo-cache");
+            RespCodec::appendBulkString(out, "proto");
+            RespCodec::appendInteger(out, session->protover);
+            RespCodec::appendBulkString(out, "mode");
+            RespCodec::appendBulkString(out, "standalone");
+        }
+        else if (name.equalsIgnoreCase("QUIT"))
+        {
+            RespCodec::appendSimpleString(out, "OK");
+            session->quit = true;
+        }
+        else if (name.equalsIgnoreCase("SELECT") || name.equalsIgnoreCase("CLIENT"))
+        {
+            RespCodec::appendSimpleString(out, "OK");
+        }
+        else if (name.equalsIgnoreCase("COMMAND") || name.equalsIgnoreCase("CONFIG"))
+        {
+            // redis-benchmark启动时会发送CONFIG GET，返回空结果即可
+            RespCodec::appendArrayHeader(out, 0);
+        }
+        else if (name.equalsIgnoreCase("INFO"))
+        {
+            char info[128];
+            int len = snprintf(info, sizeof info, "# Server\r\nredis_version:7.0.0\r\nshards:%d\r\n",
+                static_cast<int>(shards_.size()));
+            RespCodec::appendBulkString(out, StringPiece(info, len));
+        }
+        else if (name.equalsIgnoreCase("DBSIZE"))
+        {
+            size_t total = 0;
+            for (const std::unique_ptr<Shard> &shard : shards_)
+            {
+                total += shard->size.load(std::memory_order_relaxed);
+            }
+            RespCodec::appendInteger(out, static_cast<int64_t>(total));
+        }
+        else
+        {
+            std::string msg = "ERR unknown command '" + name.asString() + "'";
+            RespCodec::appendError(out, msg);
+        }
+    }
+
+    // 在分片所属的loop中执行一条单键命令（或清空分片的FLUSHDB），应答写入out；DEL/EXISTS的结果同时写入*count
+    static void execute(Shard &shard, const StringPiece *args, size_t argc, int protover,
+                        Buffer *out, int64_t *count)
+    {
+        const StringPiece &name = args[0];
+        *count = 0;
+        if (name.equalsIgnoreCase("FLUSHDB"))
+        {
+            shard.map.clear();
+            shard.size.store(0, std::memory_order_relaxed);
+            RespCodec::appendSimpleString(out, "OK");
+            return;
+        }
+        std::string key = args[1].asString();
+
+        if (name.equalsIgnoreCase("GET"))
+        {
+            if (argc != 2)
+            {
+                appendWrongArity(out, name);
+                return;
+            }
+            auto it = shard.map.find(key);
+            if (it == shard.map.end())
+            {
+                RespCodec::appendNull(out, protover);
+            }
+            else
+            {
+                RespCodec::appendBulkString(out, it->second);
+            }
+        }
+        else if (name.equalsIgnoreCase("SET"))
+        {
+            bool nx = false;
+            bool xx = false;
+            for (size_t i = 3; i < argc; ++i)
+            {
+                if (args[i].equalsIgnoreCase("NX"))
+                {
+                    nx = true;
+                }
+                else if (args[i].equalsIgnoreCase("XX"))
+                {
+                    xx = true;
+                }
+                else
+                {
+                    RespCodec::appendError(out, "ERR syntax error");
+                    return;
+                }
+            }
+            if (argc < 3)
+            {
+                appendWrongArity(out, name);
+                return;
+            }
+            if (nx && xx)
+            {
+                RespCodec::appendError(out, "ERR syntax error");
+                return;
+            }
+            auto it = shard.map.find(key);
+            if ((nx && it != shard.map.end()) || (xx && it == shard.map.end()))
+            {
+                RespCodec::appendNull(out, protover);
+                return;
+            }
+            if (it == shard.map.end())
+            {
+                shard.map.emplace(std::move(key), args[2].asString());
+                shard.size.store(shard.map.size(), std::memory_order_relaxed);
+            }
+            else
+            {
+                it->second.assign(args[2].data(), args[2].size());
+            }
+            RespCodec::appendSimpleString(out, "OK");
+        }
+        else if (name.equalsIgnoreCase("DEL") || name.equalsIgnoreCase("EXISTS"))
+        {
+            auto it = shard.map.find(key);
+            if (it != shard.map.end())
+            {
+                *count = 1;
+                if (name.equalsIgnoreCase("DEL"))
+                {
+                    shard.map.erase(it);
+                    shard.size.store(shard.map.size(), std::memory_order_relaxed);
+                }
+            }
+            RespCodec::appendInteger(out, *count);
+        }
+        else if (name.equalsIgnoreCase("INCR") || name.equalsIgnoreCase("DECR")
+                 || name.equalsIgnoreCase("INCRBY") || name.equalsIgnoreCase("DECRBY"))
+        {
+            const bool by = name.size() == 6;
+            if (argc != (by ? 3u : 2u))
+            {
+                appendWrongArity(out, name);
+                return;
+            }
+            int64_t delta = 1;
+            if (by && !parseInteger(args[2].asString(), &delta))
+            {
+                RespCodec::appendError(out, "ERR value is not an integer or out of range");
+                return;
+            }
+            if (name[0] == 'D' || name[0] == 'd')
+            {
+                delta = -delta;
+            }
+            std::string &value = shard.map[key];
+            int64_t current = 0;
+            if (!value.empty() && !parseInteger(value, &current))
+            {
+                RespCodec::appendError(out, "ERR value is not an integer or out of range");
+                return;
+            }
+            current += delta;
+            value = std::to_string(current);
+            shard.size.store(shard.map.size(), std::memory_order_relaxed);
+            RespCodec::appendInteger(out, current);
+        }
+        else if (name.equalsIgnoreCase("APPEND"))
+        {
+            if (argc != 3)
+            {
+                appendWrongArity(out, name);
+                return;
+            }
+            std::string &value = shard.map[key];
+            value.append(args[2].data(), args[2].size());
+            shard.size.store(shard.map.size(), std::memory_order_relaxed);
+            RespCodec::appendInteger(out, static_cast<int64_t>(value.size()));
+        }
+        else if (name.equalsIgnoreCase("STRLEN"))
+        {
+            auto it = shard.map.find(key);
+            RespCodec::appendInteger(out, it == shard.map.end() ? 0 : static_cast<int64_t>(it->second.size()));
+        }
+    }
+
+    // 本地命令的应答：前面有未完成的应答时先写入scratch，由endReply放入应答槽
+    static Buffer* beginReply(const TcpConnectionPtr &conn, Session *session)
+    {
+        return session->slots.empty() ? conn->outputBuffer() : &session->scratch;
+    }
+
+    static void endReply(Session *session)
+    {
+        if (!session->slots.empty() && session->scratch.readableBytes() > 0)
+        {
+            Slot slot;
+            slot.kind = kReply;
+            slot.remaining = 0;
+            slot.sum = 0;
+            slot.reply = session->scratch.retrieveAllAsString();
+            session->slots.push_back(std::move(slot));
+        }
+    }
+
+    static uint64_t pushSlot(Session *session, SlotKind kind, size_t parts)
+    {
+        Slot slot;
+        slot.kind = kind;
+        slot.remaining = parts;
+        slot.sum = 0;
+        if (kind == kArray)
+        {
+            slot.parts.resize(parts);
+        }
+        session->slots.push_back(std::move(slot));
+        return session->firstSeq + session->slots.size() - 1;
+    }
+
+    // 子命令属于本地分片时立即执行，否则加入发往目标分片的批次
+    void routePart(const TcpConnectionPtr &conn, Session *session, size_t shard, uint64_t seq, size_t part,
+                   const StringPiece *args, size_t argc, std::vector<RemoteBatchPtr> *remote)
+    {
+        if (shard == session->localShard)
+        {
+            int64_t count = 0;
+            execute(*shards_[shard], args, argc, session->protover, &session->scratch, &count);
+            completePart(session, seq, part, count, session->scratch.retrieveAllAsString());
+            return;
+        }
+
+        RemoteBatchPtr &batch = (*remote)[shard];
+        if (!batch)
+        {
+            batch = std::make_shared<RemoteBatch>();
+            batch->conn = conn;
+            batch->protover = session->protover;
+        }
+        SubCommand sub;
+        sub.seq = seq;
+        sub.part = part;
+        sub.args.reserve(argc);
+        for (size_t i = 0; i < argc; ++i)
+        {
+            sub.args.push_back(args[i].asString());
+        }
+        batch->commands.push_back(std::move(sub));
+    }
+
+    static void completePart(Session *session, uint64_t seq, size_t part, int64_t count, std::string reply)
+    {
+        Slot &slot = session->slots[seq - session->firstSeq];
+        switch (slot.kind)
+        {
+            case kReply: slot.reply = std::move(reply); break;
+            case kSum: slot.sum += count; break;
+            case kOk: break;
+            case kArray: slot.parts[part] = std::move(reply); break;
+        }
+        --slot.remaining;
+    }
+
+    // 在分片所属的loop中执行一批子命令，结果送回连接所在的loop
+    void executeRemote(size_t shardIndex, const RemoteBatchPtr &batch)
+    {
+        Shard &shard = *shards_[shardIndex];
+        Buffer out;
+        std::vector<StringPiece> args;
+        batch->results.reserve(batch->commands.size());
+        for (const SubCommand &sub : batch->commands)
+        {
+            args.assign(sub.args.begin(), sub.args.end());
+            SubResult result;
+            result.seq = sub.seq;
+            result.part = sub.part;
+            execute(shard, args.data(), args.size(), batch->protover, &out, &result.count);
+            result.reply = out.retrieveAllAsString();
+            batch->results.push_back(std::move(result));
+        }
+        batch->commands.clear();
+        EventLoop *ioLoop = batch->conn->getLoop();
+        ioLoop->runInLoop(std::bind(&CacheServer::onRemoteResults, this, batch));
+    }
+
+    void onRemoteResults(const RemoteBatchPtr &batch)
+    {
+        const TcpConnectionPtr &conn = batch->conn;
+        Session *session = static_cast<Session*>(conn->getContext().get());
+        if (!conn->connected() || session == nullptr)
+        {
+            return;
+        }
+        for (SubResult &result : batch->results)
+        {
+            completePart(session, result.seq, result.part, result.count, std::move(result.reply));
+        }
+        flush(conn, session);
+    }
+
+    // 按顺序发送已经完成的应答
+    static void flush(const TcpConnectionPtr &conn, Session *session)
+    {
+        Buffer *out = conn->outputBuffer();
+        while (!session->slots.empty() && session->slots.front().remaining == 0)
+        {
+            Slot &slot = session->slots.front();
+            switch (slot.kind)
+            {
+                case kReply:
+                    out->append(slot.reply.data(), slot.reply.size());
+                    break;
+                case kSum:
+                    RespCodec::appendInteger(out, slot.sum);
+                    break;
+                case kOk:
+                    RespCodec::appendSimpleString(out, "OK");
+                    break;
+                case kArray:
+                    RespCodec::appendArrayHeader(out, slot.parts.size());
+                    for (const std::string &part : slot.parts)
+                    {
+                        out->append(part.data(), part.size());
+                    }
+                    break;
+            }
+            session->slots.pop_front();
+            ++session->firstSeq;
+        }
+        conn->sendOutputBuffer();
+        if (session->quit && session->slots.empty())
+        {
+            conn->shutdown();
+        }
+    }
+
+    TcpServer server_;
+    RespCodec codec_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 6380;
+    int numThreads = 0;
+    size_t readBudget = 0;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "p:t:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                port = static_cast<uint16_t>(::atoi(optarg));
+                break;
+            case 't':
+                numThreads = ::atoi(optarg);
+                break;
+            case 'r':
+                readBudget = static_cast<size_t>(::atoi(optarg));
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p port] [-t threads] [-r maxCommandsPerRound]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    EventLoop loop;
+    InetAddress addr(port);
+    CacheServer server(&loop, addr, numThreads, readBudget);
+    server.start();
+    loop.loop();
+    return 0;
+}
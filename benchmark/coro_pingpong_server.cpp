@@ -0,0 +1,50 @@
+#include "Coroutine.h"
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// 用协程层写的ping-pong服务端，与pingpong_server对比协程带来的开销，可以直接用pingpong_client测试
+// 用法：coro_pingpong_server [-p port] [-t threads]
+static coro::Task echo(coro::Stream &stream)
+{
+    stream.connection()->setTcpNoDelay(true);
+    while (std::optional<StringPiece> data = co_await stream.readSome())
+    {
+        if (!co_await stream.write(*data))
+        {
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 9981;
+    int numThreads = 0;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "p:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': port = static_cast<uint16_t>(atoi(optarg)); break;
+            case 't': numThreads = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-p port] [-t threads]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "0.0.0.0"), "CoroPingPongServer");
+    server.setThreadNum(numThreads);
+    coro::serve(&server, echo);
+    server.start();
+    loop.loop();
+    return 0;
+}
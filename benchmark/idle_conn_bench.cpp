@@ -0,0 +1,172 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+/**
+ * 空闲连接的内存占用（C1M）：同一进程内的客户端线程用裸socket建立n条回环连接（不收发数据），
+ * 服务端用TcpServer接受，全部建立后报告进程RSS的增量和平均每条连接的字节数。
+ *   idle_conn_bench [-n connections] [-t threads] [-p port] [-c]
+ * -c开启紧凑模式（TcpServer::setCompactMode）。每条连接占两个描述符，100万条连接需要：
+ *   ulimit -n 2100000（不超过fs.nr_open）；客户端轮流绑定127.0.0.1~127.0.0.250作为源地址，避开临时端口的数量限制。
+ * 库的INFO日志输出到stdout，结果输出到stderr：idle_conn_bench -n 1000000 -c > /dev/null
+ */
+
+namespace
+{
+long rssKb()
+{
+    long kb = 0;
+    FILE *fp = ::fopen("/proc/self/status", "r");
+    if (fp == nullptr)
+    {
+        return 0;
+    }
+    char line[256];
+    while (::fgets(line, sizeof line, fp) != nullptr)
+    {
+        if (::strncmp(line, "VmRSS:", 6) == 0)
+        {
+            kb = ::atol(line + 6);
+            break;
+        }
+    }
+    ::fclose(fp);
+    return kb;
+}
+
+// 把描述符上限提到硬上限，返回能支持的连接数
+long raiseFdLimit(long connections)
+{
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    long maxConnections = (static_cast<long>(rl.rlim_cur) - 64) / 2;
+    return connections < maxConnections ? connections : maxConnections;
+}
+
+// 建立n条连接，返回成功的数量；fds保存客户端一侧的描述符
+long connectAll(uint16_t port, long n, std::vector<int> *fds)
+{
+    const int kSourceAddrs = 250;
+    for (long i = 0; i < n; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            fprintf(stderr, "socket: %s after %ld connections\n", strerror(errno), i);
+            return i;
+        }
+        sockaddr_in local;
+        ::memset(&local, 0, sizeof local);
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<uint32_t>(i % kSourceAddrs));
+        int on = 1;
+        // 端口推迟到connect时按四元组分配，每个源地址都能用满临时端口范围
+        ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof on);
+        ::bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof local);
+
+        sockaddr_in server;
+        ::memset(&server, 0, sizeof server);
+        server.sin_family = AF_INET;
+        server.sin_port = htons(port);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&server), sizeof server) < 0)
+        {
+            fprintf(stderr, "connect: %s after %ld connections\n", strerror(errno), i);
+            ::close(fd);
+            return i;
+        }
+        fds->push_back(fd);
+    }
+    return n;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    long connections = 1000000;
+    int numThreads = 4;
+    uint16_t port = 9985;
+    bool compact = false;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "n:t:p:c")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': connections = ::atol(optarg); break;
+            case 't': numThreads = ::atoi(optarg); break;
+            case 'p': port = static_cast<uint16_t>(::atoi(optarg)); break;
+            case 'c': compact = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n connections] [-t threads] [-p port] [-c]\n", argv[0]);
+                return 1;
+        }
+    }
+    long target = raiseFdLimit(connections);
+    if (target < connections)
+    {
+        fprintf(stderr, "RLIMIT_NOFILE only allows %ld connections (raise ulimit -n)\n", target);
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, "127.0.0.1"), "IdleConnBench");
+    server.setThreadNum(numThreads);
+    server.setCompactMode(compact);
+    std::atomic<long> established(0);
+    server.setConnectionCallback([&established](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            established.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buffer, Timestamp) {
+        buffer->retrieveAll();
+    });
+    server.start();
+
+    long baseRss = 0;
+    std::vector<int> fds;
+    fds.reserve(static_cast<size_t>(target));
+    std::thread client([&]() {
+        ::usleep(100 * 1000);
+        baseRss = rssKb(); // 线程池、epoll等固定开销之后，连接建立之前
+        Timestamp start = Timestamp::now();
+        long made = connectAll(port, target, &fds);
+        while (established.load(std::memory_order_relaxed) < made)
+        {
+            ::usleep(10 * 1000);
+        }
+        ::usleep(200 * 1000); // 等各subloop处理完连接建立之后的回调
+        double seconds = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                             - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+        long rss = rssKb();
+        fprintf(stderr, "%s mode: %ld idle connections in %.1fs, RSS %ld KiB -> %ld KiB, %.0f bytes/connection\n",
+                compact ? "compact" : "default", made, seconds, baseRss, rss,
+                made > 0 ? static_cast<double>(rss - baseRss) * 1024 / made : 0.0);
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        ::sleep(1);
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+    return 0;
+}
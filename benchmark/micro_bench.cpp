@@ -0,0 +1,353 @@
+#include "Buffer.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Timestamp.h"
+#include "Crc32c.h"
+#include "FlightRecorder.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+/**
+ * 基础组件的微基准测试（Google Benchmark）：
+ *   Buffer：append / makeSpace（前移与扩容）/ retrieveAsString / readFd / 分隔符查找，以及CRC32C
+ *   EventLoop：runInLoop、queueInLoop（在loop线程内以及跨线程）
+ *   Channel：handleEvent的分发开销
+ * 输出JSON便于跨提交对比：
+ *   micro_bench --benchmark_out=micro.json --benchmark_out_format=json
+ *   compare.py benchmarks old.json new.json   （Google Benchmark自带的tools/compare.py）
+ */
+
+// 每个线程只能有一个EventLoop，所有在主线程中运行的用例共用这一个
+static EventLoop* benchLoop()
+{
+    static EventLoop loop;
+    return &loop;
+}
+
+// ---------------------------------- Buffer ----------------------------------
+
+// 追加len字节后全部取走：readerIndex_/writerIndex_复位，不触发makeSpace
+static void BM_BufferAppend(benchmark::State &state)
+{
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::string data(len, 'x');
+    Buffer buf;
+    for (auto _ : state)
+    {
+        buf.append(data.data(), data.size());
+        buf.retrieveAll();
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * len);
+}
+BENCHMARK(BM_BufferAppend)->RangeMultiplier(8)->Range(8, 64 << 10);
+
+// 每次只取走一半，后续append需要前移可读数据（makeSpace的move分支）
+static void BM_BufferMakeSpaceMove(benchmark::State &state)
+{
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::string data(len, 'x');
+    Buffer buf(len * 2);
+    buf.append(data.data(), data.size());
+    for (auto _ : state)
+    {
+        buf.retrieve(len / 2 + 1);
+        buf.append(data.data(), len / 2 + 1);
+        buf.append(data.data(), len / 2);
+        buf.retrieve(len / 2);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * len);
+}
+BENCHMARK(BM_BufferMakeSpaceMove)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 从默认大小的Buffer开始追加到len字节（makeSpace的resize分支）
+static void BM_BufferMakeSpaceGrow(benchmark::State &state)
+{
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::string data(512, 'x');
+    for (auto _ : state)
+    {
+        Buffer buf;
+        for (size_t n = 0; n < len; n += data.size())
+        {
+            buf.append(data.data(), data.size());
+        }
+        benchmark::DoNotOptimize(buf.peek());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * len);
+}
+BENCHMARK(BM_BufferMakeSpaceGrow)->RangeMultiplier(8)->Range(4 << 10, 1 << 20);
+
+static void BM_BufferRetrieveAsString(benchmark::State &state)
+{
+    const size_t len = static_cast<size_t>(state.range(0));
+    std::string data(len, 'x');
+    Buffer buf;
+    for (auto _ : state)
+    {
+        buf.append(data.data(), data.size());
+        std::string s = buf.retrieveAsString(len);
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * len);
+}
+BENCHMARK(BM_BufferRetrieveAsString)->RangeMultiplier(8)->Range(8, 64 << 10);
+
+// 通过pipe读取len字节，超过Buffer可写空间的部分会落到栈上的extrabuf
+static void BM_BufferReadFd(benchmark::State &state)
+{
+    const size_t len = static_cast<size_t>(state.range(0));
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        state.SkipWithError("pipe2 failed");
+        return;
+    }
+    ::fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(len * 2));
+    std::string data(len, 'x');
+    Buffer buf;
+    int savedErrno = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        ssize_t n = ::write(fds[1], data.data(), data.size());
+        state.ResumeTiming();
+        if (n != static_cast<ssize_t>(len))
+        {
+            state.SkipWithError("short write to pipe");
+            break;
+        }
+        buf.readFd(fds[0], &savedErrno);
+        buf.retrieveAll();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * len);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+BENCHMARK(BM_BufferReadFd)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 带校验的LengthHeaderCodec使用的CRC32C
+static void BM_Crc32c(benchmark::State &state)
+{
+    std::string data(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Crc32c::value(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    state.SetLabel(Crc32c::isHardwareAccelerated() ? "sse4.2" : "table");
+}
+BENCHMARK(BM_Crc32c)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 分隔符位于数据末尾，测量扫描整段数据的吞吐；与memchr/memmem的标量查找对比
+static void BM_BufferFindCRLF(benchmark::State &state)
+{
+    Buffer buf;
+    std::string data(static_cast<size_t>(state.range(0)) - 2, 'x');
+    data += "\r\n";
+    buf.append(data.data(), data.size());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(buf.findCRLF());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    state.SetLabel(MemSearch::kernelName());
+}
+BENCHMARK(BM_BufferFindCRLF)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// 数据中夹杂大量单独的'\r'，标量实现每遇到一个'\r'都要重新调用memchr
+static void BM_BufferFindCRLFNoisy(benchmark::State &state)
+{
+    Buffer buf;
+    std::string data;
+    while (data.size() + 2 < static_cast<size_t>(state.range(0)))
+    {
+        data += "abc\r";
+    }
+    data += "\r\n";
+    buf.append(data.data(), data.size());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(buf.findCRLF());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * data.size());
+    state.SetLabel(MemSearch::kernelName());
+}
+BENCHMARK(BM_BufferFindCRLFNoisy)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+static void BM_BufferFindDelimiter(benchmark::State &state)
+{
+    static const char kDelim[] = "\r\n\r\n";
+    Buffer buf;
+    std::string data(static_cast<size_t>(state.range(0)) - 4, 'x');
+    data += kDelim;
+    buf.append(data.data(), data.size());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(buf.find(kDelim, 4));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    state.SetLabel(MemSearch::kernelName());
+}
+BENCHMARK(BM_BufferFindDelimiter)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+static void BM_MemmemDelimiter(benchmark::State &state)
+{
+    static const char kDelim[] = "\r\n\r\n";
+    std::string data(static_cast<size_t>(state.range(0)) - 4, 'x');
+    data += kDelim;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(::memmem(data.data(), data.size(), kDelim, 4));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_MemmemDelimiter)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// -------------------------------- EventLoop ---------------------------------
+
+// 在loop线程中调用runInLoop：直接执行
+static void BM_RunInLoopOwnerThread(benchmark::State &state)
+{
+    EventLoop *loop = benchLoop();
+    int64_t counter = 0;
+    for (auto _ : state)
+    {
+        loop->runInLoop([&counter]() { ++counter; });
+    }
+    benchmark::DoNotOptimize(counter);
+}
+BENCHMARK(BM_RunInLoopOwnerThread);
+
+// 在loop线程中queueInLoop一批回调的入队开销；执行回调的那一轮loop不计入时间
+static void BM_QueueInLoopOwnerThread(benchmark::State &state)
+{
+    EventLoop *loop = benchLoop();
+    const int64_t batch = state.range(0);
+    int64_t counter = 0;
+    for (auto _ : state)
+    {
+        for (int64_t i = 0; i < batch; ++i)
+        {
+            loop->queueInLoop([&counter]() { ++counter; });
+        }
+        state.PauseTiming();
+        loop->queueInLoop([loop]() { loop->quit(); });
+        loop->wakeup();
+        loop->loop();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    benchmark::DoNotOptimize(counter);
+}
+BENCHMARK(BM_QueueInLoopOwnerThread)->Arg(64)->Arg(1024);
+
+// 从其他线程向运行中的loop投递回调，计时到回调全部执行完为止
+static void BM_QueueInLoopCrossThread(benchmark::State &state)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    if (state.range(1) > 0)
+    {
+        loop->runInLoop([loop]() { loop->setBusyPoll(50); });
+    }
+    const int64_t batch = state.range(0);
+    std::atomic<int64_t> counter(0);
+    int64_t expected = 0;
+    for (auto _ : state)
+    {
+        for (int64_t i = 0; i < batch; ++i)
+        {
+            loop->queueInLoop([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+        }
+        expected += batch;
+        while (counter.load(std::memory_order_acquire) < expected)
+        {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_QueueInLoopCrossThread)
+    ->ArgNames({"batch", "busypoll"})
+    ->Args({1, 0})->Args({64, 0})->Args({1, 1})->Args({64, 1})
+    ->UseRealTime();
+
+// --------------------------------- Channel ----------------------------------
+
+// Channel::handleEvent按revents分发到读回调，tied表示经过weak_ptr提升的路径，
+// handler表示用ChannelHandler（虚函数）代替setReadCallback（std::function）
+struct CountingHandler : ChannelHandler
+{
+    void handleRead(Timestamp) override { ++counter; }
+    int64_t counter = 0;
+};
+
+static void BM_ChannelHandleEvent(benchmark::State &state)
+{
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        state.SkipWithError("pipe2 failed");
+        return;
+    }
+    int64_t counter = 0;
+    CountingHandler handler;
+    {
+        Channel channel(benchLoop(), fds[0]);
+        std::shared_ptr<int> owner = std::make_shared<int>(0);
+        if (state.range(0) > 0)
+        {
+            channel.tie(owner);
+        }
+        if (state.range(1) > 0)
+        {
+            channel.setHandler(&handler);
+        }
+        else
+        {
+            channel.setReadCallback(std::bind(&CountingHandler::handleRead, &handler, std::placeholders::_1));
+        }
+        channel.set_revents(EPOLLIN);
+        Timestamp now(Timestamp::now());
+        for (auto _ : state)
+        {
+            channel.handleEvent(now);
+        }
+    }
+    counter = handler.counter;
+    benchmark::DoNotOptimize(counter);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+BENCHMARK(BM_ChannelHandleEvent)
+    ->ArgNames({"tied", "handler"})
+    ->Args({0, 0})->Args({0, 1})->Args({1, 0})->Args({1, 1});
+
+// ------------------------------ FlightRecorder ------------------------------
+
+// 一个记录点（Scope）的开销：关闭时只检查标志，开启时是两次rdtsc和一次写环形缓冲区
+static void BM_FlightRecorderScope(benchmark::State &state)
+{
+    FlightRecorder::enable(state.range(0) != 0);
+    int64_t counter = 0;
+    for (auto _ : state)
+    {
+        FlightRecorder::Scope scope(FlightRecorder::kFunctor);
+        benchmark::DoNotOptimize(++counter);
+    }
+    FlightRecorder::enable(false);
+}
+BENCHMARK(BM_FlightRecorderScope)->ArgName("enabled")->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
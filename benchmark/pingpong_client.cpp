@@ -0,0 +1,286 @@
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "HdrHistogram.h"
+#include "Buffer.h"
+#include "Logger.h"
+#include "TlsContext.h"
+#include "ConnectionFilter.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+/**
+ * ping-pong基准测试的客户端：每条连接发送一个messageSize字节的消息，
+ * 收齐服务端的回显后记录往返延迟，再发送下一个消息，持续duration秒。
+ * 用法：pingpong_client [-h ip] [-p port] [-u unixPath] [-s messageSize] [-c connections] [-t threads] [-d seconds] [-T] [-z lz4|zstd]
+ * -u指定Unix域socket路径时不使用TCP，用于对比本机IPC的开销。
+ * -T使用TLS连接（不校验服务端证书），用于测量加密的开销。
+ * -z在每条连接上加CompressionFilter，服务端须使用相同的-z。
+ * 结果：吞吐（MB/s、msg/s）以及往返延迟的p50/p99/p999（微秒）。
+ */
+
+static int64_t nowNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+class Client;
+
+// 一条ping-pong连接
+class Session
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const std::string &name,
+            Client *owner, HdrHistogram *histogram, const std::shared_ptr<TlsContext> &tls)
+        : client_(loop, serverAddr, name)
+        , owner_(owner)
+        , histogram_(histogram)
+        , bytesRead_(0)
+        , messagesRead_(0)
+        , sendTime_(0)
+    {
+        client_.setConnectionCallback(
+            std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(
+            std::bind(&Session::onMessage, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        if (tls)
+        {
+            client_.setTlsContext(tls, std::string()); // 压测用的context不校验证书
+        }
+    }
+
+    void start() { client_.connect(); }
+    // 在session所属的loop中调用
+    void stop() { client_.disconnect(); }
+
+    EventLoop* getLoop() const { return client_.getLoop(); }
+    int64_t bytesRead() const { return bytesRead_; }
+    int64_t messagesRead() const { return messagesRead_; }
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time);
+
+    TcpClient client_;
+    Client *owner_;
+    HdrHistogram *histogram_; // 同一个loop上的session共用，只在该loop线程中记录
+    int64_t bytesRead_;
+    int64_t messagesRead_;
+    int64_t sendTime_;
+};
+
+class Client
+{
+public:
+    Client(EventLoop *loop, const InetAddress &serverAddr, int messageSize,
+           int numSessions, int numThreads, int duration, const std::shared_ptr<TlsContext> &tls, int codec)
+        : loop_(loop)
+        , codec_(codec)
+        , threadPool_(loop, "pingpong-client")
+        , message_(messageSize, 'x')
+        , numSessions_(numSessions)
+        , duration_(duration)
+        , numConnected_(0)
+        , running_(true)
+    {
+        threadPool_.setThreadNum(numThreads);
+        threadPool_.start();
+
+        std::vector<EventLoop*> loops = threadPool_.getAllLoops();
+        histograms_.resize(loops.size());
+        for (int i = 0; i < numSessions; ++i)
+        {
+            int index = i % static_cast<int>(loops.size());
+            sessions_.emplace_back(new Session(loops[index], serverAddr,
+                                               "C" + std::to_string(i), this, &histograms_[index], tls));
+            sessions_.back()->start();
+        }
+    }
+
+    const std::string& message() const { return message_; }
+    bool running() const { return running_; }
+    int codec() const { return codec_; }
+
+    void onConnect()
+    {
+        if (++numConnected_ == numSessions_)
+        {
+            printf("all %d connections connected\n", numSessions_);
+            startTime_ = nowNanos();
+            loop_->runAfter(duration_, std::bind(&Client::handleTimeout, this));
+        }
+    }
+
+    void onDisconnect()
+    {
+        if (--numConnected_ == 0)
+        {
+            loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+        }
+    }
+
+    // 在loop_退出后调用：此时所有连接都已断开，不再有线程修改统计数据
+    void report()
+    {
+        int64_t bytes = 0;
+        int64_t messages = 0;
+        for (const std::unique_ptr<Session> &session : sessions_)
+        {
+            bytes += session->bytesRead();
+            messages += session->messagesRead();
+        }
+        HdrHistogram total;
+        for (const HdrHistogram &h : histograms_)
+        {
+            total.merge(h);
+        }
+        double seconds = static_cast<double>(stopTime_ - startTime_) / 1e9;
+        printf("%lld total bytes read\n", static_cast<long long>(bytes));
+        printf("%lld total messages read\n", static_cast<long long>(messages));
+        printf("%.3f MiB/s throughput\n", static_cast<double>(bytes) / seconds / 1024 / 1024);
+        printf("%.0f messages/s\n", static_cast<double>(messages) / seconds);
+        printf("latency(us) min=%.1f mean=%.1f p50=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+               total.min() / 1e3, total.mean() / 1e3,
+               total.percentile(50) / 1e3, total.percentile(99) / 1e3,
+               total.percentile(99.9) / 1e3, total.max() / 1e3);
+    }
+private:
+    void handleTimeout()
+    {
+        printf("stop\n");
+        running_ = false;
+        stopTime_ = nowNanos();
+        for (const std::unique_ptr<Session> &session : sessions_)
+        {
+            Session *s = session.get();
+            s->getLoop()->runInLoop(std::bind(&Session::stop, s));
+        }
+    }
+
+    EventLoop *loop_;
+    int codec_; // -1表示不压缩
+    EventLoopThreadPool threadPool_;
+    std::string message_;
+    int numSessions_;
+    int duration_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    std::vector<HdrHistogram> histograms_; // 每个loop一个
+    std::atomic_int numConnected_;
+    std::atomic_bool running_;
+    int64_t startTime_;
+    int64_t stopTime_;
+};
+
+void Session::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setTcpNoDelay(true);
+        if (owner_->codec() >= 0)
+        {
+            conn->addFilter(std::unique_ptr<ConnectionFilter>(
+                new CompressionFilter(static_cast<CompressionFilter::Codec>(owner_->codec()))));
+        }
+        owner_->onConnect();
+        sendTime_ = nowNanos();
+        conn->send(owner_->message());
+    }
+    else
+    {
+        owner_->onDisconnect();
+    }
+}
+
+void Session::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    const size_t messageSize = owner_->message().size();
+    // 收齐一个完整的回显消息，才算一次往返
+    while (buf->readableBytes() >= messageSize)
+    {
+        int64_t now = nowNanos();
+        histogram_->record(now - sendTime_);
+        buf->retrieve(messageSize);
+        bytesRead_ += messageSize;
+        ++messagesRead_;
+        if (!owner_->running())
+        {
+            return;
+        }
+        sendTime_ = now;
+        conn->send(owner_->message());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string ip = "127.0.0.1";
+    uint16_t port = 9981;
+    int messageSize = 64;
+    int numSessions = 1;
+    int numThreads = 0;
+    int duration = 10;
+    std::string unixPath;
+    bool useTls = false;
+    int codec = -1;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "h:p:u:s:c:t:d:Tz:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'h': ip = optarg; break;
+            case 'p': port = static_cast<uint16_t>(atoi(optarg)); break;
+            case 'u': unixPath = optarg; break;
+            case 's': messageSize = atoi(optarg); break;
+            case 'c': numSessions = atoi(optarg); break;
+            case 't': numThreads = atoi(optarg); break;
+            case 'd': duration = atoi(optarg); break;
+            case 'T': useTls = true; break;
+            case 'z':
+                codec = std::string(optarg) == "lz4" ? CompressionFilter::kLz4
+                      : std::string(optarg) == "zstd" ? CompressionFilter::kZstd : -2;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-h ip] [-p port] [-u unixPath] [-s messageSize] "
+                        "[-c connections] [-t threads] [-d seconds] [-T] [-z lz4|zstd]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (messageSize <= 0 || numSessions <= 0 || duration <= 0)
+    {
+        fprintf(stderr, "messageSize, connections and seconds must be positive\n");
+        return 1;
+    }
+    if (codec == -2 || (codec >= 0 && !CompressionFilter::supported(static_cast<CompressionFilter::Codec>(codec))))
+    {
+        fprintf(stderr, "-z: unknown codec or not built in\n");
+        return 1;
+    }
+
+    InetAddress serverAddr = unixPath.empty() ? InetAddress(port, ip) : InetAddress::fromUnixPath(unixPath);
+    printf("pingpong: %s size=%d connections=%d threads=%d duration=%ds%s\n",
+           serverAddr.toIpPort().c_str(), messageSize, numSessions, numThreads, duration, useTls ? " tls" : "");
+
+    std::shared_ptr<TlsContext> tls;
+    if (useTls)
+    {
+        tls.reset(new TlsContext(TlsContext::kClient));
+        tls->setVerifyPeer(false);
+    }
+
+    EventLoop loop;
+    Client client(&loop, serverAddr, messageSize, numSessions, numThreads, duration, tls, codec);
+    loop.loop();
+    client.report();
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TlsContext.h"
+#include "ConnectionFilter.h"
+#include "LatencyStats.h"
+#include "FlightRecorder.h"
+#include "StallWatchdog.h"
+#include "MemoryBudget.h"
+
+#include <string>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// ping-pong基准测试的服务端：把收到的数据原样写回
+// 用法：pingpong_server [-p port] [-u unixPath] [-t threads] [-b busyPollUs] [-k] [-T cert:key [-K]] [-z lz4|zstd] [-l seconds] [-F trace.json] [-W ms] [-M megabytes]
+// -T用给定的证书和私钥开启TLS，-K同时尝试kTLS；-z在每条连接上加CompressionFilter（客户端须使用相同的-z）
+// -l每隔seconds秒打印一次请求延迟的分段统计（内核排队/分发/回调/写出），并清零
+// -F开启FlightRecorder，每10秒把最近的事件导出为Chrome trace JSON（覆盖写入）
+// -W开启卡顿看门狗，一轮循环超过ms毫秒时报告正在执行的回调及调用栈（同时有-F时立即导出trace）
+// -M限制所有连接的缓冲区内存（MemoryBudget），超过时暂停读/拒绝新连接，每5秒打印一次占用
+class PingPongServer
+{
+public:
+    PingPongServer(EventLoop *loop, const InetAddress &addr, int numThreads, int busyPollUs, bool autoCork,
+                   const std::shared_ptr<TlsContext> &tls, int codec, const std::shared_ptr<LatencyStats> &latency,
+                   const std::shared_ptr<StallWatchdog> &watchdog, const std::shared_ptr<MemoryBudget> &budget)
+        : server_(loop, addr, "PingPongServer")
+        , codec_(codec)
+    {
+        server_.setTlsContext(tls);
+        server_.setLatencyStats(latency);
+        server_.setStallWatchdog(watchdog);
+        server_.setMemoryBudget(budget);
+        server_.setConnectionCallback(
+            std::bind(&PingPongServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(
+            std::bind(&PingPongServer::onMessage, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(numThreads);
+        if (busyPollUs > 0 || autoCork)
+        {
+            server_.setThreadInitcallback([busyPollUs, autoCork](EventLoop *ioLoop) {
+                ioLoop->setBusyPoll(busyPollUs);
+                ioLoop->setAutoCork(autoCork);
+            });
+        }
+    }
+
+    void start() { server_.start(); }
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            if (codec_ >= 0)
+            {
+                conn->addFilter(std::unique_ptr<ConnectionFilter>(
+                    new CompressionFilter(static_cast<CompressionFilter::Codec>(codec_))));
+            }
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf->retrieveAllAsString());
+    }
+
+    TcpServer server_;
+    int codec_; // -1表示不压缩
+};
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = 9981;
+    int numThreads = 0;
+    int busyPollUs = 0;
+    bool autoCork = false;
+    std::string unixPath;
+    std::string tlsFiles;
+    bool kernelTls = false;
+    int codec = -1;
+    double statsInterval = 0;
+    std::string tracePath;
+    int stallMs = 0;
+    size_t budgetMb = 0;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "p:u:t:b:kT:Kz:l:F:W:M:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': port = static_cast<uint16_t>(atoi(optarg)); break;
+            case 'u': unixPath = optarg; break;
+            case 't': numThreads = atoi(optarg); break;
+            case 'b': busyPollUs = atoi(optarg); break;
+            case 'k': autoCork = true; break;
+            case 'T': tlsFiles = optarg; break;
+            case 'K': kernelTls = true; break;
+            case 'z':
+                codec = std::string(optarg) == "lz4" ? CompressionFilter::kLz4
+                      : std::string(optarg) == "zstd" ? CompressionFilter::kZstd : -2;
+                break;
+            case 'l': statsInterval = atof(optarg); break;
+            case 'F': tracePath = optarg; break;
+            case 'W': stallMs = atoi(optarg); break;
+            case 'M': budgetMb = static_cast<size_t>(atol(optarg)); break;
+            default:
+                fprintf(stderr, "Usage: %s [-p port] [-u unixPath] [-t threads] [-b busyPollUs] [-k] "
+                        "[-T cert:key [-K]] [-z lz4|zstd] [-l seconds] [-F trace.json] [-W ms] [-M megabytes]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (codec == -2 || (codec >= 0 && !CompressionFilter::supported(static_cast<CompressionFilter::Codec>(codec))))
+    {
+        fprintf(stderr, "-z: unknown codec or not built in\n");
+        return 1;
+    }
+
+    std::shared_ptr<TlsContext> tls;
+    if (!tlsFiles.empty())
+    {
+        std::string::size_type colon = tlsFiles.find(':');
+        tls.reset(new TlsContext(TlsContext::kServer));
+        if (colon == std::string::npos
+            || !tls->useCertificate(tlsFiles.substr(0, colon), tlsFiles.substr(colon + 1)))
+        {
+            fprintf(stderr, "invalid -T cert:key\n");
+            return 1;
+        }
+        tls->setKernelTls(kernelTls);
+    }
+
+    EventLoop loop;
+    loop.setAutoCork(autoCork);
+    InetAddress addr = unixPath.empty() ? InetAddress(port, "0.0.0.0") : InetAddress::fromUnixPath(unixPath);
+    std::shared_ptr<LatencyStats> latency;
+    if (statsInterval > 0)
+    {
+        latency.reset(new LatencyStats);
+        loop.runEvery(statsInterval, [latency]() {
+            printf("%s\n", latency->toString().c_str());
+            fflush(stdout);
+            latency->reset();
+        });
+    }
+    if (!tracePath.empty())
+    {
+        FlightRecorder::enable(true);
+        loop.runEvery(10.0, [tracePath]() { FlightRecorder::dumpChromeTrace(tracePath); });
+    }
+    std::shared_ptr<StallWatchdog> watchdog;
+    if (stallMs > 0)
+    {
+        watchdog = std::make_shared<StallWatchdog>(stallMs / 1000.0);
+        watchdog->setTraceDumpPath(tracePath);
+        watchdog->start();
+    }
+    std::shared_ptr<MemoryBudget> budget;
+    if (budgetMb > 0)
+    {
+        budget = std::make_shared<MemoryBudget>(budgetMb << 20);
+        loop.runEvery(5.0, [budget]() {
+            printf("%s\n", budget->toString().c_str());
+            fflush(stdout);
+        });
+    }
+    PingPongServer server(&loop, addr, numThreads, busyPollUs, autoCork, tls, codec, latency, watchdog, budget);
+    server.start();
+    loop.loop();
+    return 0;
+}
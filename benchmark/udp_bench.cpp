@@ -0,0 +1,170 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * UDP收包吞吐基准测试：
+ *   服务端：udp_bench -s [-p port] [-t threads] [-e] [-g] [-G]  每秒打印收到的数据报数（-e回显，-g开启GRO，-G回显时使用GSO）
+ *   发送端：udp_bench -c [-h host] [-p port] [-n senders] [-z size] [-d seconds]
+ * 发送端每个线程一个socket（源端口不同，服务端的SO_REUSEPORT会把它们分散到不同的loop），用sendmmsg批量发送。
+ */
+
+static void runServer(uint16_t port, int numThreads, bool echo, bool gro, bool gso)
+{
+    EventLoop loop;
+    UdpServer server(&loop, InetAddress(port, "0.0.0.0"), "UdpBench");
+    server.setThreadNum(numThreads);
+    server.setGro(gro);
+    server.setGso(gso);
+    server.setReceiveBufferSize(4 * 1024 * 1024);
+    if (echo)
+    {
+        server.setMessageCallback([](UdpChannel *channel, const UdpDatagram *datagrams, size_t n, Timestamp) {
+            for (size_t i = 0; i < n; ++i)
+            {
+                channel->sendTo(datagrams[i].peer, datagrams[i].data, datagrams[i].len);
+            }
+        });
+    }
+    server.start();
+
+    uint64_t last = 0;
+    loop.runEvery(1.0, [&server, &last]() {
+        uint64_t total = 0;
+        uint64_t dropped = 0;
+        for (const std::unique_ptr<UdpChannel> &channel : server.channels())
+        {
+            total += channel->receivedDatagrams();
+            dropped += channel->droppedDatagrams();
+        }
+        printf("received %llu datagrams/s, dropped %llu in total\n",
+            static_cast<unsigned long long>(total - last), static_cast<unsigned long long>(dropped));
+        fflush(stdout);
+        last = total;
+    });
+    loop.loop();
+}
+
+static void runClient(const char *host, uint16_t port, int senders, size_t size, int seconds)
+{
+    const int kBatch = 64;
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> sent(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < senders; ++t)
+    {
+        threads.emplace_back([&]() {
+            int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            sockaddr_in addr;
+            ::memset(&addr, 0, sizeof addr);
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            ::inet_pton(AF_INET, host, &addr.sin_addr);
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+            {
+                perror("connect");
+                return;
+            }
+            std::string payload(size, 'u');
+            iovec iov[kBatch];
+            mmsghdr msgs[kBatch];
+            ::memset(msgs, 0, sizeof msgs);
+            for (int i = 0; i < kBatch; ++i)
+            {
+                iov[i].iov_base = &payload[0];
+                iov[i].iov_len = payload.size();
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                int n = ::sendmmsg(fd, msgs, kBatch, 0);
+                if (n > 0)
+                {
+                    sent.fetch_add(n, std::memory_order_relaxed);
+                }
+            }
+            ::close(fd);
+        });
+    }
+
+    uint64_t last = 0;
+    for (int s = 0; s < seconds; ++s)
+    {
+        ::sleep(1);
+        uint64_t total = sent.load();
+        printf("sent %llu datagrams/s\n", static_cast<unsigned long long>(total - last));
+        fflush(stdout);
+        last = total;
+    }
+    stop = true;
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool server = false;
+    bool client = false;
+    bool echo = false;
+    bool gro = false;
+    bool gso = false;
+    const char *host = "127.0.0.1";
+    uint16_t port = 9982;
+    int numThreads = 0;
+    int senders = 1;
+    size_t size = 64;
+    int seconds = 10;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "sceGgh:p:t:n:z:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': server = true; break;
+            case 'c': client = true; break;
+            case 'e': echo = true; break;
+            case 'g': gro = true; break;
+            case 'G': gso = true; break;
+            case 'h': host = optarg; break;
+            case 'p': port = static_cast<uint16_t>(atoi(optarg)); break;
+            case 't': numThreads = atoi(optarg); break;
+            case 'n': senders = atoi(optarg); break;
+            case 'z': size = static_cast<size_t>(atoi(optarg)); break;
+            case 'd': seconds = atoi(optarg); break;
+            default:
+                server = client = false;
+                break;
+        }
+    }
+    if (server == client)
+    {
+        fprintf(stderr, "Usage: %s -s [-p port] [-t threads] [-e] [-g] [-G]\n"
+                        "       %s -c [-h host] [-p port] [-n senders] [-z size] [-d seconds]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    if (server)
+    {
+        runServer(port, numThreads, echo, gro, gso);
+    }
+    else
+    {
+        runClient(host, port, senders, size, seconds);
+    }
+    return 0;
+}
@@ -4,12 +4,13 @@
 #include "Channel.h"
 
 #include <functional>
+#include <string>
 
 class EventLoop;
 class InetAddress;
 
-// Acceptor of incoming TCP connections.
-class Acceptor : noncopyable
+// Acceptor of incoming TCP connections（监听地址也可以是AF_UNIX的Unix域socket）.
+class Acceptor : noncopyable, private ChannelHandler
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
@@ -24,7 +25,8 @@ public:
     bool listenning() const { return listenning_; }
     void listen();
 private:
-    void handleRead();
+    // listenfd可读：接受新连接（acceptChannel_的ChannelHandler）
+    void handleRead(Timestamp receiveTime) override;
     
     EventLoop *loop_; // Acceptor用的就是用户定义的那个baseLoop，也称作mainLoop
     Socket acceptSocket_;
@@ -34,4 +36,5 @@ private:
     NewConnectionCallback newConnectionCallback_;
 
     bool listenning_;
+    std::string unixPath_; // 监听的Unix域socket路径，析构时删除socket文件
 };
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "Logger.h"
+#include "MemSearch.h"
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <endian.h>
 
 // 网络库底层的缓冲器类型定义
 // +-------------------+------------------+------------------+
@@ -31,7 +35,8 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        // releaseIfEmpty()之后buffer_为空，而writerIndex_仍停在kCheapPrepend
+        return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0;
     }
 
     size_t prependableBytes() const
@@ -39,6 +44,37 @@ public:
         return readerIndex_;
     }
 
+    void swap(Buffer &rhs)
+    {
+        buffer_.swap(rhs.buffer_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
+    // buffer_实际占用的内存
+    size_t internalCapacity() const
+    {
+        return buffer_.capacity();
+    }
+
+    // 释放多余的内存：只保留可读数据和reserve字节的可写空间
+    void shrink(size_t reserve)
+    {
+        Buffer other(readableBytes() + reserve);
+        other.append(peek(), readableBytes());
+        swap(other);
+    }
+
+    // 没有可读数据时释放全部内存（连同预留的头部空间），下次写入时再按需分配
+    void releaseIfEmpty()
+    {
+        if (readableBytes() == 0 && buffer_.capacity() > 0)
+        {
+            std::vector<char>().swap(buffer_);
+            readerIndex_ = writerIndex_ = kCheapPrepend;
+        }
+    }
+
     // 获取缓冲区buffer_中，可读数据的起始地址
     const char* peek() const
     {
@@ -111,24 +147,249 @@ public:
         return begin() + writerIndex_;
     }
 
+    // 直接写入beginWrite()之后，调用hasWritten移动writerIndex_
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
+    /* 以网络字节序（大端）读写整数：append追加到尾部，peek/read从头部读取，prepend写入头部的预留空间 */
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = static_cast<int64_t>(htobe64(static_cast<uint64_t>(x)));
+        append(reinterpret_cast<const char*>(&be64), sizeof be64);
+    }
+
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(x)));
+        append(reinterpret_cast<const char*>(&be32), sizeof be32);
+    }
+
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = static_cast<int16_t>(htobe16(static_cast<uint16_t>(x)));
+        append(reinterpret_cast<const char*>(&be16), sizeof be16);
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(reinterpret_cast<const char*>(&x), sizeof x);
+    }
+
+    // 要求readableBytes() >= sizeof(int64_t)
+    int64_t peekInt64() const
+    {
+        if (readableBytes() < sizeof(int64_t))
+        {
+            LOG_FATAL("peekInt64 with %lu readable bytes!\n", readableBytes());
+        }
+        uint64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return static_cast<int64_t>(be64toh(be64));
+    }
+
+    int32_t peekInt32() const
+    {
+        if (readableBytes() < sizeof(int32_t))
+        {
+            LOG_FATAL("peekInt32 with %lu readable bytes!\n", readableBytes());
+        }
+        uint32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return static_cast<int32_t>(be32toh(be32));
+    }
+
+    int16_t peekInt16() const
+    {
+        if (readableBytes() < sizeof(int16_t))
+        {
+            LOG_FATAL("peekInt16 with %lu readable bytes!\n", readableBytes());
+        }
+        uint16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof be16);
+        return static_cast<int16_t>(be16toh(be16));
+    }
+
+    int8_t peekInt8() const
+    {
+        if (readableBytes() < sizeof(int8_t))
+        {
+            LOG_FATAL("peekInt8 with %lu readable bytes!\n", readableBytes());
+        }
+        return static_cast<int8_t>(*peek());
+    }
+
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    // 把[data, data+len]写到可读数据的前面（使用prependable区域，不移动已有数据）
+    void prepend(const void *data, size_t len)
+    {
+        if (buffer_.empty())
+        {
+            buffer_.resize(kCheapPrepend); // 已经被releaseIfEmpty()释放
+        }
+        if (len > prependableBytes())
+        {
+            LOG_FATAL("prepend %lu bytes, only %lu prependable!\n", len, prependableBytes());
+        }
+        readerIndex_ -= len;
+        const char *d = static_cast<const char*>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = static_cast<int64_t>(htobe64(static_cast<uint64_t>(x)));
+        prepend(&be64, sizeof be64);
+    }
+
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(x)));
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = static_cast<int16_t>(htobe16(static_cast<uint16_t>(x)));
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
     const char* beginWrite() const
     {
         return begin() + writerIndex_;
     }
 
-    // 从fd上读取数据（从fd的接收缓冲区读取数据）
-    ssize_t readFd(int fd, int* saveErrno);
+    // 在可读区域中查找"\r\n"，返回指向'\r'的指针，找不到返回nullptr
+    const char* findCRLF() const
+    {
+        return MemSearch::findCRLF(peek(), beginWrite());
+    }
+
+    // 从start（位于可读区域内）开始查找"\r\n"
+    const char* findCRLF(const char *start) const
+    {
+        return MemSearch::findCRLF(start, beginWrite());
+    }
+
+    // 可续查版本：从peek()+*offset开始查找。找到时*offset为匹配位置相对peek()的偏移；
+    // 找不到时*offset推进到下次需要重新检查的位置，增量解析时已检查过的字节不会被重复扫描
+    const char* findCRLF(size_t *offset) const
+    {
+        return resume(MemSearch::findCRLF(peek() + *offset, beginWrite()), offset, 2);
+    }
+
+    // 查找行尾'\n'
+    const char* findEOL() const
+    {
+        return MemSearch::findEOL(peek(), beginWrite());
+    }
+
+    const char* findEOL(const char *start) const
+    {
+        return MemSearch::findEOL(start, beginWrite());
+    }
+
+    const char* findEOL(size_t *offset) const
+    {
+        return resume(MemSearch::findEOL(peek() + *offset, beginWrite()), offset, 1);
+    }
+
+    // 查找单个字节
+    const char* findByte(char c) const
+    {
+        return MemSearch::findByte(peek(), beginWrite(), c);
+    }
+
+    const char* findByte(char c, size_t *offset) const
+    {
+        return resume(MemSearch::findByte(peek() + *offset, beginWrite(), c), offset, 1);
+    }
+
+    // 查找任意长度的分隔符
+    const char* find(const char *needle, size_t len) const
+    {
+        return MemSearch::find(peek(), beginWrite(), needle, len);
+    }
+
+    const char* find(const char *needle, size_t len, const char *start) const
+    {
+        return MemSearch::find(start, beginWrite(), needle, len);
+    }
+
+    const char* find(const char *needle, size_t len, size_t *offset) const
+    {
+        return resume(MemSearch::find(peek() + *offset, beginWrite(), needle, len), offset, len);
+    }
+
+    // 从fd上读取数据（从fd的接收缓冲区读取数据），一次最多读maxBytes字节
+    ssize_t readFd(int fd, int* saveErrno, size_t maxBytes = SIZE_MAX);
+    // 从AF_UNIX socket上读取数据，同时把随数据到达的描述符（SCM_RIGHTS）追加到fds
+    ssize_t readFd(int fd, int* saveErrno, std::vector<int> *fds, size_t maxBytes = SIZE_MAX);
+    /**
+     * 用recvmsg读取数据并解析附带的控制消息：fds不为空时接收描述符（同上）；
+     * receiveTimeNs不为空且socket开启了SO_TIMESTAMPNS时，取得内核收到数据的时间（纳秒，CLOCK_REALTIME），没有时置0
+     */
+    ssize_t recvMsg(int fd, int* saveErrno, std::vector<int> *fds, int64_t *receiveTimeNs, size_t maxBytes = SIZE_MAX);
     // 通过fd发送数据（给fd发送缓冲区写入数据）
     ssize_t writeFd(int fd, int* saveErrno);
 private:
+    // 更新可续查的偏移：未找到时，末尾不足needleLen-1字节的部分可能是分隔符的前缀，下次从那里重新检查
+    const char* resume(const char *found, size_t *offset, size_t needleLen) const
+    {
+        if (found != nullptr)
+        {
+            *offset = found - peek();
+        }
+        else
+        {
+            size_t readable = readableBytes();
+            size_t next = readable >= needleLen ? readable - needleLen + 1 : 0;
+            *offset = std::max(*offset, next);
+        }
+        return found;
+    }
+
     char* begin()
     {
         // 获取buffer_中，首个元素的地址，即数组的起始地址
-        return &*buffer_.begin();  // vector底层数组首元素的地址，也就是数组的起始地址
+        return buffer_.data();  // vector底层数组首元素的地址，也就是数组的起始地址
     }
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
 	
 	/* 
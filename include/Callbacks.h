@@ -14,4 +14,10 @@ using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 
 using MessageCallback = std::function<void (const TcpConnectionPtr&, Buffer*, Timestamp)>;
 
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+
+using TimerCallback = std::function<void()>;
+
+// 用户未设置回调时使用的默认实现（定义在TcpConnection.cpp中）
+void defaultConnectionCallback(const TcpConnectionPtr &conn);
+void defaultMessageCallback(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp receiveTime);
\ No newline at end of file
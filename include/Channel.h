@@ -2,6 +2,7 @@
 
 #include "noncopyable.h"
 #include "Timestamp.h"
+#include "ChannelHandler.h"
 
 #include <functional>
 #include <memory>
@@ -25,11 +26,13 @@ public:
     /* 当fd_得到poller的事件后，处理事件，即调用相应的回调函数 */
     void handleEvent(Timestamp receiveTime);  
 
-    // 初始化不同类型事件的回调函数对象
-    void setReadCallback(ReadEventCallback cb) { readCallback_ = std::move(cb); }
-    void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
-    void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
-    void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    // 事件交给handler处理（见ChannelHandler），handler的生命期不短于channel
+    void setHandler(ChannelHandler *handler) { handler_ = handler; }
+    // 或者为不同类型的事件分别设置回调函数对象（第一次设置时分配，与setHandler二选一）
+    void setReadCallback(ReadEventCallback cb);
+    void setWriteCallback(EventCallback cb);
+    void setCloseCallback(EventCallback cb);
+    void setErrorCallback(EventCallback cb);
 
     // 防止当channel被手动remove掉，channel还在执行回调操作
     void tie(const std::shared_ptr<void>&);
@@ -39,7 +42,8 @@ public:
     // 返回该Channel监听的文件描述符所感兴趣的事件
     int events() const { return events_; }
     // 设置pollers返回的发生的事件
-    int set_revents(int revt) { revents_ = revt; }
+    void set_revents(int revt) { revents_ = revt; }
+    int revents() const { return revents_; }
 
     // 设置fd相应的事件状态
     void enableReading() { events_ |= kReadEvent; update(); }
@@ -67,6 +71,9 @@ private:
     */
     void update();
     void handleEventWithGuard(Timestamp receiveTime);
+    // 把set*Callback设置的回调包装成ChannelHandler
+    class CallbackHandler;
+    CallbackHandler* callbackHandler();
 
     static const int kNoneEvent;
     static const int kReadEvent;
@@ -83,11 +90,8 @@ private:
     std::weak_ptr<void> tie_;
     bool tied_;
 
-    // 因Channel可获知fd返回的发生的具体事件revents，所以它负责调用具体事件的回调操作
-    //，故可在该类中注册各种读/写/异常/关闭回调函数
-    ReadEventCallback readCallback_;
-    EventCallback writeCallback_;
-    EventCallback closeCallback_;
-    EventCallback errorCallback_;
+    // 因Channel可获知fd返回的发生的具体事件revents，所以它负责调用具体事件的处理函数
+    ChannelHandler *handler_;
+    std::unique_ptr<CallbackHandler> callbacks_; // 使用set*Callback时才分配
 };
 
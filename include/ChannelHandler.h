@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Timestamp.h"
+
+/**
+ * Channel的事件处理接口（Channel::setHandler）：Channel只存一个指针，
+ * 每个事件是一次虚函数调用，省去std::function的类型擦除和std::bind的转发，
+ * Channel也不必为读/写/关闭/错误各存一个可调用对象。
+ * TcpConnection、Acceptor和EventLoop的wakeup channel使用它；其他channel仍可用setReadCallback等。
+ * 不感兴趣的事件保留默认的空实现。
+ */
+class ChannelHandler
+{
+public:
+    virtual void handleRead(Timestamp) {}
+    virtual void handleWrite() {}
+    virtual void handleClose() {}
+    virtual void handleError() {}
+protected:
+    // 不通过ChannelHandler指针析构
+    ~ChannelHandler() {}
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/**
+ * 连接上的数据变换（压缩、校验、自定义编码等），位于用户的send/MessageCallback与socket（或TLS）之间：
+ *
+ *   send → filter[0].encode → ... → filter[n-1].encode → TLS加密 → socket
+ *   socket → TLS解密 → filter[n-1].decode → ... → filter[0].decode → inputBuffer_ → MessageCallback
+ *
+ * 每个连接有自己的filter对象（保存该连接的解码状态），在ConnectionCallback（连接建立时）中
+ * 用TcpConnection::addFilter添加。所有方法都在连接所属的loop线程中调用。
+ */
+class ConnectionFilter : noncopyable
+{
+public:
+    virtual ~ConnectionFilter() = default;
+
+    // 出方向：把要发送的数据变换后追加到out
+    virtual void encode(const struct iovec *iov, int iovcnt, Buffer *out) = 0;
+    // 入方向：处理in中完整的部分并从in中取走，结果追加到out。返回false表示数据无效，连接会被关闭
+    virtual bool decode(Buffer *in, Buffer *out) = 0;
+};
+
+// 一个连接上按顺序排列的filter，以及各级之间的缓冲区
+class FilterChain : noncopyable
+{
+public:
+    void add(std::unique_ptr<ConnectionFilter> filter);
+
+    // 出方向：数据按添加顺序经过各filter，返回结果所在的缓冲区，调用方发送后将其清空
+    Buffer* encode(const struct iovec *iov, int iovcnt);
+    // 入方向：input()中的数据按相反顺序逐级解码，结果追加到out
+    bool decode(Buffer *out);
+
+    // 从socket（或TLS）收到、还没有解码的数据
+    Buffer* input() { return &input_; }
+    // TcpConnection::outputBuffer()返回的缓冲区，sendOutputBuffer()时经过各filter发送
+    Buffer* staging() { return &staging_; }
+private:
+    std::vector<std::unique_ptr<ConnectionFilter>> filters_;
+    std::vector<Buffer> encoded_; // encoded_[i]：filters_[i]编码的结果
+    std::vector<Buffer> decoded_; // decoded_[i]：filters_[i+1]解码的结果
+    Buffer input_;
+    Buffer staging_;
+};
+
+/**
+ * 分块压缩：每次send的数据切成不超过64KB的块，各块独立压缩，块格式为
+ * [压缩后长度 int32][原始长度 int32][数据]，两个长度相等时数据未压缩（太短或压缩后没有变小）。
+ * 压缩/解压上下文按线程（即按loop）复用，不随连接分配，适合大量连接。
+ * LZ4和zstd分别在编译时找到对应的库才可用（见supported()），两端必须使用相同的codec。
+ */
+class CompressionFilter : public ConnectionFilter
+{
+public:
+    enum Codec { kLz4, kZstd };
+
+    static const size_t kMaxBlockSize = 64 * 1024;
+    // 短于它的块不压缩
+    static const size_t kMinCompressSize = 64;
+
+    // level：zstd的压缩级别；LZ4为acceleration（越大越快，压缩率越低）
+    explicit CompressionFilter(Codec codec, int level = 1);
+
+    static bool supported(Codec codec);
+
+    void encode(const struct iovec *iov, int iovcnt, Buffer *out) override;
+    bool decode(Buffer *in, Buffer *out) override;
+
+    // 统计：编码前后的字节数
+    int64_t rawBytes() const { return rawBytes_; }
+    int64_t wireBytes() const { return wireBytes_; }
+private:
+    void encodeBlock(const char *data, size_t len, Buffer *out);
+    size_t compressBound(size_t len) const;
+    // 返回压缩后的长度，0表示失败
+    size_t compress(const char *src, size_t len, char *dst, size_t capacity);
+    bool decompress(const char *src, size_t len, char *dst, size_t rawLen);
+
+    Codec codec_;
+    int level_;
+    int64_t rawBytes_;
+    int64_t wireBytes_;
+};
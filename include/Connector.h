@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接：非阻塞connect + 等待可写事件。
+ * 连接失败后按指数退避重试（kInitRetryDelayMs起，每次翻倍，最大kMaxRetryDelayMs）。
+ * Connector只负责建立连接，成功后把sockfd交给newConnectionCallback_（通常是TcpClient）。
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb)
+    { newConnectionCallback_ = cb; }
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+
+    void start();   // can be called in any thread
+    void restart(); // must be called in loop thread
+    void stop();    // can be called in any thread
+private:
+    enum States { kDisconnected, kConnecting, kConnected };
+    static const int kMaxRetryDelayMs = 30 * 1000;
+    static const int kInitRetryDelayMs = 500;
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否希望保持连接
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_; // 只在connecting阶段存在
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+    TimerId retryTimer_;
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+/**
+ * 可选的C++20协程层：用顺序的代码写连接处理逻辑，不必在MessageCallback里手写状态机。
+ * 只有头文件，库本身仍按C++11编译；使用它的源文件需要用-std=c++20编译。
+ *
+ *   coro::Task echoLines(coro::Stream &s)
+ *   {
+ *       while (auto line = co_await s.readUntil("\r\n"))
+ *       {
+ *           co_await s.write(*line);
+ *           co_await s.write("\r\n");
+ *       }
+ *   }
+ *   coro::serve(&server, echoLines);
+ *
+ * - 协程始终运行在连接所属的loop线程中：数据到达时在MessageCallback里直接恢复（resume）协程，
+ *   能立即满足的读操作不会挂起，恢复过程不分配内存。
+ * - 读操作返回的StringPiece直接指向inputBuffer_，在下一次co_await之前有效。
+ * - 协程帧从每线程的空闲链表中分配，连接建立/关闭不会每次都走malloc。
+ * - 连接关闭后，读操作返回空值、write返回false；处理函数返回时主动shutdown连接。
+ * - Stream保存在连接的context中，使用协程层的连接不能再setContext。
+ */
+#if !defined(__cpp_impl_coroutine)
+#error "Coroutine.h requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include "TcpConnection.h"
+#include "TcpServer.h"
+#include "Buffer.h"
+#include "StringPiece.h"
+#include "noncopyable.h"
+
+#include <coroutine>
+#include <optional>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stddef.h>
+
+namespace coro
+{
+
+// 协程帧的每线程内存池：按64字节分级，每级缓存有限个空闲块，超过kMaxPooledSize的帧直接用operator new
+class FramePool
+{
+public:
+    static void* allocate(size_t size)
+    {
+        size_t cls = sizeClass(size);
+        if (cls < kClasses)
+        {
+            FreeList &list = lists()[cls];
+            if (list.head != nullptr)
+            {
+                Block *block = list.head;
+                list.head = block->next;
+                --list.count;
+                return block;
+            }
+            return ::operator new((cls + 1) * kGranularity);
+        }
+        return ::operator new(size);
+    }
+
+    static void deallocate(void *p, size_t size)
+    {
+        size_t cls = sizeClass(size);
+        if (cls < kClasses)
+        {
+            FreeList &list = lists()[cls];
+            if (list.count < kMaxCached)
+            {
+                Block *block = static_cast<Block*>(p);
+                block->next = list.head;
+                list.head = block;
+                ++list.count;
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+private:
+    static const size_t kGranularity = 64;
+    static const size_t kMaxPooledSize = 4096;
+    static const size_t kClasses = kMaxPooledSize / kGranularity;
+    static const size_t kMaxCached = 1024;
+
+    struct Block
+    {
+        Block *next;
+    };
+    struct FreeList
+    {
+        Block *head = nullptr;
+        size_t count = 0;
+
+        ~FreeList()
+        {
+            while (head != nullptr)
+            {
+                Block *next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    };
+
+    static size_t sizeClass(size_t size) { return (size + kGranularity - 1) / kGranularity - 1; }
+    static FreeList* lists()
+    {
+        static thread_local FreeList t_lists[kClasses];
+        return t_lists;
+    }
+};
+
+class Stream;
+
+// 连接处理函数的返回类型：由Stream启动，运行结束后帧自动释放
+class Task
+{
+public:
+    struct promise_type
+    {
+        Stream *stream = nullptr;
+
+        Task get_return_object() noexcept { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        // 先挂起，等Stream记录好句柄之后再开始运行
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+        inline ~promise_type();
+
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void *p, size_t size) { FramePool::deallocate(p, size); }
+    };
+
+    Task(Task &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy(); // 没有交给Stream运行
+        }
+    }
+
+    std::coroutine_handle<promise_type> release()
+    {
+        std::coroutine_handle<promise_type> handle = handle_;
+        handle_ = nullptr;
+        return handle;
+    }
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * 一个连接上的协程读写接口，所有方法都 must be called in loop thread（即在协程中）。
+ */
+class Stream : noncopyable
+{
+public:
+    using Handler = std::function<Task(Stream&)>;
+
+    // 在ConnectionCallback（连接建立时）中调用：接管连接的MessageCallback并启动处理函数
+    static void attach(const TcpConnectionPtr &conn, const Handler &handler)
+    {
+        std::shared_ptr<Stream> stream(new Stream(conn.get()));
+        conn->setContext(stream);
+        conn->setMessageCallback(&Stream::onMessage);
+
+        Task task = handler(*stream);
+        std::coroutine_handle<Task::promise_type> handle = task.release();
+        handle.promise().stream = stream.get();
+        stream->root_ = handle;
+        handle.resume();
+    }
+
+    // 在ConnectionCallback（连接断开时）中调用：唤醒等待中的协程，读操作返回空值
+    static void detach(const TcpConnectionPtr &conn)
+    {
+        Stream *stream = static_cast<Stream*>(conn->getContext().get());
+        if (stream != nullptr)
+        {
+            stream->closed_ = true;
+            stream->resumeWaiter();
+        }
+    }
+
+    ~Stream()
+    {
+        if (root_)
+        {
+            // 处理函数没有结束（例如连接关闭后还在等待），直接销毁它的帧
+            std::coroutine_handle<> root = root_;
+            root_ = nullptr;
+            root.destroy();
+        }
+    }
+
+    struct ReadAwaiter
+    {
+        enum Kind { kUntil, kExactly, kSome };
+
+        Stream *stream;
+        Kind kind;
+        StringPiece delim;
+        size_t size;       // kExactly：需要的字节数；kUntil：不含分隔符的最大长度
+        std::optional<StringPiece> result;
+
+        bool await_ready() { return stream->startRead(this); }
+        void await_suspend(std::coroutine_handle<> handle) { stream->suspend(handle, this); }
+        std::optional<StringPiece> await_resume() { return result; }
+    };
+
+    struct WriteAwaiter
+    {
+        Stream *stream;
+        bool result;
+
+        bool await_ready() const { return stream->closed_ || !stream->overHighWater(); }
+        void await_suspend(std::coroutine_handle<> handle) { stream->suspendWrite(handle); }
+        bool await_resume() const { return !stream->closed_; }
+    };
+
+    // 读到分隔符为止，返回不含分隔符的数据；连接关闭或超过maxLength仍没有分隔符时返回空值
+    ReadAwaiter readUntil(StringPiece delim, size_t maxLength = 64 * 1024)
+    {
+        return ReadAwaiter{this, ReadAwaiter::kUntil, delim, maxLength, std::nullopt};
+    }
+    // 恰好读n个字节
+    ReadAwaiter read(size_t n) { return ReadAwaiter{this, ReadAwaiter::kExactly, StringPiece(), n, std::nullopt}; }
+    // 读目前可用的全部数据（至少1字节）
+    ReadAwaiter readSome() { return ReadAwaiter{this, ReadAwaiter::kSome, StringPiece(), 0, std::nullopt}; }
+
+    /**
+     * 发送数据（不拷贝成临时string）。输出缓冲区超过highWaterMark时挂起，直到数据发送完毕，
+     * 这样生产快于对端接收时协程会被自然地限速。返回false表示连接已经关闭。
+     */
+    WriteAwaiter write(StringPiece data)
+    {
+        if (!closed_ && data.size() > 0)
+        {
+            conn_->sendv({data});
+        }
+        return WriteAwaiter{this, !closed_};
+    }
+
+    void setHighWaterMark(size_t bytes) { highWaterMark_ = bytes; }
+    TcpConnection* connection() const { return conn_; }
+    bool closed() const { return closed_; }
+private:
+    friend struct Task::promise_type;
+
+    explicit Stream(TcpConnection *conn)
+        : conn_(conn)
+        , input_(nullptr)
+        , consumed_(0)
+        , scanned_(0)
+        , closed_(false)
+        , highWaterMark_(64 * 1024)
+        , pending_(nullptr)
+    {
+    }
+
+    static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        Stream *stream = static_cast<Stream*>(conn->getContext().get());
+        stream->input_ = buf;
+        if (stream->pending_ != nullptr && stream->tryRead(stream->pending_))
+        {
+            stream->resumeWaiter();
+        }
+    }
+
+    void onWriteComplete()
+    {
+        conn_->setWriteCompleteCallback(WriteCompleteCallback());
+        if (writing_)
+        {
+            resumeWaiter();
+        }
+    }
+
+    // 新的读操作开始：先丢掉上一次读操作返回给协程的数据
+    bool startRead(ReadAwaiter *op)
+    {
+        if (consumed_ > 0)
+        {
+            input_->retrieve(consumed_);
+            consumed_ = 0;
+        }
+        scanned_ = 0;
+        return tryRead(op);
+    }
+
+    bool tryRead(ReadAwaiter *op)
+    {
+        size_t readable = input_ != nullptr ? input_->readableBytes() : 0;
+        switch (op->kind)
+        {
+            case ReadAwaiter::kUntil:
+            {
+                const char *found = readable > 0 ? input_->find(op->delim.data(), op->delim.size(), &scanned_) : nullptr;
+                if (found != nullptr && static_cast<size_t>(found - input_->peek()) <= op->size)
+                {
+                    size_t len = found - input_->peek();
+                    op->result = StringPiece(input_->peek(), len);
+                    consumed_ = len + op->delim.size();
+                    return true;
+                }
+                if (found != nullptr || readable > op->size + op->delim.size())
+                {
+                    return true; // 行太长，result为空
+                }
+                break;
+            }
+            case ReadAwaiter::kExactly:
+                if (readable >= op->size)
+                {
+                    op->result = StringPiece(input_->peek(), op->size);
+                    consumed_ = op->size;
+                    return true;
+                }
+                break;
+            case ReadAwaiter::kSome:
+                if (readable > 0)
+                {
+                    op->result = StringPiece(input_->peek(), readable);
+                    consumed_ = readable;
+                    return true;
+                }
+                break;
+        }
+        return closed_;
+    }
+
+    void suspend(std::coroutine_handle<> handle, ReadAwaiter *op)
+    {
+        waiter_ = handle;
+        pending_ = op;
+    }
+
+    bool overHighWater() const
+    {
+        return conn_->outputBuffer()->readableBytes() > highWaterMark_;
+    }
+
+    void suspendWrite(std::coroutine_handle<> handle)
+    {
+        waiter_ = handle;
+        writing_ = true;
+        Stream *self = this;
+        conn_->setWriteCompleteCallback([self](const TcpConnectionPtr&) { self->onWriteComplete(); });
+    }
+
+    void resumeWaiter()
+    {
+        if (waiter_)
+        {
+            std::coroutine_handle<> handle = waiter_;
+            waiter_ = nullptr;
+            pending_ = nullptr;
+            writing_ = false;
+            handle.resume();
+        }
+    }
+
+    void handlerDone()
+    {
+        root_ = nullptr;
+        if (!closed_)
+        {
+            conn_->shutdown();
+        }
+    }
+
+    TcpConnection *conn_;  // Stream由连接的context持有，不会比连接活得长
+    Buffer *input_;        // 连接的inputBuffer_，收到第一次数据后才知道
+    size_t consumed_;      // 上一次读操作返回的字节数，下一次读操作开始时才从input_中取走
+    size_t scanned_;       // readUntil已经查找过的偏移
+    bool closed_;
+    bool writing_ = false;
+    size_t highWaterMark_;
+    ReadAwaiter *pending_;
+    std::coroutine_handle<> waiter_;
+    std::coroutine_handle<> root_;
+};
+
+inline Task::promise_type::~promise_type()
+{
+    if (stream != nullptr && stream->root_)
+    {
+        stream->handlerDone();
+    }
+}
+
+// 让server上的每个新连接都运行handler
+inline void serve(TcpServer *server, const Stream::Handler &handler)
+{
+    server->setConnectionCallback([handler](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            Stream::attach(conn, handler);
+        }
+        else
+        {
+            Stream::detach(conn);
+        }
+    });
+}
+
+} // namespace coro
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC32C（Castagnoli）校验：
+ * CPU支持SSE4.2时使用crc32指令（运行时检测），否则使用查表法。
+ */
+namespace Crc32c
+{
+    // 在crc的基础上继续计算[data, data+n)的校验值，用于分段计算
+    uint32_t extend(uint32_t crc, const char *data, size_t n);
+
+    // 计算[data, data+n)的校验值
+    inline uint32_t value(const char *data, size_t n)
+    {
+        return extend(0, data, n);
+    }
+
+    // 当前是否使用了硬件加速
+    bool isHardwareAccelerated();
+}
@@ -5,17 +5,23 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <stdint.h>
 
 #include "Logger.h"
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "ChannelHandler.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class StallWatchdog;
 
 // 事件的循环类：主要包含了Channel和Poller（epoll的抽象）两大类
-class EventLoop : noncopyable
+class EventLoop : noncopyable, private ChannelHandler
 {
 public:
     using Functor = std::function<void()>;
@@ -39,10 +45,71 @@ public:
 	
     // 将cb放入队列中，唤醒loop所在的线程，执行cb
     void queueInLoop(Functor cb);
+    // 队列中还没有执行的cb的个数（Thread safe）
+    size_t queueSize() const;
 
     // 用来唤醒loop所在的线程的
     void wakeup();
 
+    // 定时器：在time时刻执行cb（Thread safe）
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // 在delay秒之后执行cb（Thread safe）
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb（Thread safe）
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器（Thread safe）
+    void cancel(TimerId timerId);
+
+    /**
+     * busy-poll模式（默认关闭）：loop在阻塞于epoll_wait之前，先以0超时轮询IO并检查任务队列，
+     * 自旋时长不超过spinBudgetUs微秒；空闲时自旋预算逐次减半（不低于kMinSpinUs），一旦有事件则恢复。
+     * loop自旋期间，其他线程的queueInLoop不再写eventfd唤醒。
+     * spinBudgetUs <= 0 表示关闭。需在loop()之前或loop所在线程中调用。
+     */
+    void setBusyPoll(int spinBudgetUs);
+    bool busyPolling() const { return spinBudgetUs_ > 0; }
+
+    /**
+     * auto-cork模式（默认关闭）：处理IO事件和pendingFunctors_期间，TcpConnection::send不再立即write，
+     * 而是把数据攒在outputBuffer_里，本轮事件分发结束后每个有数据的连接只write一次。
+     * 一个回调里连续send多条小消息时，可以减少系统调用次数和发出的TCP分段数。
+     * 需在loop()之前或loop所在线程中调用。
+     */
+    void setAutoCork(bool on) { autoCork_ = on; }
+    bool autoCork() const { return autoCork_; }
+    // 当前是否处于攒数据的阶段（auto-cork开启且正在分发事件）
+    bool corking() const { return corking_; }
+    // 本轮事件分发结束后执行cb（如冲刷攒下的数据），must be called in loop thread
+    void runAfterDispatch(Functor cb) { afterDispatchFunctors_.push_back(std::move(cb)); }
+
+    /**
+     * 把cb推迟到下一轮循环：在下一轮的IO事件处理完之后执行，且有推迟的任务时poll不会阻塞。
+     * 用于读预算用完的连接把剩余的消息留到下一轮处理，让同一loop上的其他连接先得到处理。
+     * must be called in loop thread
+     */
+    void deferToNextIteration(Functor cb) { deferredFunctors_.push_back(std::move(cb)); }
+    // 已经开始的循环轮数，用来判断某个操作是否已在本轮执行过
+    uint64_t iteration() const { return iteration_; }
+
+    /**
+     * 由watchdog监视本loop的卡顿（见StallWatchdog），loop析构时自动取消监视。
+     * 需在loop()之前或loop所在线程中调用
+     */
+    void setStallWatchdog(const std::shared_ptr<StallWatchdog> &watchdog);
+    // 以下供看门狗线程读取（Thread safe）：
+    // 本轮从poll返回的时间（微秒），0表示正阻塞在poll中
+    int64_t busySince() const { return busySinceUs_.load(std::memory_order_relaxed); }
+    // 最近一次从poll返回时的轮数
+    uint64_t heartbeat() const { return heartbeat_.load(std::memory_order_relaxed); }
+    // 正在执行的操作："channel"（fd为其fd）、"functor"等，detail为回调的类型名（可能为空）
+    const char* activity(int *fd, const char **detail) const
+    {
+        *fd = activityFd_.load(std::memory_order_relaxed);
+        *detail = activityDetail_.load(std::memory_order_relaxed);
+        return activityKind_.load(std::memory_order_relaxed);
+    }
+    pid_t threadId() const { return threadId_; }
+
     // EventLoop的这些方法，需要调用Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
@@ -58,8 +125,21 @@ public:
         }
     }
 private:
-    void handleRead(); // wake up
-    void doPendingFunctors(); // 执行回调
+    void handleRead(Timestamp receiveTime) override; // wake up（wakeupChannel_的ChannelHandler）
+    bool doPendingFunctors(); // 执行回调，返回是否执行了回调
+    bool stopSpinning(); // busy-poll：准备进入阻塞poll，若有待执行的回调则继续自旋
+    void startSpinning();
+    void doAfterDispatchFunctors();
+    // 被监视时记录正在执行的操作，kind和detail必须指向静态存储
+    void setActivity(const char *kind, int fd, const char *detail)
+    {
+        if (watchdog_)
+        {
+            activityKind_.store(kind, std::memory_order_relaxed);
+            activityFd_.store(fd, std::memory_order_relaxed);
+            activityDetail_.store(detail, std::memory_order_relaxed);
+        }
+    }
 
     using ChannelList = std::vector<Channel*>;
 
@@ -70,6 +150,7 @@ private:
 
     Timestamp pollReturnTime_; // poller返回发生事件的channels的时间点
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_; // 必须在poller_之后构造、之前析构
 
     /*
         主要的作用：当mainloop获取一个新用户的channel
@@ -83,5 +164,23 @@ private:
 
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
     std::vector<Functor> pendingFunctors_; // pendingFunctors_中保存的是其他线程希望该EventLoop线程执行的函数
-    std::mutex mutex_; // 互斥锁，用来保护上面vector容器的线程安全操作
+    mutable std::mutex mutex_; // 互斥锁，用来保护上面vector容器的线程安全操作
+
+    int spinBudgetUs_; // busy-poll的自旋预算（微秒），0表示关闭
+    bool spinning_;    // loop是否处于自旋阶段，由mutex_保护
+
+    bool autoCork_;    // 是否开启auto-cork
+    bool corking_;     // 正在分发事件，send的数据先攒起来
+    std::vector<Functor> afterDispatchFunctors_; // 本轮分发结束后执行（只在loop线程访问）
+
+    uint64_t iteration_;
+    std::vector<Functor> deferredFunctors_; // 推迟到下一轮IO事件之后执行（只在loop线程访问）
+
+    // 卡顿看门狗读取的心跳，loop线程写
+    std::shared_ptr<StallWatchdog> watchdog_;
+    std::atomic<int64_t> busySinceUs_;
+    std::atomic<uint64_t> heartbeat_;
+    std::atomic<const char*> activityKind_;
+    std::atomic<int> activityFd_;
+    std::atomic<const char*> activityDetail_;
 };
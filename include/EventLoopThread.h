@@ -20,6 +20,9 @@ public:
     ~EventLoopThread();
 
     EventLoop* startLoop();
+    // startLoop分成两步：先启动线程，之后再等待loop创建完成，以便同时启动多个loop线程
+    void start();
+    EventLoop* waitLoop();
 private:
     void threadFunc();
 
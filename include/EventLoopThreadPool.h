@@ -26,6 +26,17 @@ public:
 
     std::vector<EventLoop*> getAllLoops();
 
+    /**
+     * 运行期扩缩容（start()之后，在baseLoop线程中调用）：
+     * addLoop新建一个subloop并加入轮询；retireLoop把loop移出轮询，之后不再给它分配新连接，
+     * 但线程继续运行，直到调用者确认它上面的连接都已关闭后调用releaseLoop退出并回收线程。
+     */
+    EventLoop* addLoop();
+    bool retireLoop(EventLoop *loop);
+    void releaseLoop(EventLoop *loop);
+    // 参与轮询的subloop个数
+    size_t numLoops() const { return loops_.size(); }
+
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 private:
@@ -34,6 +45,11 @@ private:
     bool started_;
     int numThreads_;
     int next_;
-    std::vector<std::unique_ptr<EventLoopThread>> threads_;
+    int nextThreadId_; // 新线程名字的编号
+    std::vector<std::unique_ptr<EventLoopThread>> threads_; // 与loops_一一对应
     std::vector<EventLoop*> loops_;
+    ThreadInitCallback threadInitCallback_; // addLoop新建的loop也要执行
+    // 已经退役、等待连接关闭的loop
+    std::vector<std::unique_ptr<EventLoopThread>> retiredThreads_;
+    std::vector<EventLoop*> retiredLoops_;
 };
\ No newline at end of file
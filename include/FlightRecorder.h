@@ -0,0 +1,80 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * 进程内的飞行记录器：每个线程一个环形缓冲区，记录loop中发生的事件（poll、channel分发、回调、accept、close等），
+ * 需要时导出为Chrome/Perfetto trace JSON（chrome://tracing或ui.perfetto.dev打开），查看尾延迟尖刺时各subloop在做什么。
+ *
+ * 始终编译在内，默认关闭：关闭时每个记录点只有一次relaxed load；开启后每个事件是一次rdtsc和一次写环形缓冲区，
+ * 不加锁、不分配内存（每个线程第一次记录时分配一次）。环写满后覆盖最旧的事件。
+ * 导出与记录并发时，导出过程中被覆盖的事件会被丢弃。线程退出后只保留最近退出的8个线程的环形缓冲区。
+ */
+class FlightRecorder : noncopyable
+{
+public:
+    enum EventType
+    {
+        kPoll,          // poll等待（arg：返回的事件数）
+        kChannel,       // 一个channel的事件处理（arg：fd，extra：revents）
+        kFunctor,       // pendingFunctors中的一个回调
+        kDeferred,      // 推迟到本轮执行的回调（读预算carry-over等）
+        kAfterDispatch, // 分发结束后的冲刷（auto-cork）
+        kAccept,        // 瞬时事件（arg：新连接的fd）
+        kClose,         // 瞬时事件（arg：关闭的连接的fd）
+        kStall,         // 瞬时事件：loop卡顿，由StallWatchdog记录（arg：已持续的毫秒数，extra：loop线程）
+        kNumTypes
+    };
+
+    // 开启/关闭记录（Thread safe）。capacity为每个线程的环形缓冲区能保存的事件数（向上取2的幂），在第一次开启前设置
+    static void enable(bool on);
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void setCapacity(size_t eventsPerThread);
+
+    // 时间戳（TSC，非x86上为CLOCK_MONOTONIC纳秒）
+    static uint64_t now();
+
+    // 记录一个时间段/瞬时事件。调用前应先检查enabled()
+    static void recordSpan(EventType type, uint64_t start, int32_t arg, int32_t extra = 0);
+    static void recordInstant(EventType type, int32_t arg, int32_t extra = 0)
+    {
+        recordSpan(type, 0, arg, extra);
+    }
+
+    // 记录一个作用域的时间段，关闭时构造和析构都只检查一次标志
+    class Scope : noncopyable
+    {
+    public:
+        Scope(EventType type, int32_t arg = 0, int32_t extra = 0)
+            : start_(enabled() ? now() : 0)
+            , type_(type)
+            , arg_(arg)
+            , extra_(extra)
+        {}
+        ~Scope()
+        {
+            if (start_ != 0)
+            {
+                recordSpan(type_, start_, arg_, extra_);
+            }
+        }
+    private:
+        uint64_t start_;
+        EventType type_;
+        int32_t arg_;
+        int32_t extra_;
+    };
+
+    // 导出所有线程的事件为Chrome trace JSON（Thread safe）
+    static std::string dumpChromeTrace();
+    // 写入文件，失败返回false
+    static bool dumpChromeTrace(const std::string &path);
+
+    static const char* typeName(EventType type);
+private:
+    static std::atomic_bool enabled_;
+};
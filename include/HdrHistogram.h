@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ * HDR（High Dynamic Range）风格的直方图：对数-线性分桶。
+ * 每个2的幂区间再线性分成2^(subBucketBits-1)个桶，相对误差不超过2^-(subBucketBits-1)，
+ * 记录一次只需要一次clz和一次数组自增，适合在IO线程中记录延迟。
+ * 非线程安全：每个线程各自记录，最后用merge()汇总。
+ */
+class HdrHistogram
+{
+public:
+    explicit HdrHistogram(int subBucketBits = 8)
+        : subBucketBits_(subBucketBits)
+        , subBucketHalf_(int64_t(1) << (subBucketBits - 1))
+        , counts_(static_cast<size_t>((64 - subBucketBits + 1) * subBucketHalf_ + subBucketHalf_), 0)
+        , totalCount_(0)
+        , min_(INT64_MAX)
+        , max_(0)
+        , sum_(0)
+    {}
+
+    void record(int64_t value)
+    {
+        if (value < 0)
+        {
+            value = 0;
+        }
+        ++counts_[indexOf(value)];
+        ++totalCount_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    // 汇总另一个相同精度的直方图
+    void merge(const HdrHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size() && i < other.counts_.size(); ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        totalCount_ += other.totalCount_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        totalCount_ = 0;
+        min_ = INT64_MAX;
+        max_ = 0;
+        sum_ = 0;
+    }
+
+    // percentile取值[0, 100]，返回该分位数所在桶的上界（不超过max）
+    int64_t percentile(double percentile) const
+    {
+        if (totalCount_ == 0)
+        {
+            return 0;
+        }
+        int64_t target = static_cast<int64_t>(percentile / 100.0 * totalCount_ + 0.5);
+        target = std::max<int64_t>(1, std::min(target, totalCount_));
+        int64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            seen += counts_[i];
+            if (seen >= target)
+            {
+                return std::min(highestEquivalentValue(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    int64_t count() const { return totalCount_; }
+    int64_t min() const { return totalCount_ ? min_ : 0; }
+    int64_t max() const { return max_; }
+    double mean() const { return totalCount_ ? static_cast<double>(sum_) / totalCount_ : 0.0; }
+private:
+    // 小于2^subBucketBits的值直接作下标；否则先右移到[2^(bits-1), 2^bits)，再拼上移位数
+    size_t indexOf(int64_t value) const
+    {
+        if (value < 2 * subBucketHalf_)
+        {
+            return static_cast<size_t>(value);
+        }
+        int shift = (63 - __builtin_clzll(static_cast<uint64_t>(value))) - subBucketBits_ + 1;
+        return static_cast<size_t>(shift * subBucketHalf_ + (value >> shift));
+    }
+
+    int64_t highestEquivalentValue(size_t index) const
+    {
+        int64_t idx = static_cast<int64_t>(index);
+        if (idx < 2 * subBucketHalf_)
+        {
+            return idx;
+        }
+        int shift = static_cast<int>(idx / subBucketHalf_) - 1;
+        int64_t sub = idx - shift * subBucketHalf_;
+        return (sub << shift) + (int64_t(1) << shift) - 1;
+    }
+
+    const int subBucketBits_;
+    const int64_t subBucketHalf_;
+    std::vector<int64_t> counts_;
+    int64_t totalCount_;
+    int64_t min_;
+    int64_t max_;
+    int64_t sum_;
+};
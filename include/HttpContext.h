@@ -0,0 +1,66 @@
+#pragma once
+
+#include "HttpRequest.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <utility>
+#include <stddef.h>
+
+class Buffer;
+
+/**
+ * 增量式的HTTP/1.x请求解析器，每个连接一个。
+ * 解析结果只记录相对于buf->peek()的偏移，数据留在inputBuffer_中（Buffer扩容或前移数据不影响偏移），
+ * 请求完整后再生成指向Buffer的HttpRequest。已经扫描过的字节不会重复扫描。
+ * 处理完一个请求后，调用方retrieve(requestLength())并reset()，即可继续解析流水线中的下一个请求。
+ */
+class HttpContext
+{
+public:
+    enum ParseResult { kIncomplete, kComplete, kError };
+
+    static const size_t kMaxHeaderBytes = 64 * 1024;
+    static const size_t kMaxBodyBytes = 16 * 1024 * 1024;
+
+    HttpContext() { reset(); }
+
+    ParseResult parseRequest(const Buffer *buf, Timestamp receiveTime);
+
+    // 只在parseRequest返回kComplete之后、buf被修改之前有效
+    const HttpRequest& request() const { return request_; }
+    // 当前请求（头部+body）在buf中占用的字节数
+    size_t requestLength() const { return headerEnd_ + bodyLength_; }
+    // 解析失败时建议返回的状态码
+    int errorStatus() const { return errorStatus_; }
+
+    void reset();
+private:
+    enum State { kExpectRequestLine, kExpectHeaders, kExpectBody };
+
+    struct Span
+    {
+        size_t offset;
+        size_t length;
+    };
+
+    bool parseRequestLine(const char *base, const char *begin, const char *end);
+    bool parseHeaderLine(const char *base, const char *begin, const char *colon, const char *end);
+    bool finishHeaders(const char *base);
+    void buildRequest(const char *base, Timestamp receiveTime);
+
+    State state_;
+    size_t scanned_;      // 已经检查过、确定不含CRLF的字节数
+    size_t lineStart_;    // 当前行的起始偏移
+    size_t headerEnd_;    // 头部（含空行）结束的偏移
+    size_t bodyLength_;
+    int errorStatus_;
+
+    HttpRequest::Method method_;
+    HttpRequest::Version version_;
+    Span path_;
+    Span query_;
+    std::vector<std::pair<Span, Span>> headers_;
+
+    HttpRequest request_;
+};
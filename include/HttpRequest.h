@@ -0,0 +1,69 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <utility>
+
+/**
+ * HTTP请求：所有字段都是指向连接inputBuffer_的StringPiece，解析过程中不拷贝数据。
+ * 只在HttpServer回调HttpCallback期间有效，需要保存时请自行拷贝。
+ */
+class HttpRequest
+{
+public:
+    enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions, kPatch };
+    enum Version { kUnknown, kHttp10, kHttp11 };
+
+    using Header = std::pair<StringPiece, StringPiece>;
+
+    HttpRequest()
+        : method_(kInvalid)
+        , version_(kUnknown)
+    {}
+
+    Method method() const { return method_; }
+    const char* methodString() const;
+    Version version() const { return version_; }
+    const StringPiece& path() const { return path_; }
+    // 不含'?'，没有查询字符串时为空
+    const StringPiece& query() const { return query_; }
+    const StringPiece& body() const { return body_; }
+    const std::vector<Header>& headers() const { return headers_; }
+    Timestamp receiveTime() const { return receiveTime_; }
+
+    // 字段名忽略大小写，不存在时返回空的StringPiece
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for (const Header &header : headers_)
+        {
+            if (header.first.equalsIgnoreCase(field))
+            {
+                return header.second;
+            }
+        }
+        return StringPiece();
+    }
+
+    // 根据HTTP版本和Connection头部判断是否保持连接
+    bool keepAlive() const
+    {
+        StringPiece connection = getHeader("Connection");
+        if (version_ == kHttp11)
+        {
+            return !connection.equalsIgnoreCase("close");
+        }
+        return connection.equalsIgnoreCase("keep-alive");
+    }
+
+    friend class HttpContext;
+private:
+    Method method_;
+    Version version_;
+    StringPiece path_;
+    StringPiece query_;
+    StringPiece body_;
+    std::vector<Header> headers_;
+    Timestamp receiveTime_;
+};
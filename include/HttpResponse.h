@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <sys/types.h>
+
+class Buffer;
+
+// HTTP响应：由HttpCallback填写，HttpServer直接序列化到连接的输出缓冲区
+class HttpResponse
+{
+public:
+    enum HttpStatusCode
+    {
+        kUnknown,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k403Forbidden = 403,
+        k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k413PayloadTooLarge = 413,
+        k431HeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+    };
+
+    explicit HttpResponse(bool close)
+        : statusCode_(kUnknown)
+        , closeConnection_(close)
+        , headOnly_(false)
+        , fileFd_(-1)
+        , fileSize_(0)
+    {}
+    ~HttpResponse();
+
+    void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
+    void setStatusMessage(const std::string &message) { statusMessage_ = message; }
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+    void setContentType(const std::string &contentType) { addHeader("Content-Type", contentType); }
+    void addHeader(const std::string &key, const std::string &value) { headers_.emplace_back(key, value); }
+    void setBody(const std::string &body) { body_ = body; }
+    void setBody(std::string &&body) { body_ = std::move(body); }
+    // HEAD请求：只输出头部（Content-Length仍按实际body计算）
+    void setHeadOnly(bool on) { headOnly_ = on; }
+
+    // 以文件内容作为body，由HttpServer通过sendfile发送；文件不存在或不是普通文件时返回false
+    bool setFileBody(const std::string &path);
+    bool hasFileBody() const { return fileFd_ >= 0; }
+    // 取走文件fd，之后由调用方负责关闭
+    int releaseFile(size_t *size);
+
+    // 1xx、204、304之外的响应才能带body
+    bool allowsBody() const
+    {
+        const int code = static_cast<int>(statusCode_);
+        return !((code >= 100 && code < 200) || code == k204NoContent || code == k304NotModified);
+    }
+
+    // 把状态行、头部以及body（不含文件）序列化到output
+    void appendToBuffer(Buffer *output) const;
+private:
+    HttpStatusCode statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool headOnly_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string body_;
+    int fileFd_;
+    size_t fileSize_;
+};
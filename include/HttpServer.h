@@ -0,0 +1,53 @@
+#pragma once
+
+#include "TcpServer.h"
+#include "noncopyable.h"
+
+#include <functional>
+#include <string>
+
+class HttpRequest;
+class HttpResponse;
+
+/**
+ * 基于TcpServer的HTTP/1.1服务器：
+ *  - 每个连接一个增量解析器HttpContext，请求直接在inputBuffer_上解析，不拷贝；
+ *  - 支持keep-alive和流水线（一次onMessage处理完所有完整的请求，响应按顺序写入输出缓冲区，最后只发送一次）；
+ *  - 设置了documentRoot时，GET/HEAD请求优先匹配静态文件，文件内容通过sendfile发送。
+ */
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void(const HttpRequest&, HttpResponse*)>;
+
+    HttpServer(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop* getLoop() const { return loop_; }
+
+    // Not thread safe, callback be registered before calling start().
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    // 静态文件的根目录，为空表示不提供静态文件
+    void setDocumentRoot(const std::string &root) { documentRoot_ = root; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setThreadInitCallback(const TcpServer::ThreadInitCallback &cb) { server_.setThreadInitcallback(cb); }
+    // 每个连接每轮最多处理maxRequests个流水线请求（见TcpConnection::setReadBudget）
+    void setReadBudget(size_t maxBytes, size_t maxRequests) { server_.setReadBudget(maxBytes, maxRequests); }
+    // HTTPS：静态文件在开启kTLS时仍然通过sendfile发送，否则读出后加密发送
+    void setTlsContext(const std::shared_ptr<TlsContext> &context) { server_.setTlsContext(context); }
+
+    void start();
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    // 处理一个请求，把响应写入conn的输出缓冲区，返回是否需要关闭连接
+    bool onRequest(const TcpConnectionPtr &conn, const HttpRequest &req);
+    bool serveStaticFile(const HttpRequest &req, HttpResponse *resp);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    std::string documentRoot_;
+};
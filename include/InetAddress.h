@@ -2,22 +2,45 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-// 封装socket地址类型
+// 封装socket地址类型：IPv4（AF_INET）或者Unix域（AF_UNIX）地址
 class InetAddress
 {
 public:
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr) : sockaddr_(addr)
-    {}
+    explicit InetAddress(const sockaddr_in &addr);
+    InetAddress(const sockaddr_un &addr, socklen_t len);
+
+    // Unix域socket地址，path以'@'开头时表示Linux的抽象命名空间（不在文件系统中创建文件）。
+    // path超出sun_path的容量时LOG_FATAL
+    static InetAddress fromUnixPath(const std::string &path);
+    // 由getsockname/getpeername/accept返回的任意地址构造
+    static InetAddress fromSockAddr(const sockaddr *addr, socklen_t len);
+
+    sa_family_t family() const { return addr_.sa.sa_family; }
+    bool isUnix() const { return family() == AF_UNIX; }
 
     std::string toIp() const;
-    std::string toIpPort() const;
-    uint16_t toPort() const;
+    std::string toIpPort() const;   // Unix域地址返回"unix:<path>"
+    uint16_t toPort() const;        // Unix域地址返回0
+    std::string toUnixPath() const; // 抽象命名空间的地址以'@'开头，未命名的地址返回空串
+
+    // 仅对AF_INET地址有意义
+    const sockaddr_in* getSockAddr() const {return &addr_.in;}
+    void setSockAddr(const sockaddr_in &addr);
 
-    const sockaddr_in* getSockAddr() const {return &sockaddr_;}
-    void setSockAddr(const sockaddr_in &addr) { sockaddr_ = addr; }
+    // 通用的地址接口，用于bind/connect等
+    const sockaddr* sockAddr() const { return &addr_.sa; }
+    socklen_t sockAddrLen() const { return len_; }
 private:
-    sockaddr_in sockaddr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr sa;
+        sockaddr_in in;
+        sockaddr_un un;
+    } addr_;
+    socklen_t len_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HdrHistogram.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * 服务端请求延迟的分段统计（纳秒）。一次"请求"指一次读事件读到数据后的MessageCallback分发：
+ *
+ *   内核收到数据 --kKernelQueue--> poll返回 --kDispatch--> 开始分发 --kHandler--> 回调返回 --kWrite--> 回复写完
+ *
+ * kKernelQueue：数据在socket接收队列中等待、以及epoll唤醒的时间，需要内核时间戳（SO_TIMESTAMPNS），TLS连接没有这一段；
+ * kDispatch：同一批事件中排在前面的channel、读系统调用以及读预算推迟（carry-over）造成的延迟；
+ * kHandler：MessageCallback本身；
+ * kWrite：回调返回后，回复数据全部交给内核所用的时间（auto-cork、写缓冲区满时才不为0）；只统计回调中发送了数据的请求；
+ * kTotal：从内核收到数据（没有内核时间戳时从poll返回）到回复写完。
+ *
+ * 每个loop记录到自己的分片中，分片各带一把锁，只有读取统计的线程会和它竞争。
+ * 用TcpServer::setLatencyStats开启。
+ */
+class LatencyStats : noncopyable
+{
+public:
+    enum Stage { kKernelQueue, kDispatch, kHandler, kWrite, kTotal, kNumStages };
+
+    // 一个loop的分片，只在该loop线程中记录
+    class Shard : noncopyable
+    {
+    public:
+        void record(Stage stage, int64_t nanos)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            histograms_[stage].record(nanos);
+        }
+    private:
+        friend class LatencyStats;
+        std::mutex mutex_;
+        HdrHistogram histograms_[kNumStages];
+    };
+
+    // Thread safe：取得loop对应的分片，第一次调用时创建
+    Shard* shardFor(EventLoop *loop);
+
+    // Thread safe：汇总所有loop的某一段
+    HdrHistogram histogram(Stage stage) const;
+    void reset();
+
+    static const char* stageName(Stage stage);
+    // 各段的count/p50/p99/p999/max（微秒），每段一行
+    std::string toString() const;
+private:
+    mutable std::mutex mutex_; // 保护shards_
+    std::map<EventLoop*, std::unique_ptr<Shard>> shards_;
+};
+
+// CLOCK_REALTIME的纳秒数，与内核接收时间戳可以直接相减
+int64_t latencyClockNanos();
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <string>
+
+class Buffer;
+
+/**
+ * 长度前缀的分帧编解码器：
+ * +-------------------+------------------+-------------------------+
+ * | length (int32 BE) |       body       | crc32c (int32 BE，可选)  |
+ * +-------------------+------------------+-------------------------+
+ * length为其后所有字节数（包括可选的校验和）。
+ *
+ * 解码：onMessage作为TcpConnection的MessageCallback，一次调用解出inputBuffer_中所有完整的帧，
+ * frameCallback_直接拿到指向Buffer内部的指针，不做拷贝。
+ * 编码：先把body写入Buffer，再利用Buffer头部预留的kCheapPrepend空间原地写入长度。
+ */
+class LengthHeaderCodec : noncopyable
+{
+public:
+    // data只在回调期间有效
+    using FrameCallback = std::function<void(const TcpConnectionPtr&, const char *data, size_t len, Timestamp)>;
+
+    static const int32_t kHeaderLen = sizeof(int32_t);
+    static const int32_t kChecksumLen = sizeof(int32_t);
+
+    explicit LengthHeaderCodec(FrameCallback cb,
+                               bool checksum = false,
+                               size_t maxFrameLength = 64 * 1024 * 1024);
+
+    // 设置为TcpConnection/TcpServer的MessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // buf中的可读数据作为body：追加校验和，并在头部原地写入长度
+    void encode(Buffer *buf) const;
+    // 编码buf并发送，发送后buf被清空
+    void send(const TcpConnectionPtr &conn, Buffer *buf) const;
+    void send(const TcpConnectionPtr &conn, const char *data, size_t len) const;
+private:
+    FrameCallback frameCallback_;
+    const bool checksum_;
+    const size_t maxFrameLength_;
+};
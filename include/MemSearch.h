@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * 在内存区间[begin, end)中查找分隔符：
+ * x86_64上按CPU能力（运行时检测）选择AVX2或SSE2实现，其余平台使用标量实现。
+ * 所有函数找不到时返回nullptr。
+ */
+namespace MemSearch
+{
+    // 查找单个字节c
+    const char* findByte(const char *begin, const char *end, char c);
+
+    // 查找"\r\n"，返回指向'\r'的指针
+    const char* findCRLF(const char *begin, const char *end);
+
+    // 查找行尾'\n'
+    inline const char* findEOL(const char *begin, const char *end)
+    {
+        return findByte(begin, end, '\n');
+    }
+
+    // 查找长度为n的字节串needle，n为0时返回begin
+    const char* find(const char *begin, const char *end, const char *needle, size_t n);
+
+    // 当前使用的实现："avx2"、"sse2"或"scalar"
+    const char* kernelName();
+}
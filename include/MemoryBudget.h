@@ -0,0 +1,123 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+
+class EventLoop;
+class TcpConnection;
+
+/**
+ * 连接缓冲区的内存记账与全局预算。记账的是每个连接inputBuffer_/outputBuffer_的容量（实际占用的内存），
+ * 另外单独统计outputBuffer_中排队待发送的字节数；按连接、按loop、按预算对象三级汇总，
+ * 多个TcpServer共用一个MemoryBudget即为进程级的预算。
+ *
+ * 超过预算后逐级降级，而不是让进程OOM：
+ * 1. 总量超过limit：占用高于平均值的连接暂停读（不再接收请求，也就不再产生回复），TcpServer拒绝新连接，
+ *    空闲下来的缓冲区超过kShrinkThreshold的容量被释放；总量回落到limit的90%以下时，被暂停的连接恢复读；
+ *    被暂停的连接每kRecheckSeconds秒复查一次：压力已经解除就恢复，被暂停超过pauseTimeout的连接关闭——
+ *    停在半条消息上的连接自己释放不了缓冲区，没有其他连接释放内存时会永远等下去；
+ * 2. 总量超过closeLimit（0表示不开启）：每个loop每轮关闭一个占用最多的连接。
+ *
+ * 用法：auto budget = std::make_shared<MemoryBudget>(256 << 20); server.setMemoryBudget(budget);
+ */
+class MemoryBudget : noncopyable, public std::enable_shared_from_this<MemoryBudget>
+{
+public:
+    // 超过预算时，空的缓冲区容量超过它的部分被释放
+    static const size_t kShrinkThreshold = 64 * 1024;
+    // 复查被暂停的连接的间隔（秒）
+    static const int kRecheckSeconds = 1;
+
+    explicit MemoryBudget(size_t limitBytes, size_t closeLimitBytes = 0);
+
+    // 一个loop上的记账：连接集合只在该loop线程中访问，计数可在任意线程读取
+    class Shard : noncopyable
+    {
+    public:
+        int64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+        int64_t queuedBytes() const { return queued_.load(std::memory_order_relaxed); }
+    private:
+        friend class MemoryBudget;
+
+        explicit Shard(EventLoop *loop);
+
+        EventLoop *loop_;
+        std::atomic<int64_t> bytes_;
+        std::atomic<int64_t> queued_;
+        std::atomic<int64_t> paused_; // 本loop上被暂停的连接数
+        std::atomic_bool resumeScheduled_;
+        bool recheckScheduled_;
+        std::unordered_set<TcpConnection*> connections_;
+        std::unordered_map<TcpConnection*, Timestamp> pausedSince_; // 被暂停的连接及暂停的时刻
+        uint64_t lastCloseIteration_; // 最近一次因超过closeLimit关闭连接的那一轮
+    };
+
+    // Thread safe：取得loop对应的记账，第一次调用时创建
+    Shard* shardFor(EventLoop *loop);
+
+    // 连接被暂停超过seconds秒仍未恢复时关闭它（默认30秒），<= 0表示不关闭。在start()之前调用
+    void setPauseTimeout(double seconds) { pauseTimeout_ = seconds; }
+
+    size_t limit() const { return limit_; }
+    size_t closeLimit() const { return closeLimit_; }
+    bool overLimit() const { return totalBytes() > static_cast<int64_t>(limit_); }
+    bool overCloseLimit() const
+    {
+        return closeLimit_ > 0 && totalBytes() > static_cast<int64_t>(closeLimit_);
+    }
+    // 总量高于恢复线（limit的90%）：此时释放空闲缓冲区的多余容量，不恢复被暂停的连接
+    bool underPressure() const { return totalBytes() > resumeBytes_; }
+
+    // 统计（Thread safe）
+    int64_t totalBytes() const { return bytes_.load(std::memory_order_relaxed); }
+    int64_t queuedBytes() const { return queued_.load(std::memory_order_relaxed); }
+    int64_t connections() const { return connections_.load(std::memory_order_relaxed); }
+    int64_t pausedConnections() const { return pausedNow_.load(std::memory_order_relaxed); }
+    int64_t pausedCount() const { return pausedCount_.load(std::memory_order_relaxed); }
+    int64_t refusedCount() const { return refusedCount_.load(std::memory_order_relaxed); }
+    int64_t closedCount() const { return closedCount_.load(std::memory_order_relaxed); }
+    // 一行汇总，包含每个loop的占用
+    std::string toString() const;
+private:
+    friend class TcpConnection;
+    friend class TcpServer;
+
+    // 以下在shard的loop线程中调用
+    void add(Shard *shard, TcpConnection *conn);
+    void remove(Shard *shard, TcpConnection *conn, int64_t bytes, int64_t queued, bool paused);
+    void update(Shard *shard, int64_t deltaBytes, int64_t deltaQueued);
+    // conn的占用高于平均值时暂停它的读，返回是否暂停
+    bool maybePause(Shard *shard, TcpConnection *conn, int64_t bytes);
+    void resumed(Shard *shard, TcpConnection *conn);
+    // 每轮最多关闭shard上一个占用最多的连接
+    void closeHeaviest(Shard *shard);
+    void resumePaused(Shard *shard);
+    void scheduleRecheck(Shard *shard);
+    // 定时复查shard上被暂停的连接：恢复或者关闭超时的
+    void recheckPaused(Shard *shard);
+
+    const size_t limit_;
+    const size_t closeLimit_;
+    const int64_t resumeBytes_;
+    double pauseTimeout_;
+
+    std::atomic<int64_t> bytes_;
+    std::atomic<int64_t> queued_;
+    std::atomic<int64_t> connections_;
+    std::atomic<int64_t> pausedNow_;
+    std::atomic<int64_t> pausedCount_;
+    std::atomic<int64_t> refusedCount_;
+    std::atomic<int64_t> closedCount_;
+
+    mutable std::mutex mutex_; // 保护shards_
+    std::map<EventLoop*, std::unique_ptr<Shard>> shards_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+#include "StringPiece.h"
+
+#include <functional>
+#include <vector>
+#include <sys/types.h>
+
+class Buffer;
+
+/**
+ * RESP（Redis序列化协议）编解码器，支持RESP2和RESP3：
+ *  - 服务端解码：onMessage作为MessageCallback，一次解出inputBuffer_中所有完整的命令（多条批量字符串数组或inline命令），
+ *    整批交给commandBatchCallback_，命令参数直接指向Buffer内部，不做拷贝；回调返回后才从Buffer中取走这些数据。
+ *  - 客户端解码：valueLength返回一个完整RESP2/RESP3值（包括嵌套的聚合类型）的长度，用于对应答分帧。
+ *  - 编码：append*系列函数把应答直接写入Buffer；与协议版本有关的类型（null、map、布尔、浮点）需要传入protover。
+ */
+class RespCodec : noncopyable
+{
+public:
+    using Command = std::vector<StringPiece>;
+    // commands[0, n)只在回调期间有效
+    using CommandBatchCallback = std::function<void(const TcpConnectionPtr&, const Command *commands, size_t n, Timestamp)>;
+
+    static const size_t kMaxInlineLength = 64 * 1024;
+
+    explicit RespCodec(CommandBatchCallback cb,
+                       size_t maxBulkLength = 512 * 1024 * 1024,
+                       size_t maxArgs = 1024 * 1024);
+
+    // 设置为TcpConnection/TcpServer的MessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 解析[begin, end)开头的一条命令，返回消耗的字节数，0表示数据不完整，-1表示协议错误。
+    // 空命令（空行、*0）返回消耗的字节数且args为空
+    static ssize_t parseCommand(const char *begin, const char *end, Command *args,
+                                size_t maxBulkLength, size_t maxArgs);
+    // [begin, end)开头一个完整RESP值的长度，0表示数据不完整，-1表示协议错误
+    static ssize_t valueLength(const char *begin, const char *end);
+
+    static void appendSimpleString(Buffer *buf, const StringPiece &str);
+    static void appendError(Buffer *buf, const StringPiece &msg);
+    static void appendInteger(Buffer *buf, int64_t value);
+    static void appendBulkString(Buffer *buf, const StringPiece &str);
+    static void appendArrayHeader(Buffer *buf, size_t n);
+    // RESP2中null为"$-1"，RESP3中为"_"
+    static void appendNull(Buffer *buf, int protover);
+    // RESP2中map以2n个元素的数组表示
+    static void appendMapHeader(Buffer *buf, size_t n, int protover);
+    // RESP2中布尔以整数0/1表示
+    static void appendBoolean(Buffer *buf, bool value, int protover);
+    // RESP2中浮点以批量字符串表示
+    static void appendDouble(Buffer *buf, double value, int protover);
+private:
+    CommandBatchCallback commandBatchCallback_;
+    const size_t maxBulkLength_;
+    const size_t maxArgs_;
+};
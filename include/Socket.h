@@ -3,6 +3,7 @@
 #include "noncopyable.h"
 #include "Logger.h"
 #include <cstring>
+#include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/types.h>         
@@ -38,9 +39,12 @@ public:
 
     /* 这四个函数，通过调用::setsockopt()方法，来设置sockfd_的属性 */ 
     void setTcpNoDelay(bool on);
+    void setTcpCork(bool on);
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_TIMESTAMPNS：recvmsg时附带内核收到数据的时间（见Buffer::recvMsg）
+    void setReceiveTimestamps(bool on);
 	
     // 通过sockfd_获取其绑定的IP+Port的sockaddr_in地址结构
     static struct sockaddr_in sockfd_To_SockAddr(int sockfd) 
@@ -54,6 +58,35 @@ public:
         }
         return sockAddr;
     } 
+
+    // 通过sockfd_获取对端的IP+Port的sockaddr_in地址结构
+    static struct sockaddr_in sockfd_To_PeerAddr(int sockfd) 
+    {
+        struct sockaddr_in peerAddr;
+        std::memset(&peerAddr, 0, sizeof(peerAddr));
+        socklen_t peerAddrlen = (socklen_t)(sizeof(peerAddr));
+        if (::getpeername(sockfd, (struct sockaddr*)(&peerAddr), &peerAddrlen) < 0)
+        {
+            LOG_ERROR("Socket::sockfd_To_PeerAddr() is error.\n");
+        }
+        return peerAddr;
+    } 
+
+    // 通过sockfd获取本端/对端的地址，支持AF_INET和AF_UNIX
+    static InetAddress localAddress(int sockfd);
+    static InetAddress peerAddress(int sockfd);
+
+    // 获取并清除sockfd上挂起的错误（SO_ERROR）
+    static int getSocketError(int sockfd)
+    {
+        int optval;
+        socklen_t optlen = static_cast<socklen_t>(sizeof optval);
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+        {
+            return errno;
+        }
+        return optval;
+    }
 private:
     const int sockfd_;
 };
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+
+/**
+ * loop卡顿看门狗：一个后台线程定期检查各loop的心跳（轮数和本轮开始处理事件的时间），
+ * 一轮循环（从poll返回到下一次进入poll）超过阈值时，报告该loop正在执行的channel或回调，
+ * 并向loop线程发信号抓取它当时的调用栈，用来找出造成延迟尖刺的回调。每轮卡顿只报告一次。
+ *
+ * 用法：auto watchdog = std::make_shared<StallWatchdog>(0.1); watchdog->start();
+ * 再EventLoop::setStallWatchdog(watchdog)或TcpServer::setStallWatchdog(watchdog)。
+ * 抓调用栈使用信号SIGRTMIN+4（见backtraceSignal()），不要在程序中另作他用；
+ * loop线程此时若阻塞在不受SA_RESTART影响的系统调用（如nanosleep）中，该调用会提前返回EINTR。
+ */
+class StallWatchdog : noncopyable
+{
+public:
+    struct StallReport
+    {
+        EventLoop *loop;                    // 只用作标识，不要解引用：报告时loop可能已经析构
+        pid_t tid;                          // loop线程
+        uint64_t iteration;                 // 卡住的那一轮
+        int64_t stalledMs;                  // 发现时已持续的时间
+        std::string activity;               // 正在执行的操作，如"channel fd=12"、"functor std::_Bind<...>"
+        std::vector<std::string> backtrace; // loop线程的调用栈（抓取失败时为空）
+        int64_t loopStalls;                 // 该loop累计的卡顿次数
+    };
+    using StallCallback = std::function<void(const StallReport&)>;
+
+    // thresholdSeconds：一轮循环超过它即视为卡顿；检查间隔为阈值的1/4
+    explicit StallWatchdog(double thresholdSeconds = 0.1);
+    ~StallWatchdog();
+
+    // 在看门狗线程中、不持有内部锁时调用，默认用LOG_ERROR输出报告
+    void setStallCallback(const StallCallback &cb) { stallCallback_ = cb; }
+    // 发现卡顿时，若FlightRecorder已开启则把trace导出到path（覆盖写入），在start()之前调用
+    void setTraceDumpPath(const std::string &path) { traceDumpPath_ = path; }
+
+    void start();
+    void stop();
+
+    // Thread safe。由EventLoop::setStallWatchdog和EventLoop析构时调用
+    void watch(EventLoop *loop);
+    void unwatch(EventLoop *loop);
+
+    // 所有loop累计的卡顿次数
+    int64_t stallCount() const { return stallCount_.load(std::memory_order_relaxed); }
+
+    static int backtraceSignal();
+private:
+    struct Watched
+    {
+        EventLoop *loop;
+        uint64_t reportedIteration; // 已经报告过的那一轮，避免重复报告
+        int64_t stalls;
+    };
+
+    void threadFunc();
+    void checkLoops(std::vector<StallReport> *stalls);
+    void report(StallReport *stall);
+
+    const int64_t thresholdUs_;
+    StallCallback stallCallback_;
+    std::string traceDumpPath_;
+
+    std::mutex mutex_; // 保护loops_和running_；只在持有它时访问loop，unwatch返回后loop不会再被访问
+    std::condition_variable cond_;
+    std::vector<Watched> loops_;
+    bool running_;
+    std::atomic<int64_t> stallCount_;
+    Thread thread_;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <ostream>
+
+/**
+ * 指向一段外部内存的只读字符串视图（C++11中没有std::string_view），不拥有数据。
+ * 常用于指向Buffer内部的数据，调用方要保证视图的生命周期不超过底层数据。
+ */
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str)
+        : ptr_(str), length_(static_cast<size_t>(::strlen(str))) {}
+    StringPiece(const std::string &str)
+        : ptr_(str.data()), length_(str.size()) {}
+    StringPiece(const char *offset, size_t len)
+        : ptr_(offset), length_(len) {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + length_; }
+
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void removePrefix(size_t n) { ptr_ += n; length_ -= n; }
+    void removeSuffix(size_t n) { length_ -= n; }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && ::memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const { return !(*this == x); }
+
+    // 忽略大小写比较（ASCII），用于HTTP头部字段名等
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {
+        return length_ == x.length_ && ::strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    bool startsWith(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && ::memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    std::string asString() const { return std::string(ptr_, length_); }
+private:
+    const char *ptr_;
+    size_t length_;
+};
+
+inline std::ostream& operator<<(std::ostream &o, const StringPiece &piece)
+{
+    o.write(piece.data(), static_cast<std::streamsize>(piece.size()));
+    return o;
+}
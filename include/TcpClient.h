@@ -0,0 +1,75 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpConnection.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+class Connector;
+class EventLoop;
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+/**
+ * 对外的客户端编程使用的类：每个TcpClient最多维护一条TcpConnection。
+ * Connector负责（重试）建立连接，连接的IO运行在构造时传入的loop上。
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();  // force out-line dtor, for std::unique_ptr members.
+
+    void connect();
+    void disconnect();
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    // 连接断开后自动重连
+    void enableRetry() { retry_ = true; }
+
+    const std::string& name() const { return name_; }
+
+    // Not thread safe.
+    void setConnectionCallback(ConnectionCallback cb) { connectionCallback_ = std::move(cb); }
+    void setMessageCallback(MessageCallback cb) { messageCallback_ = std::move(cb); }
+    void setWriteCompleteCallback(WriteCompleteCallback cb) { writeCompleteCallback_ = std::move(cb); }
+    /**
+     * 连接使用TLS，serverName用于SNI、证书校验和会话复用。在connect()之前调用。
+     * serverName为空时（如直接按IP连接），开启了证书校验的context要求证书签发给对端IP。
+     */
+    void setTlsContext(const std::shared_ptr<TlsContext> &context, const std::string &serverName)
+    { tlsContext_ = context; tlsServerName_ = serverName; }
+private:
+    // Not thread safe, but in loop.
+    void newConnection(int sockfd);
+    // Not thread safe, but in loop.
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    std::shared_ptr<TlsContext> tlsContext_;
+    std::string tlsServerName_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_; // always in loop thread
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // guarded by mutex_
+};
@@ -5,21 +5,36 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "StringPiece.h"
+#include "LatencyStats.h"
+#include "MemoryBudget.h"
+#include "ChannelHandler.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <list>
+#include <map>
+#include <functional>
+#include <vector>
+#include <initializer_list>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 class Channel;
 class EventLoop;
 class Socket;
+class TlsContext;
+class TlsSession;
+class ConnectionFilter;
+class FilterChain;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
  * => TcpConnection 设置回调 => Channel => Poller => Channel的回调操作
  * 
  */ 
-class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
+class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>, private ChannelHandler
 /**
  * enable_shared_from_this (C++11) 允许对象创建指代自身的 shared_ptr : 
 *       1. operator= : 返回到 this 的引用 (受保护成员函数)
@@ -48,20 +63,153 @@ public:
 
     // 发送数据
     void send(const std::string &buf);
+    // 发送buf中所有可读数据，并清空buf（在loop线程中调用时不产生额外的拷贝）
+    void send(Buffer *buf);
+    /**
+     * 分散/聚集发送（如头部+正文+尾部）：输出队列为空时直接writev，不必先拼接成一个string；
+     * 没发完的部分逐段追加到outputBuffer_。在其他线程调用时会把各段拷贝成一条消息再交给loop线程。
+     */
+    void send(const struct iovec *iov, int iovcnt);
+    void sendv(std::initializer_list<StringPiece> pieces);
+    /**
+     * 用sendfile发送文件fd中[offset, offset+count)的数据，排在之前send的数据之后。
+     * closeWhenDone为true时，发送完成（或连接关闭）后由TcpConnection关闭fd。
+     * must be called in loop thread
+     */
+    void sendFile(int fd, off_t offset, size_t count, bool closeWhenDone);
+
+    /**
+     * 在AF_UNIX连接上传递文件描述符（SCM_RIGHTS）：fds随data的第一个字节一起到达对端，
+     * 按顺序排在之前send的数据之后。fds会被dup，调用方仍然拥有原来的描述符。len必须大于0。
+     * must be called in loop thread
+     */
+    void sendWithFds(const char *data, size_t len, const int *fds, size_t nfds);
+    // 开启后读数据时同时接收对端传来的描述符（在ConnectionCallback中开启）
+    void setReceiveFds(bool on) { receiveFds_ = on; }
+    // 在MessageCallback中取走目前收到的描述符，之后由调用方负责关闭
+    std::vector<int> takeReceivedFds();
+
+    /**
+     * 直接在输出缓冲区中构造待发送的数据，避免先拼接到临时string再拷贝。
+     * 写完后调用sendOutputBuffer()尝试立即发送。两者都 must be called in loop thread。
+     */
+    Buffer* outputBuffer();
+    void sendOutputBuffer();
     // 关闭当前连接
     void shutdown();    // not thread safe, no simultaneous calling
+    // 不等待outputBuffer_发送完毕，直接关闭连接
+    void forceClose();
+    /**
+     * 在这条连接上启用TLS（TcpServer/TcpClient设置了TlsContext时自动调用），在connectEstablished之前调用。
+     * 之后send/outputBuffer()收发的都是明文：握手在loop中非阻塞地进行，握手完成前send的数据暂存，
+     * 完成后加密发出；MessageCallback只会收到解密后的数据。serverName为客户端的SNI和证书校验主机名。
+     */
+    void startTls(const std::shared_ptr<TlsContext> &context, const std::string &serverName = std::string());
+    bool tlsEnabled() const { return tls_ != nullptr; }
+    // TLS握手已经完成（NOT thread safe）
+    bool tlsEstablished() const;
+    /**
+     * 在用户数据和socket（TLS）之间加一级变换，如CompressionFilter。按添加顺序编码、按相反顺序解码。
+     * 在ConnectionCallback（连接建立时）中调用，之后send/outputBuffer()/MessageCallback看到的都是变换前的数据；
+     * 此后sendFile退化为读文件再send，不能再sendWithFds。must be called in loop thread
+     */
+    void addFilter(std::unique_ptr<ConnectionFilter> filter);
+    /**
+     * 把本连接的请求延迟分段记录到stats（见LatencyStats），并开启SO_TIMESTAMPNS，读数据时取得内核接收时间。
+     * TcpServer设置了LatencyStats时自动调用，在connectEstablished之前调用
+     */
+    void setLatencyStats(const std::shared_ptr<LatencyStats> &stats);
+    /**
+     * 把inputBuffer_/outputBuffer_占用的内存记到budget（见MemoryBudget），超过预算时本连接可能被暂停读或关闭。
+     * TcpServer设置了MemoryBudget时自动调用，在connectEstablished之前调用
+     */
+    void setMemoryBudget(const std::shared_ptr<MemoryBudget> &budget);
+    // 最近一次记账时inputBuffer_/outputBuffer_占用的内存（NOT thread safe）
+    size_t bufferMemory() const { return static_cast<size_t>(accountedBytes_); }
+    // 开启/关闭Nagle算法（TCP_NODELAY）
+    void setTcpNoDelay(bool on);
+    /**
+     * 开启/关闭TCP_CORK：开启期间内核只发满MSS的分段，关闭时把剩余数据一次发出。
+     * 适合手动把多次send（如响应头+sendFile）合并成尽量少的分段。must be called in loop thread
+     */
+    void setTcpCork(bool on);
+
+    // 开始/暂停从socket读数据（Thread safe）
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; } // NOT thread safe, may race with start/stopReadInLoop
+
+    /**
+     * 读预算（0表示不限）：每轮循环本连接最多从socket读maxBytes字节、最多处理maxMessages条消息。
+     * 消息数由解码器在处理每条消息前调用consumeMessageBudget()计数；预算用完后留在inputBuffer_中的数据
+     * 推迟到下一轮循环再交给MessageCallback，这样一个高速连接不会饿死同一subloop上的其他连接。
+     * 在connectEstablished之前或loop线程中调用
+     */
+    void setReadBudget(size_t maxBytes, size_t maxMessages);
+    // 解码器处理每条完整消息之前调用：返回false表示本轮的消息预算已用完，应停止解析直接返回
+    bool consumeMessageBudget()
+    {
+        if (maxMessagesPerRound_ == 0)
+        {
+            return true;
+        }
+        if (messageBudget_ == 0)
+        {
+            budgetExhausted_ = true;
+            return false;
+        }
+        --messageBudget_;
+        return true;
+    }
+
+    /**
+     * 背压：当本连接outputBuffer_中待发送的数据达到highMark时，暂停source的读事件；
+     * 回落到lowMark以下时再恢复读。source可以是代理中配对的另一条连接，也可以是本连接自己，
+     * 这样发送慢的对端不会让outputBuffer_无限增长。传入空的source则取消背压。
+     */
+    void setBackpressureSource(const TcpConnectionPtr &source, size_t highMark, size_t lowMark);
  
+    // 一条连接的全部回调。TcpServer的所有连接共用同一份，单独设置某条连接的回调时才复制一份（copy-on-write）
+    struct Callbacks
+    {
+        ConnectionCallback connection;       // 连接建立/断开时的回调
+        MessageCallback message;             // 有读写消息时的回调
+        WriteCompleteCallback writeComplete; // 消息发送完成以后的回调
+        HighWaterMarkCallback highWaterMark;
+        CloseCallback close;
+    };
+    // 直接使用callbacks（不复制），之后不应再修改它。在connectEstablished之前调用
+    void setCallbacks(const std::shared_ptr<Callbacks> &callbacks) { callbacks_ = callbacks; }
+
     // 设置回调函数：
     void setConnectionCallback(const ConnectionCallback& cb)
-    { connectionCallback_ = cb; } 
+    { ownCallbacks()->connection = cb; }
     void setMessageCallback(const MessageCallback& cb)
-    { messageCallback_ = cb; } 
+    { ownCallbacks()->message = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback& cb)
-    { writeCompleteCallback_ = cb; } 
+    { ownCallbacks()->writeComplete = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
-    { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; } 
+    { ownCallbacks()->highWaterMark = cb; highWaterMark_ = highWaterMark; }
     void setCloseCallback(const CloseCallback& cb)
-    { closeCallback_ = cb; }
+    { ownCallbacks()->close = cb; }
+
+    /**
+     * 紧凑模式（C1M）：inputBuffer_/outputBuffer_没有数据时立即释放内存，空闲连接不占用缓冲区，
+     * 代价是活跃连接每次收发都要重新分配。TcpServer::setCompactMode开启，在connectEstablished之前调用
+     */
+    void setCompactMode(bool on);
+
+    /**
+     * 计算任务结果的有序交付（见ThreadPool::submit）：beginOffload为一个任务领取序号，
+     * completeOffload按序号顺序执行各任务的结果回调，先完成的任务等待排在它前面的任务。
+     * must be called in loop thread
+     */
+    uint64_t beginOffload();
+    void completeOffload(uint64_t ticket, const std::function<void()> &done);
+
+    // 每个连接可以挂一个任意类型的上下文（如协议解析的状态）
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void>& getContext() const { return context_; }
 	
     /* This two functions should be called only once. */
     // Called me when tcpServer accepts a new connection
@@ -69,42 +217,152 @@ public:
     // Called me when TcpServer has remove me from its map
     void connectDestroyed();
 private:
+    friend class MemoryBudget;
+
     enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
 	const char* stateToString() const;
     void setState(StateE state) { state_ = state; }
+    // 修改回调之前调用：与其他连接共用时先复制一份
+    Callbacks* ownCallbacks();
 
-    void handleRead(Timestamp receiveTime);
-    void handleWrite();
-    void handleClose();
-    void handleError();
+    // channel_的ChannelHandler。final：类内部的直接调用（如handleClose）不经过虚函数表
+    void handleRead(Timestamp receiveTime) override final;
+    // 以新的一轮消息预算调用messageCallback_，预算用完还有剩余数据时推迟到下一轮
+    void dispatchMessages(Timestamp receiveTime);
+    void handleCarryOver();
+    // 一次分发结束后记录kKernelQueue/kDispatch/kHandler，回复还没写完时留到writeCompleted再记录kWrite/kTotal
+    void recordDispatchLatency(Timestamp receiveTime, int64_t dispatchStartNs);
+    void handleWrite() override final;
+    void handleClose() override final;
+    void handleError() override final;
 	
     // 由于应用层写的快，内核发送数据慢，故需要将待发送的数据先写入缓冲区，且设置了水位回调
     void sendInLoop(const void* message, size_t len);
+    void sendvInLoop(const struct iovec *iov, int iovcnt);
+    // 没有排队的文件时，数据经过各filter后交给sendFilteredInLoop
+    void filterAndSendInLoop(const struct iovec *iov, int iovcnt);
+    // 已经经过各filter的数据：交给TLS加密或直接写socket
+    void sendFilteredInLoop(const struct iovec *iov, int iovcnt);
+    // 发送用户在outputBuffer()中构造的数据（有filter时）
+    void flushFilterStaging();
+    // 解码filters_->input()中的数据，追加到inputBuffer_。数据无效时关闭连接并返回false
+    bool decodeFilterInput();
+    // 把数据原样写入socket（TLS连接上是密文，或者内核负责加密的明文）
+    void writeRawInLoop(const struct iovec *iov, int iovcnt);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // outputBuffer_的大小发生变化后，检查是否需要暂停/恢复source的读
+    void updateBackpressure();
+    void releaseBackpressure();
+    // 缓冲区大小变化后更新内存记账，超过预算时释放空闲缓冲区、暂停读或关闭连接
+    void updateMemoryUsage();
+    // 总量回落后由MemoryBudget调用
+    void resumeMemoryPaused();
+    // 发送pendingSegments_，返回false表示发生了错误
+    bool sendPendingSegments();
+    // 用sendmsg发送数据并附带描述符
+    ssize_t writeWithFds(const char *data, size_t len, const std::vector<int> &fds);
+    void writeCompleted();
+    // auto-cork：本轮事件分发结束后，把攒在outputBuffer_中的数据write出去
+    void scheduleCorkFlush();
+    void flushCorked();
+    // TLS：读socket并解密、发送OpenSSL产生的密文、处理握手完成
+    void handleTlsRead(Timestamp receiveTime);
+    bool handleTlsResult(int result, bool wasEstablished);
+    void flushTlsOutput();
+    // 以下两个函数返回false表示加密失败、连接已经关闭
+    bool flushTlsPlaintext();
+    bool encryptAndWriteInLoop(const struct iovec *iov, int iovcnt);
+    void tlsEstablishedInLoop();
+    // 数据需要加密（没有kTLS）或经过filter时，sendFile退化为读文件再send：文件排进bufferedFiles_，
+    // 每次outputBuffer_写空后（writeCompleted）再读下一块，不会一次把整个文件读进内存
+    void sendFileBuffered(int fd, off_t offset, size_t count, bool closeWhenDone);
+    // 发送bufferedFiles_的下一块，读文件失败时关闭连接并返回false
+    bool pumpBufferedFiles();
+    // 关闭bufferedFiles_中由我们负责关闭的文件并清空
+    void discardBufferedFiles();
+
+    // 排在outputBuffer_之后等待发送的一段输出：一个sendfile发送的文件，或者一组随数据传递的描述符，
+    // 以及排在它之后、下一段之前send的数据
+    struct PendingSegment
+    {
+        int fd;                   // 没有文件时为-1
+        off_t offset;
+        size_t remaining;
+        bool closeWhenDone;
+        std::vector<int> passFds; // 随tail的第一个字节一起发送（SCM_RIGHTS）
+        Buffer tail;
+    };
 
+    // 每次事件都要访问的字段放在最前面，标志位挤在state_之后的空隙里
     EventLoop *loop_; // 这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
     std::atomic_int state_;   // atomic variable
     bool reading_;
-	
+    bool compact_;      // 紧凑模式，见setCompactMode
+    bool corkPending_;  // outputBuffer_中有攒下的数据，已登记在本轮分发结束后冲刷
+    bool sourcePaused_; // 见backpressureSource_
+
     // Acceptor ==> mainloop、TcpConnection ==> subloop
-    std::unique_ptr<Socket> socket_;
     std::unique_ptr<Channel> channel_;
-
-    const InetAddress localAddr_;
-    const InetAddress peerAddr_;
-    
-    // 各种回调函数：
-    ConnectionCallback connectionCallback_; // 有新连接时的回调
-    MessageCallback messageCallback_;       // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
-	
-    size_t highWaterMark_;  // 设置水位线
+    std::unique_ptr<Socket> socket_;
+    // 各种回调函数，见Callbacks
+    std::shared_ptr<Callbacks> callbacks_;
 
     // 接收数据的缓冲区
     Buffer inputBuffer_; 
     // 发送数据的缓冲区（避免发送数据过快，导致数据丢失），通过水位线highWaterMark限制发送的数据量
     Buffer outputBuffer_;   // FIXME : use list<Buffer> as output buffer
+    // 排在outputBuffer_之后（list为空时不分配内存，deque会预先分配一块）
+    std::list<std::unique_ptr<PendingSegment>> pendingSegments_;
+    // sendFileBuffered排队的文件（不使用passFds），tail为明文，之后send的数据都排在里面
+    std::list<std::unique_ptr<PendingSegment>> bufferedFiles_;
+    size_t highWaterMark_;  // 设置水位线
+
+    // 读预算，见setReadBudget
+    size_t maxBytesPerRound_;
+    size_t maxMessagesPerRound_;
+    size_t messageBudget_;      // 本轮还能处理的消息数
+    uint64_t lastDispatchIteration_;
+    bool budgetExhausted_;      // 上一次dispatch因为预算用完而停止
+    bool carryOverPending_;     // 已推迟到下一轮继续处理
+    bool receiveFds_;
+    bool latencyReplied_;       // 本次分发期间发送了数据（延迟统计）
+    bool memoryPaused_;         // 因超出内存预算暂停了读（不改变reading_）
+    Timestamp carryOverTime_;   // 推迟的数据的接收时间
+
+    const std::string name_;
+    const InetAddress localAddr_;
+    const InetAddress peerAddr_;
+
+    // 背压：outputBuffer_超过backpressureHigh_时暂停backpressureSource_的读，低于backpressureLow_时恢复
+    std::weak_ptr<TcpConnection> backpressureSource_;
+    size_t backpressureHigh_;
+    size_t backpressureLow_;
+
+    std::vector<int> receivedFds_; // 收到但还没有被取走的描述符
+
+    // 线程池任务的有序交付
+    uint64_t nextOffloadTicket_;
+    uint64_t nextDeliveryTicket_;
+    std::map<uint64_t, std::function<void()>> completedOffloads_; // 已完成但还没轮到交付的结果
+
+    // 延迟统计，见setLatencyStats
+    std::shared_ptr<LatencyStats> latencyStats_;
+    LatencyStats::Shard *latencyShard_; // 为空表示不统计
+    int64_t kernelReceiveNs_;   // 最近一次读到的数据的内核接收时间，0表示没有
+    int64_t replyOriginNs_;     // 回复还没写完的请求的起点（内核接收或poll返回），0表示没有
+    int64_t replyHandlerEndNs_; // 该请求的回调返回的时间
+
+    // 内存记账，见setMemoryBudget
+    std::shared_ptr<MemoryBudget> memoryBudget_;
+    MemoryBudget::Shard *memoryShard_; // 为空表示不记账
+    int64_t accountedBytes_;  // 已记入预算的缓冲区容量
+    int64_t accountedQueued_; // 已记入预算的outputBuffer_排队字节数
+
+    std::unique_ptr<FilterChain> filters_; // 为空表示没有filter
+    std::unique_ptr<TlsSession> tls_; // 为空表示明文连接
+
+    std::shared_ptr<void> context_;
 };
@@ -17,6 +17,7 @@
 #include <memory>
 #include <atomic>
 #include <unordered_map>
+#include <map>
 
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
@@ -37,15 +38,41 @@ public:
     ~TcpServer();
 
     void setThreadInitcallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; connCallbacks_.reset(); }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; connCallbacks_.reset(); }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; connCallbacks_.reset(); }
 
     // 设置底层线程数，即subloop的个数
     void setThreadNum(int numThreads);
+    // 新连接的读预算（见TcpConnection::setReadBudget），在start()之前调用
+    void setReadBudget(size_t maxBytes, size_t maxMessages)
+    { readBudgetBytes_ = maxBytes; readBudgetMessages_ = maxMessages; }
+    // 新连接都使用TLS（见TcpConnection::startTls），在start()之前调用
+    void setTlsContext(const std::shared_ptr<TlsContext> &context) { tlsContext_ = context; }
+    // 新连接的请求延迟分段记录到stats（见LatencyStats，所有subloop共用一个），在start()之前调用
+    void setLatencyStats(const std::shared_ptr<LatencyStats> &stats) { latencyStats_ = stats; }
+    // 新连接的缓冲区内存记到budget（见MemoryBudget，可与其他server共用），超过预算时拒绝新连接，在start()之前调用
+    void setMemoryBudget(const std::shared_ptr<MemoryBudget> &budget) { memoryBudget_ = budget; }
+    // 新连接使用紧凑模式（见TcpConnection::setCompactMode），适合大量空闲连接（C1M），在start()之前调用
+    void setCompactMode(bool on) { compactMode_ = on; }
+    // baseLoop和所有subloop（包括resizeThreadPool新增的）都由watchdog监视卡顿，在start()之前调用
+    void setStallWatchdog(const std::shared_ptr<StallWatchdog> &watchdog) { stallWatchdog_ = watchdog; }
 
     // 开启mainloop监听客户端的连接
     void start();
+
+    /**
+     * 运行期调整subloop的个数（Thread safe，start()之后调用）：新增的loop立即参与新连接的分配；
+     * 减少时从最后加入的loop开始退役，退役的loop不再接收新连接，等它上面的连接全部关闭后退出线程。
+     * drainTimeout >= 0 时，退役drainTimeout秒后仍未关闭的连接会被强制关闭。
+     */
+    void resizeThreadPool(int numThreads, double drainTimeout = -1.0);
+
+    const std::string& ipPort() const { return ipPort_; }
+    const std::string& name() const { return name_; }
+    EventLoop* getLoop() const { return loop_; }
+    // start()之后可以通过它取得所有subloop
+    std::shared_ptr<EventLoopThreadPool> threadPool() const { return threadPool_; }
 private:
     // Not thread safe, but in loop.
     void newConnection(int sockfd, const InetAddress &peerAddr);
@@ -53,6 +80,9 @@ private:
     void removeConnection(const TcpConnectionPtr &conn);
     // Not thread safe, but in loop.
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    void resizeThreadPoolInLoop(int numThreads, double drainTimeout);
+    // 强制关闭退役loop上剩余的连接
+    void forceCloseRetiring(EventLoop *ioLoop);
 
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
@@ -68,11 +98,29 @@ private:
     ConnectionCallback connectionCallback_; // 有新连接时的回调
     MessageCallback messageCallback_; // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
+    // 所有连接共用的一份回调（第一个连接建立时生成），省去每个连接各复制一份std::function
+    std::shared_ptr<TcpConnection::Callbacks> connCallbacks_;
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
 
+    size_t readBudgetBytes_;
+    size_t readBudgetMessages_;
+    std::shared_ptr<TlsContext> tlsContext_;
+    std::shared_ptr<LatencyStats> latencyStats_;
+    std::shared_ptr<MemoryBudget> memoryBudget_;
+    std::shared_ptr<StallWatchdog> stallWatchdog_;
+    bool compactMode_;
+
     std::atomic_int started_;  // 注：可能会在多个线程中使用。故需要保证“线程安全”问题。
 
     int nextConnId_;  // Not thread safe, but in mainloop（only thread）. 
     ConnectionMap connections_; // 保存所有的连接
+
+    // 退役中的loop，及其上尚未关闭的连接数和强制关闭的定时器（只在baseLoop中访问）
+    struct RetiringLoop
+    {
+        size_t connections;
+        TimerId drainTimer;
+    };
+    std::map<EventLoop*, RetiringLoop> retiringLoops_;
 };
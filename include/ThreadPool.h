@@ -0,0 +1,73 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+class Thread;
+
+/**
+ * 计算线程池：与EventLoopThreadPool并列，用来执行压缩、加解密、查询计算等耗时的CPU任务，
+ * 避免在messageCallback_中直接计算而阻塞subloop上的其他连接。
+ *
+ * 每个工作线程有自己的任务队列：工作线程提交的任务放进自己的队列（后进先出，缓存更热），
+ * 其他线程提交的任务轮流分给各工作线程；自己的队列为空时从其他线程队列的头部窃取任务。
+ */
+class ThreadPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+    // 在池中执行，返回需要回到连接所在loop中执行的回调（如发送计算结果）
+    using Work = std::function<Task()>;
+
+    explicit ThreadPool(const std::string &nameArg = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    // 工作线程数，0表示使用CPU核数。在start()之前调用
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    void start();
+    // 执行完已提交的任务后退出所有工作线程
+    void stop();
+
+    // 提交任务（Thread safe）。没有start()或已经stop()时直接在当前线程中执行
+    void run(Task task);
+
+    /**
+     * 把work交给线程池执行，返回的回调通过runInLoop在conn所在的loop中执行。
+     * 同一连接的结果按提交顺序交付，即使后提交的任务先执行完。
+     * must be called in conn's loop thread
+     */
+    void submit(const TcpConnectionPtr &conn, Work work);
+
+    const std::string& name() const { return name_; }
+    size_t queueSize() const { return pending_; }
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void runInThread(size_t index);
+    bool take(size_t index, Task *task);
+
+    std::string name_;
+    int numThreads_;
+    std::atomic<bool> running_; // 在sleepMutex_下修改，run()不加锁读
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    std::atomic<size_t> next_;    // 外部提交的任务轮流分给各工作线程
+    std::atomic<size_t> pending_; // 所有队列中的任务数
+
+    std::mutex sleepMutex_; // 只在工作线程睡眠/唤醒以及stop()时使用，提交任务的快路径不加锁
+    std::condition_variable notEmpty_;
+    std::atomic<int> idle_; // 等待任务的工作线程数，在sleepMutex_下修改
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+
+// 定时器：记录超时时间、回调函数以及重复间隔
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++numCreated_)
+    {}
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复定时器：以now为基准，重新计算下一次的超时时间
+    void restart(Timestamp now);
+
+    static int64_t numCreated() { return numCreated_; }
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_; // 重复间隔（秒），<= 0表示一次性定时器
+    const bool repeat_;
+    const int64_t sequence_; // 全局唯一的序号，用来区分地址复用的Timer对象
+
+    static std::atomic<int64_t> numCreated_;
+};
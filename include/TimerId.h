@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 对外暴露的定时器标识，用于取消定时器（可拷贝）
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr)
+        , sequence_(0)
+    {}
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer)
+        , sequence_(seq)
+    {}
+
+    friend class TimerQueue;
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
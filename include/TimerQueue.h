@@ -0,0 +1,55 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/**
+ * 定时器队列：基于timerfd，把定时事件统一到Poller的IO事件中处理。
+ * timerfd的超时时间始终设置为队列中最早到期的定时器。
+ * 只在所属loop的线程中操作定时器列表，addTimer/cancel通过runInLoop保证线程安全。
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // Thread safe.
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+private:
+    using Entry = std::pair<Timestamp, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读时调用
+    void handleRead();
+    // 取出所有已到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_; // 按超时时间排序的定时器列表
+
+    // 用于cancel
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_;
+};
@@ -3,7 +3,7 @@
 #include <iostream>
 #include <string>
 
-// 时间类
+// 时间类：内部以微秒为单位记录自Epoch以来的时间
 class Timestamp
 {
 public:
@@ -11,6 +11,37 @@ public:
     explicit Timestamp(int64_t microSecondsSinceEpoch);
     static Timestamp now();
     std::string toString() const;
+
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+    static Timestamp invalid() { return Timestamp(); }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间点之间相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp的基础上，增加seconds秒
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
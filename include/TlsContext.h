@@ -0,0 +1,142 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+#include <string>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <sys/uio.h>
+
+// OpenSSL的类型，避免在头文件中包含openssl/ssl.h
+struct ssl_st;
+struct ssl_ctx_st;
+struct ssl_session_st;
+struct bio_st;
+
+/**
+ * TLS配置（对应一个SSL_CTX），可以被多个TcpServer/TcpClient、多个loop线程共享。
+ * 库在找到OpenSSL时才带TLS支持（定义MYMUDUO_WITH_OPENSSL），否则构造TlsContext会LOG_FATAL。
+ *
+ *   std::shared_ptr<TlsContext> tls(new TlsContext(TlsContext::kServer));
+ *   tls->useCertificate("server.crt", "server.key");
+ *   server.setTlsContext(tls);
+ *
+ * - 服务端开启会话缓存和TLS 1.3会话票据；客户端按serverName缓存会话，重连时自动复用，省掉完整握手。
+ * - setKernelTls(true)时握手直接在socket上进行并开启SSL_OP_ENABLE_KTLS：内核接管发送方向的加密后，
+ *   send直接写明文、sendFile仍然走sendfile零拷贝；内核或OpenSSL不支持时自动退回用户态加密。
+ */
+class TlsContext : noncopyable
+{
+public:
+    enum Role { kServer, kClient };
+
+    explicit TlsContext(Role role);
+    ~TlsContext();
+
+    // 加载PEM格式的证书链和私钥，失败返回false
+    bool useCertificate(const std::string &certFile, const std::string &keyFile);
+    // 客户端：是否校验服务端证书（默认校验，使用系统CA）；caFile非空时改用该CA文件
+    void setVerifyPeer(bool on, const std::string &caFile = std::string());
+    // 握手完成后尝试开启kTLS，在创建连接之前设置
+    void setKernelTls(bool on);
+    bool kernelTls() const { return kernelTls_; }
+
+    Role role() const { return role_; }
+    ssl_ctx_st* nativeHandle() const { return ctx_; }
+
+    // 统计：完成的握手数和其中复用了会话的次数
+    int64_t handshakes() const { return handshakes_; }
+    int64_t resumedHandshakes() const { return resumed_; }
+private:
+    friend class TlsSession;
+
+    // 客户端会话缓存，key为serverName（没有时为对端地址），返回的会话由调用方释放
+    ssl_session_st* findSession(const std::string &key);
+    void storeSession(const std::string &key, ssl_session_st *session);
+    static int onNewSession(ssl_st *ssl, ssl_session_st *session);
+
+    Role role_;
+    ssl_ctx_st *ctx_;
+    bool kernelTls_;
+    std::atomic<int64_t> handshakes_;
+    std::atomic<int64_t> resumed_;
+
+    std::mutex mutex_;
+    std::map<std::string, ssl_session_st*> sessions_; // guarded by mutex_
+};
+
+/**
+ * 一个连接上的TLS状态，由TcpConnection持有，所有方法都在连接所属的loop线程中调用。
+ *
+ * 默认使用内存BIO：socket读到的密文写入rbio，SSL_read解出的明文追加到inputBuffer_；
+ * 要发送的明文经SSL_write加密后从wbio取出，再走TcpConnection原有的outputBuffer_发送路径。
+ * kTLS模式下rbio直接是socket，握手完成后若内核没有接管发送方向，wbio换成内存BIO。
+ */
+class TlsSession : noncopyable
+{
+public:
+    enum Result
+    {
+        kOk,        // 成功，或者需要等待更多数据
+        kWantWrite, // 握手时socket写满了（仅kTLS模式），等可写事件后调用handshake()
+        kClosed,    // 对端关闭（收到close_notify或EOF）
+        kError,
+    };
+
+    // serverName：客户端用于SNI和证书校验的主机名（为空且校验证书时按对端IP校验）；sessionKey：客户端会话缓存的key
+    TlsSession(const std::shared_ptr<TlsContext> &context, int sockfd,
+               const std::string &serverName, const std::string &sessionKey);
+    ~TlsSession();
+
+    // 推进握手
+    Result handshake();
+    /**
+     * 从socket读数据：握手未完成时推进握手，完成后把解出的明文追加到plain。
+     * maxBytes限制本次从socket读的字节数（见TcpConnection::setReadBudget）
+     */
+    Result read(int fd, Buffer *plain, size_t maxBytes, int *savedErrno);
+    // 加密明文，密文追加到cipher。握手完成后才能调用
+    bool encrypt(const struct iovec *iov, int iovcnt, Buffer *cipher);
+    // 取出OpenSSL待发送的密文（握手消息、告警、会话票据等）
+    void drainOutput(Buffer *cipher);
+    // 发送close_notify
+    void shutdown();
+
+    bool established() const { return established_; }
+    // 发送方向已经由内核加密：明文直接写socket，sendfile可用
+    bool kernelSend() const { return kernelSend_; }
+    // kTLS模式：握手和读都直接在socket上进行
+    bool socketBio() const { return socketBio_; }
+    bool closeNotifySent() const { return closeNotifySent_; }
+    bool resumed() const;
+    const char* version() const;
+    const char* cipher() const;
+
+    // 握手完成前send的数据、以及用户通过outputBuffer()构造的明文，加密前暂存在这里
+    Buffer* plainOutput() { return &plainOutput_; }
+    // 加密结果的临时缓冲区
+    Buffer* cipherOutput() { return &cipherOutput_; }
+private:
+    friend class TlsContext;
+
+    Result decrypt(Buffer *plain, size_t maxBytes);
+    Result checkError(int ret, const char *what);
+    void onEstablished();
+
+    std::shared_ptr<TlsContext> context_;
+    ssl_st *ssl_;
+    bio_st *rbio_;   // 内存BIO模式下的密文输入，kTLS模式下为空
+    bio_st *wbio_;   // 内存BIO时的密文输出，否则为空
+    std::string sessionKey_;
+    bool socketBio_;
+    bool established_;
+    bool kernelSend_;
+    bool closeNotifySent_;
+    Buffer rawInput_;
+    Buffer plainOutput_;
+    Buffer cipherOutput_;
+    Buffer gather_; // 把多个小块明文合并成一条TLS记录
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+class EventLoop;
+
+// 收到的一个数据报，data指向UdpChannel内部的接收缓冲区，只在回调期间有效
+struct UdpDatagram
+{
+    const char *data;
+    size_t len;
+    InetAddress peer;
+};
+
+/**
+ * 绑定在一个EventLoop上的UDP socket：
+ *  - 接收：可读时用recvmmsg一次收取一批数据报到预先分配好的缓冲区，整批交给messageCallback_；
+ *    开启GRO时内核会把同一个流的多个数据报合并成一个，这里再按gso_size拆开。
+ *  - 发送：sendTo把数据报放入发送队列，在回调中发送的数据报等回调返回后用sendmmsg一次发出；
+ *    开启GSO时，发往同一个对端、长度相同的连续数据报合并成一个带UDP_SEGMENT的消息，由内核（或网卡）分段。
+ *    socket发送缓冲区满时暂存在队列中等待可写，队列满了就丢弃（UDP语义）。
+ * 除了sendTo之外，所有操作都要在loop线程中进行。
+ */
+class UdpChannel : noncopyable
+{
+public:
+    using MessageCallback = std::function<void(UdpChannel*, const UdpDatagram *datagrams, size_t n, Timestamp)>;
+
+    static const int kBatchSize = 64;          // 每次recvmmsg/sendmmsg的消息数
+    static const int kGroBatchSize = 16;       // 开启GRO时每个缓冲区为64K，减少批量以控制内存
+    static const size_t kMaxPendingSends = 4096;
+
+    UdpChannel(EventLoop *loop, const InetAddress &localAddr, bool reusePort,
+               size_t maxDatagramSize = 2048);
+    ~UdpChannel();
+
+    // 以下设置在start()之前调用
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    // 开启UDP GRO（需要内核5.0以上），不支持时返回false
+    bool setGro(bool on);
+    // 开启UDP GSO（需要内核4.18以上），发送失败时会自动关闭
+    void setGso(bool on) { gso_ = on; }
+    // 设置socket接收缓冲区（SO_RCVBUF），突发流量下缓冲区太小会在内核中丢包
+    void setReceiveBufferSize(int bytes);
+
+    // 开始接收，在loop线程中调用
+    void start();
+
+    // 线程安全，在其他线程调用时会拷贝数据
+    void sendTo(const InetAddress &peer, const char *data, size_t len);
+    void sendTo(const InetAddress &peer, const std::string &message) { sendTo(peer, message.data(), message.size()); }
+
+    EventLoop* getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+    InetAddress localAddress() const { return InetAddress(Socket::sockfd_To_SockAddr(socket_.fd())); }
+
+    // 统计，可以在其他线程读取
+    uint64_t receivedDatagrams() const { return received_.load(std::memory_order_relaxed); }
+    uint64_t sentDatagrams() const { return sent_.load(std::memory_order_relaxed); }
+    uint64_t droppedDatagrams() const { return dropped_.load(std::memory_order_relaxed); }
+private:
+    struct PendingSend
+    {
+        sockaddr_in peer;
+        std::string data;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void sendInLoop(const sockaddr_in &peer, const char *data, size_t len);
+    void sendCopyInLoop(const InetAddress &peer, const std::string &data);
+    void flushSends();
+    // 从pending_[first]开始，最多能和后面多少个数据报合并成一个GSO消息
+    size_t coalesce(size_t first) const;
+    void setupReceiveBuffers();
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    MessageCallback messageCallback_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool gso_;
+    bool inCallback_;
+
+    // 接收：预先分配的缓冲区，每个消息占一个slot
+    int recvBatch_;
+    size_t slotSize_;
+    std::vector<char> recvArena_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in> recvAddrs_;
+    std::vector<char> recvControl_;
+    std::vector<UdpDatagram> datagrams_;
+
+    // 发送队列：pending_中的元素在发送后保留，复用其中string的容量
+    std::vector<PendingSend> pending_;
+    size_t pendingCount_;
+    size_t sentIndex_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<size_t> sendCovers_;   // 每个消息覆盖的数据报数
+    std::vector<char> sendControl_;
+
+    std::atomic<uint64_t> received_;
+    std::atomic<uint64_t> sent_;
+    std::atomic<uint64_t> dropped_;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "UdpChannel.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class EventLoopThreadPool;
+
+/**
+ * UDP服务器：每个IO loop一个UdpChannel，各自的socket都以SO_REUSEPORT绑定同一个地址，
+ * 由内核按四元组哈希把数据报分散到各个loop，loop之间不需要任何同步。
+ * 没有设置线程数时只在baseloop上创建一个UdpChannel。
+ */
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name);
+    ~UdpServer(); // 在baseloop线程中调用，等各loop上的UdpChannel析构完成后返回
+
+    // 以下设置在start()之前调用
+    void setThreadNum(int numThreads);
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setMessageCallback(const UdpChannel::MessageCallback &cb) { messageCallback_ = cb; }
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+    void setGro(bool on) { gro_ = on; }
+    void setGso(bool on) { gso_ = on; }
+    // 每个socket的SO_RCVBUF，0表示使用系统默认值
+    void setReceiveBufferSize(int bytes) { receiveBufferSize_ = bytes; }
+
+    void start();
+
+    const std::string& name() const { return name_; }
+    // start()之后有效，每个loop一个
+    const std::vector<std::unique_ptr<UdpChannel>>& channels() const { return channels_; }
+private:
+    EventLoop *loop_;
+    InetAddress listenAddr_;
+    const std::string name_;
+    std::unique_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    UdpChannel::MessageCallback messageCallback_;
+    size_t maxDatagramSize_;
+    bool gro_;
+    bool gso_;
+    int receiveBufferSize_;
+    bool started_;
+    std::vector<std::unique_ptr<UdpChannel>> channels_;
+};
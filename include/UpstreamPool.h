@@ -0,0 +1,84 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * 单个loop上的上游连接池：维护numConnections条到同一上游的TcpClient连接，
+ * 所有上游IO都运行在该loop上，并支持请求流水线（pipelining）：
+ * 同一条连接上可以有多个未完成的请求，响应按FIFO顺序与请求一一对应。
+ *
+ * 推荐的用法是在TcpServer的ThreadInitCallback中，为每个subloop创建一个UpstreamPool，
+ * 下游连接通过conn->getLoop()找到本loop的池子，这样上下游之间不会发生跨线程的切换。
+ *
+ * 除了构造函数，所有接口都必须在loop线程中调用。
+ */
+class UpstreamPool : noncopyable
+{
+public:
+    // 返回buffer开头第一个完整响应的长度，响应还不完整时返回0
+    using ResponseFramer = std::function<size_t(const Buffer*)>;
+    // 收到完整的响应时回调；连接断开导致请求失败时，data为nullptr、len为0
+    using ResponseCallback = std::function<void(const char *data, size_t len)>;
+
+    UpstreamPool(EventLoop *loop,
+                 const InetAddress &serverAddr,
+                 const std::string &nameArg,
+                 int numConnections,
+                 int maxPipelineDepth = 64);
+    ~UpstreamPool();
+
+    void setResponseFramer(ResponseFramer framer) { framer_ = std::move(framer); }
+    // backlog_最多暂存的请求数（默认10000），满了之后新请求立即以失败回调
+    void setMaxBacklog(size_t maxBacklog) { maxBacklog_ = maxBacklog; }
+
+    void start();
+    // 断开所有上游，在途和暂存的请求都以失败回调；之后send的请求立即失败
+    void stop();
+
+    // 把请求发往在途请求最少的连接；没有可用连接（或都达到了流水线深度上限）时，暂存在backlog_中。
+    // 所有上游都断开时，暂存的请求以失败回调
+    void send(const std::string &request, ResponseCallback cb);
+
+    EventLoop* getLoop() const { return loop_; }
+    size_t inflight() const;
+    size_t backlog() const { return backlog_.size(); }
+    int connectedCount() const;
+private:
+    struct Upstream
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn; // 连接建立后才非空
+        std::deque<ResponseCallback> pending; // 已发送、等待响应的请求
+    };
+
+    void onConnection(int index, const TcpConnectionPtr &conn);
+    void onMessage(int index, const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    // 选择在途请求最少的可用连接，没有时返回-1
+    int pickUpstream() const;
+    void sendTo(int index, const std::string &request, ResponseCallback cb);
+    void drainBacklog();
+    // 以失败回调backlog_中的请求
+    void failBacklog();
+    // 以失败回调所有在途和暂存的请求
+    void failAll();
+
+    EventLoop *loop_;
+    const std::string name_;
+    const size_t maxPipelineDepth_;
+    size_t maxBacklog_;
+    bool stopped_;
+    ResponseFramer framer_;
+    std::vector<Upstream> upstreams_;
+    std::deque<std::pair<std::string, ResponseCallback>> backlog_;
+};
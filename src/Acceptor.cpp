@@ -1,42 +1,63 @@
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "FlightRecorder.h"
 
 #include <sys/types.h>    
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 // Create a non-blocking socket file descriptor, abort if any error.
-static int createNonblocking()
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) 
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking()) // socket
+    , acceptSocket_(createNonblocking(listenAddr.family())) // socket
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(reuseport);
+    if (listenAddr.isUnix())
+    {
+        // 上次运行遗留的socket文件会导致bind失败（EADDRINUSE），只删除socket类型的文件
+        unixPath_ = listenAddr.toUnixPath();
+        struct stat st;
+        if (!unixPath_.empty() && unixPath_[0] != '@'
+            && ::stat(unixPath_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            ::unlink(unixPath_.c_str());
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(true);
+        acceptSocket_.setReusePort(reuseport);
+    }
     acceptSocket_.bindAddress(listenAddr); // bind
 	
     // 只注册了读回调函数：用来接受客户端的连接（listenfd只关心读事件）
     // TcpServer::start() Acceptor.listen  有新用户的连接，要执行一个回调（connfd => channel => subloop）
     // baseLoop => acceptChannel_(listenfd) => 
-    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+    acceptChannel_.setHandler(this);
 }
 
 Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (!unixPath_.empty() && unixPath_[0] != '@')
+    {
+        ::unlink(unixPath_.c_str());
+    }
 }
 
 void Acceptor::listen()
@@ -49,7 +70,7 @@ void Acceptor::listen()
 }
 
 // listenfd有事件发生了，就是有新用户连接了
-void Acceptor::handleRead()
+void Acceptor::handleRead(Timestamp)
 {
     InetAddress peerAddr;
 
@@ -57,6 +78,10 @@ void Acceptor::handleRead()
     int connfd = acceptSocket_.accept(&peerAddr);  // accept
     if (connfd >= 0)
     {
+        if (FlightRecorder::enabled())
+        {
+            FlightRecorder::recordInstant(FlightRecorder::kAccept, connfd);
+        }
         if (newConnectionCallback_)
         {
 	    // 该函数中，需要轮询找到subloop，并唤醒、分发当前新客户端的channel
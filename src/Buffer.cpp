@@ -2,6 +2,8 @@
 
 #include <errno.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <string.h>
 #include <unistd.h>
 
 /**
@@ -9,7 +11,7 @@
  * 从fd上读取数据  Poller工作在LT模式
  * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小。
 */ 
-ssize_t Buffer::readFd(int fd, int* saveErrno)
+ssize_t Buffer::readFd(int fd, int* saveErrno, size_t maxBytes)
 {
     char extrabuf[65536] = {0}; // 栈上的内存空间  64K  初始化为0
    
@@ -26,17 +28,17 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     
     const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
     vec[0].iov_base = begin() + writerIndex_;  // 第一块缓冲区，为buffer_从writeIndex_开始的剩余可写的连续空间
-    vec[0].iov_len = writable;
+    vec[0].iov_len = std::min(writable, maxBytes);
 
     vec[1].iov_base = extrabuf;                // 第二块缓冲区，自定义的栈区64K的连续空间
-    vec[1].iov_len = sizeof(extrabuf);
+    vec[1].iov_len = std::min(sizeof(extrabuf), maxBytes - vec[0].iov_len);
     
     /*     
 		Read data into the multiple buffers :   
 		The readv() system call reads iovcnt buffers from the file associated  with  the file descriptor fd 
 		into the buffers described by iov ("scatter input").
     */
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const int iovcnt = (writable < sizeof extrabuf && vec[1].iov_len > 0) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
@@ -51,7 +53,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     // 所以，需要将extrabuf中的数据转移到扩容后的buffer_中。
     else                    // extrabuf里面也写入了数据 
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable; // 即buffer_.size()（buffer_被释放时writable为0）
 	// 从 writerIndex_开始写 n - writable 大小的数据，到buffer_中
         append(extrabuf, n - writable);  
     }
@@ -59,17 +61,93 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     return n;
 }
 
-// 将buffer_中的数据，写入TCP发送缓冲区，之后回传给客户端
-ssize_t Buffer::writeFd(int fd, int* saveErrno)
+ssize_t Buffer::readFd(int fd, int* saveErrno, std::vector<int> *fds, size_t maxBytes)
+{
+    return recvMsg(fd, saveErrno, fds, nullptr, maxBytes);
+}
+
+ssize_t Buffer::recvMsg(int fd, int* saveErrno, std::vector<int> *fds, int64_t *receiveTimeNs, size_t maxBytes)
 {
-    size_t n = ::write(fd, peek(), readableBytes());
+    char extrabuf[65536];
+    // 一次最多接收的描述符数（与内核的SCM_MAX_FD相同）
+    static const size_t kMaxFds = 253;
+    char control[CMSG_SPACE(kMaxFds * sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))];
+
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_len = std::min(writable, maxBytes);
+    vec[1].iov_base = extrabuf;
+    vec[1].iov_len = std::min(sizeof(extrabuf), maxBytes - vec[0].iov_len);
+
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = (writable < sizeof extrabuf && vec[1].iov_len > 0) ? 2 : 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    if (receiveTimeNs != nullptr)
+    {
+        *receiveTimeNs = 0;
+    }
+    const ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
     if (n < 0)
     {
         *saveErrno = errno;
+        return n;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i)
+            {
+                int received;
+                ::memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof received);
+                if (fds != nullptr)
+                {
+                    fds->push_back(received);
+                }
+                else
+                {
+                    ::close(received); // 调用方不接收描述符，不能泄漏
+                }
+            }
+        }
+        else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS && receiveTimeNs != nullptr)
+        {
+            struct timespec ts;
+            ::memcpy(&ts, CMSG_DATA(cmsg), sizeof ts);
+            *receiveTimeNs = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        LOG_ERROR("Buffer::recvMsg - ancillary data truncated, some descriptors were dropped \n");
+    }
+
+    if (static_cast<size_t>(n) <= writable)
+    {
+        writerIndex_ += n;
     }
     else
     {
-        saveErrno = nullptr;
+        writerIndex_ += writable; // 即buffer_.size()（buffer_被释放时writable为0）
+        append(extrabuf, n - writable);
+    }
+    return n;
+}
+
+// 将buffer_中的数据，写入TCP发送缓冲区，之后回传给客户端
+ssize_t Buffer::writeFd(int fd, int* saveErrno)
+{
+    ssize_t n = ::write(fd, peek(), readableBytes());
+    if (n < 0)
+    {
+        *saveErrno = errno;
     }
     return n;
 }
@@ -8,14 +8,82 @@ const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
 
+class Channel::CallbackHandler : public ChannelHandler
+{
+public:
+    void handleRead(Timestamp receiveTime) override
+    {
+        if (readCallback)
+        {
+            readCallback(receiveTime);
+        }
+    }
+    void handleWrite() override
+    {
+        if (writeCallback)
+        {
+            writeCallback();
+        }
+    }
+    void handleClose() override
+    {
+        if (closeCallback)
+        {
+            closeCallback();
+        }
+    }
+    void handleError() override
+    {
+        if (errorCallback)
+        {
+            errorCallback();
+        }
+    }
+
+    ReadEventCallback readCallback;
+    EventCallback writeCallback;
+    EventCallback closeCallback;
+    EventCallback errorCallback;
+};
+
 // EventLoop: ChannelList Poller
 Channel::Channel(EventLoop *loop, int fd)
-    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false)
+    : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false), handler_(nullptr)
 { }
 
 Channel::~Channel()
 { }
 
+Channel::CallbackHandler* Channel::callbackHandler()
+{
+    if (!callbacks_)
+    {
+        callbacks_.reset(new CallbackHandler);
+        handler_ = callbacks_.get();
+    }
+    return callbacks_.get();
+}
+
+void Channel::setReadCallback(ReadEventCallback cb)
+{
+    callbackHandler()->readCallback = std::move(cb);
+}
+
+void Channel::setWriteCallback(EventCallback cb)
+{
+    callbackHandler()->writeCallback = std::move(cb);
+}
+
+void Channel::setCloseCallback(EventCallback cb)
+{
+    callbackHandler()->closeCallback = std::move(cb);
+}
+
+void Channel::setErrorCallback(EventCallback cb)
+{
+    callbackHandler()->errorCallback = std::move(cb);
+}
+
 // channel的tie方法什么时候调用过？
 // 一个TcpConnection新连接创建的时候 TcpConnection => Channel 
 void Channel::tie(const std::shared_ptr<void> &obj)
@@ -60,26 +128,24 @@ void Channel::handleEvent(Timestamp receiveTime)
     }
 }
 
-// 根据poller通知的channel发生的具体事件， 由channel负责调用具体的回调操作
+// 根据poller通知的channel发生的具体事件， 由channel负责调用具体的处理函数
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_);
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_);
+    if (handler_ == nullptr)
+    {
+        return;
+    }
 
     // 在使用epoll机制进行I/O多路复用时，当文件描述符上出现EPOLLHUP事件时，通常意味着连接已经被对端关闭，或者一些错误导致连接异常断开。
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
-        if (closeCallback_)
-        {
-            closeCallback_();
-        }
+        handler_->handleClose();
     }
 
     if (revents_ & EPOLLERR)
     {
-        if (errorCallback_)
-        {
-            errorCallback_();
-        }
+        handler_->handleError();
     }
 
     /*  
@@ -89,17 +155,11 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
     */
     if (revents_ & (EPOLLIN | EPOLLPRI))
     {
-        if (readCallback_)
-        {
-            readCallback_(receiveTime);
-        }
+        handler_->handleRead(receiveTime);
     }
 
     if (revents_ & EPOLLOUT)
     {
-        if (writeCallback_)
-        {
-            writeCallback_();
-        }
+        handler_->handleWrite();
     }
 }
@@ -0,0 +1,290 @@
+#include "ConnectionFilter.h"
+#include "Logger.h"
+
+#include <string.h>
+#include <endian.h>
+
+#ifdef MYMUDUO_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+void FilterChain::add(std::unique_ptr<ConnectionFilter> filter)
+{
+    filters_.push_back(std::move(filter));
+    encoded_.resize(filters_.size());
+    decoded_.resize(filters_.size() - 1);
+}
+
+Buffer* FilterChain::encode(const struct iovec *iov, int iovcnt)
+{
+    filters_[0]->encode(iov, iovcnt, &encoded_[0]);
+    for (size_t i = 1; i < filters_.size(); ++i)
+    {
+        struct iovec vec;
+        vec.iov_base = const_cast<char*>(encoded_[i - 1].peek());
+        vec.iov_len = encoded_[i - 1].readableBytes();
+        filters_[i]->encode(&vec, 1, &encoded_[i]);
+        encoded_[i - 1].retrieveAll();
+    }
+    return &encoded_.back();
+}
+
+bool FilterChain::decode(Buffer *out)
+{
+    Buffer *in = &input_;
+    for (size_t i = filters_.size(); i > 0; --i)
+    {
+        Buffer *dst = i == 1 ? out : &decoded_[i - 2];
+        if (!filters_[i - 1]->decode(in, dst))
+        {
+            return false;
+        }
+        in = dst;
+    }
+    return true;
+}
+
+namespace
+{
+const size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+// 压缩/解压上下文按线程复用：每个loop线程一份，不随连接分配
+#ifdef MYMUDUO_WITH_LZ4
+struct Lz4Context
+{
+    LZ4_stream_t *stream = LZ4_createStream();
+    ~Lz4Context() { LZ4_freeStream(stream); }
+};
+
+Lz4Context& lz4Context()
+{
+    static thread_local Lz4Context t_context;
+    return t_context;
+}
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+struct ZstdContext
+{
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    ~ZstdContext()
+    {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+ZstdContext& zstdContext()
+{
+    static thread_local ZstdContext t_context;
+    return t_context;
+}
+#endif
+
+// 跨多个iovec的块先拼接到这里再压缩
+std::vector<char>& gatherScratch()
+{
+    static thread_local std::vector<char> t_scratch;
+    return t_scratch;
+}
+}
+
+const size_t CompressionFilter::kMaxBlockSize;
+const size_t CompressionFilter::kMinCompressSize;
+
+CompressionFilter::CompressionFilter(Codec codec, int level)
+    : codec_(codec)
+    , level_(level)
+    , rawBytes_(0)
+    , wireBytes_(0)
+{
+    if (!supported(codec))
+    {
+        LOG_FATAL("CompressionFilter - codec %d was not found when building mymuduo \n", static_cast<int>(codec));
+    }
+}
+
+bool CompressionFilter::supported(Codec codec)
+{
+    switch (codec)
+    {
+#ifdef MYMUDUO_WITH_LZ4
+        case kLz4:
+            return true;
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+        case kZstd:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+void CompressionFilter::encode(const struct iovec *iov, int iovcnt, Buffer *out)
+{
+    int i = 0;
+    size_t offset = 0;
+    while (true)
+    {
+        while (i < iovcnt && offset == iov[i].iov_len)
+        {
+            ++i;
+            offset = 0;
+        }
+        if (i == iovcnt)
+        {
+            break;
+        }
+
+        const char *base = static_cast<const char*>(iov[i].iov_base) + offset;
+        size_t avail = iov[i].iov_len - offset;
+        if (avail >= kMaxBlockSize || i + 1 == iovcnt)
+        {
+            // 直接从用户的内存压缩
+            size_t n = avail < kMaxBlockSize ? avail : kMaxBlockSize;
+            encodeBlock(base, n, out);
+            offset += n;
+            continue;
+        }
+
+        // 当前段不足一块，后面还有数据：拼接成一块（如响应头+正文）
+        std::vector<char> &scratch = gatherScratch();
+        scratch.clear();
+        while (i < iovcnt && scratch.size() < kMaxBlockSize)
+        {
+            const char *data = static_cast<const char*>(iov[i].iov_base) + offset;
+            size_t n = iov[i].iov_len - offset;
+            if (n > kMaxBlockSize - scratch.size())
+            {
+                n = kMaxBlockSize - scratch.size();
+            }
+            scratch.insert(scratch.end(), data, data + n);
+            offset += n;
+            if (offset == iov[i].iov_len)
+            {
+                ++i;
+                offset = 0;
+            }
+        }
+        encodeBlock(scratch.data(), scratch.size(), out);
+    }
+}
+
+void CompressionFilter::encodeBlock(const char *data, size_t len, Buffer *out)
+{
+    size_t bound = compressBound(len);
+    out->ensureWriteableBytes(kHeaderSize + (bound > len ? bound : len));
+    char *dst = out->beginWrite() + kHeaderSize;
+    size_t n = len >= kMinCompressSize ? compress(data, len, dst, bound) : 0;
+    if (n == 0 || n >= len)
+    {
+        ::memcpy(dst, data, len);
+        n = len;
+    }
+
+    uint32_t header[2] = { htobe32(static_cast<uint32_t>(n)), htobe32(static_cast<uint32_t>(len)) };
+    ::memcpy(out->beginWrite(), header, kHeaderSize);
+    out->hasWritten(kHeaderSize + n);
+    rawBytes_ += len;
+    wireBytes_ += kHeaderSize + n;
+}
+
+bool CompressionFilter::decode(Buffer *in, Buffer *out)
+{
+    while (in->readableBytes() >= kHeaderSize)
+    {
+        uint32_t header[2];
+        ::memcpy(header, in->peek(), kHeaderSize);
+        size_t wireLen = be32toh(header[0]);
+        size_t rawLen = be32toh(header[1]);
+        if (rawLen > kMaxBlockSize || wireLen > rawLen)
+        {
+            LOG_ERROR("CompressionFilter::decode - invalid block %lu/%lu \n", wireLen, rawLen);
+            return false;
+        }
+        if (in->readableBytes() < kHeaderSize + wireLen)
+        {
+            break; // 块还没有收完
+        }
+
+        const char *src = in->peek() + kHeaderSize;
+        if (wireLen == rawLen)
+        {
+            out->append(src, rawLen);
+        }
+        else
+        {
+            out->ensureWriteableBytes(rawLen);
+            if (!decompress(src, wireLen, out->beginWrite(), rawLen))
+            {
+                LOG_ERROR("CompressionFilter::decode - corrupt block %lu/%lu \n", wireLen, rawLen);
+                return false;
+            }
+            out->hasWritten(rawLen);
+        }
+        in->retrieve(kHeaderSize + wireLen);
+    }
+    return true;
+}
+
+size_t CompressionFilter::compressBound(size_t len) const
+{
+#ifdef MYMUDUO_WITH_LZ4
+    if (codec_ == kLz4)
+    {
+        return LZ4_compressBound(static_cast<int>(len));
+    }
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+    if (codec_ == kZstd)
+    {
+        return ZSTD_compressBound(len);
+    }
+#endif
+    return len;
+}
+
+size_t CompressionFilter::compress(const char *src, size_t len, char *dst, size_t capacity)
+{
+#ifdef MYMUDUO_WITH_LZ4
+    if (codec_ == kLz4)
+    {
+        int n = LZ4_compress_fast_extState(lz4Context().stream, src, dst, static_cast<int>(len),
+                                           static_cast<int>(capacity), level_);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+    if (codec_ == kZstd)
+    {
+        size_t n = ZSTD_compressCCtx(zstdContext().cctx, dst, capacity, src, len, level_);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    (void)src; (void)len; (void)dst; (void)capacity; // 没有编译任何压缩库时
+    return 0;
+}
+
+bool CompressionFilter::decompress(const char *src, size_t len, char *dst, size_t rawLen)
+{
+#ifdef MYMUDUO_WITH_LZ4
+    if (codec_ == kLz4)
+    {
+        int n = LZ4_decompress_safe(src, dst, static_cast<int>(len), static_cast<int>(rawLen));
+        return n >= 0 && static_cast<size_t>(n) == rawLen;
+    }
+#endif
+#ifdef MYMUDUO_WITH_ZSTD
+    if (codec_ == kZstd)
+    {
+        size_t n = ZSTD_decompressDCtx(zstdContext().dctx, dst, rawLen, src, len);
+        return !ZSTD_isError(n) && n == rawLen;
+    }
+#endif
+    (void)src; (void)len; (void)dst; (void)rawLen; // 没有编译任何压缩库时
+    return false;
+}
@@ -0,0 +1,219 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Socket.h"
+#include "Logger.h"
+#include "InetAddress.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+// 创建非阻塞的socket，用于主动连接
+static int createNonblocking(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+// 判断是否自连接：本端的ip和port与对端的完全一样（连接本机的临时端口时可能发生）
+static bool isSelfConnect(int sockfd)
+{
+    InetAddress local = Socket::localAddress(sockfd);
+    if (local.isUnix())
+    {
+        return false; // Unix域socket不会自连接
+    }
+    InetAddress peer = Socket::peerAddress(sockfd);
+    return local.getSockAddr()->sin_port == peer.getSockAddr()->sin_port
+        && local.getSockAddr()->sin_addr.s_addr == peer.getSockAddr()->sin_addr.s_addr;
+}
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , retryDelayMs_(kInitRetryDelayMs)
+{
+    LOG_DEBUG("Connector ctor[%p]\n", this);
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG("Connector dtor[%p]\n", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    loop_->assertInLoopThread();
+    if (connect_)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("Connector::startInLoop do not connect\n");
+    }
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    loop_->assertInLoopThread();
+    loop_->cancel(retryTimer_);
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.sockAddr(), serverAddr_.sockAddrLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            // 非阻塞connect正在进行，等待sockfd可写
+            connecting(sockfd);
+            break;
+
+        case EAGAIN:        // AF_UNIX：服务端的backlog满了
+        case ENOENT:        // AF_UNIX：服务端还没有创建socket文件
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+            // 暂时性的错误，稍后重试
+            retry(sockfd);
+            break;
+
+        default:
+            LOG_ERROR("%s:%s:%d connect error:%d \n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+            ::close(sockfd);
+            break;
+    }
+}
+
+void Connector::restart()
+{
+    loop_->assertInLoopThread();
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    // 防止回调执行期间Connector被析构
+    channel_->tie(shared_from_this());
+    channel_->enableWriting();
+}
+
+// 连接建立（或失败）后，channel_就没用了，交出sockfd
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前正处于channel_的回调中，不能直接析构channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = Socket::getSocketError(sockfd);
+        if (err)
+        {
+            LOG_ERROR("Connector::handleWrite - SO_ERROR = %d \n", err);
+            retry(sockfd);
+        }
+        else if (isSelfConnect(sockfd))
+        {
+            LOG_ERROR("Connector::handleWrite - Self connect \n");
+            retry(sockfd);
+        }
+        else
+        {
+            setState(kConnected);
+            if (connect_ && newConnectionCallback_)
+            {
+                newConnectionCallback_(sockfd);
+            }
+            else
+            {
+                ::close(sockfd);
+            }
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    LOG_ERROR("Connector::handleError state=%d \n", (int)state_);
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = Socket::getSocketError(sockfd);
+        LOG_ERROR("Connector::handleError - SO_ERROR = %d \n", err);
+        retry(sockfd);
+    }
+}
+
+// 关闭失败的sockfd，并在retryDelayMs_之后重新连接，重试间隔按指数增长
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (connect_)
+    {
+        LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds. \n",
+                 serverAddr_.toIpPort().c_str(), retryDelayMs_);
+        retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0,
+                                      std::bind(&Connector::startInLoop, shared_from_this()));
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+    else
+    {
+        LOG_DEBUG("Connector::retry do not connect\n");
+    }
+}
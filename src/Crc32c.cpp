@@ -0,0 +1,104 @@
+#include "Crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace
+{
+
+const uint32_t kPoly = 0x82f63b78; // CRC32C的反射多项式
+
+// 查表法使用的256项表，程序启动时生成
+struct Crc32cTable
+{
+    uint32_t table[256];
+
+    Crc32cTable()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ kPoly : crc >> 1;
+            }
+            table[i] = crc;
+        }
+    }
+};
+
+const Crc32cTable kTable;
+
+uint32_t extendPortable(uint32_t crc, const char *data, size_t n)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+    uint32_t c = ~crc;
+    for (size_t i = 0; i < n; ++i)
+    {
+        c = kTable.table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+#if defined(__x86_64__)
+// 只给这个函数开启SSE4.2，其余代码不依赖编译选项，由运行时检测决定是否调用
+__attribute__((target("sse4.2")))
+uint32_t extendSse42(uint32_t crc, const char *data, size_t n)
+{
+    uint64_t c = ~crc;
+    // 每次处理8字节
+    while (n >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof word);
+        c = _mm_crc32_u64(c, word);
+        data += 8;
+        n -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (n > 0)
+    {
+        c32 = _mm_crc32_u8(c32, static_cast<unsigned char>(*data));
+        ++data;
+        --n;
+    }
+    return ~c32;
+}
+#endif
+
+using ExtendFunc = uint32_t (*)(uint32_t, const char*, size_t);
+
+ExtendFunc chooseExtend()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return extendSse42;
+    }
+#endif
+    return extendPortable;
+}
+
+const ExtendFunc kExtend = chooseExtend();
+
+} // namespace
+
+namespace Crc32c
+{
+    uint32_t extend(uint32_t crc, const char *data, size_t n)
+    {
+        return kExtend(crc, data, n);
+    }
+
+    bool isHardwareAccelerated()
+    {
+#if defined(__x86_64__)
+        return kExtend == extendSse42;
+#else
+        return false;
+#endif
+    }
+}
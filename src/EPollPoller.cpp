@@ -30,8 +30,8 @@ EPollPoller::~EPollPoller()
 // polls the I/O events
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // 实际上应该用LOG_DEBUG输出日志更为合理
-    LOG_INFO("[EpollPoller::%s] ==> fd total size = %d.\n", __FUNCTION__, channels_.size());
+    // 每次poll都会走到这里（busy-poll模式下更是频繁），故只输出DEBUG日志
+    LOG_DEBUG("[EpollPoller::%s] ==> fd total size = %d.\n", __FUNCTION__, channels_.size());
 	
     /* int epoll_wait(int __epfd, epoll_event *__events, int __maxevents, int __timeout) */ 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
@@ -40,7 +40,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happened.\n", numEvents);
+        LOG_DEBUG("%d events happened.\n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if (numEvents == events_.size())
         {
@@ -77,7 +77,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("[EpollPoller::%s] ==> fd=%d events=%d index=%d.\n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("[EpollPoller::%s] ==> fd=%d events=%d index=%d.\n", __FUNCTION__, channel->fd(), channel->events(), index);
 
     if (index == kNew || index == kDeleted)
     {
@@ -2,12 +2,16 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "FlightRecorder.h"
+#include "StallWatchdog.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <algorithm>
 
 /* 防止在一个线程中，创建多个EventLoop对象 */
 // __thread是一个关键字，其修饰的全局变量t_loopInThisThread在每一个线程内都会有一个独立的实体（一般的全局变量都是被同一个进程中的多个线程所共享）。
@@ -15,6 +19,8 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;
+// busy-poll模式下，空闲回退后的最小自旋预算（微秒）
+const int kMinSpinUs = 50;
 
 // 创建wakeupfd，用来notify唤醒subReactor处理新来的channel
 int createEventfd()
@@ -34,8 +40,19 @@ EventLoop::EventLoop()
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())   // 生成一个eventfd，每个EventLoop对象，都会有自己的eventfd
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , spinBudgetUs_(0)
+    , spinning_(false)
+    , autoCork_(false)
+    , corking_(false)
+    , iteration_(0)
+    , busySinceUs_(0)
+    , heartbeat_(0)
+    , activityKind_(nullptr)
+    , activityFd_(-1)
+    , activityDetail_(nullptr)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread)
@@ -50,13 +67,17 @@ EventLoop::EventLoop()
     }
 
     // 设置wakeupfd的事件类型以及发生事件后的回调操作
-    wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
+    wakeupChannel_->setHandler(this);
     // 每一个eventloop都将监听wakeupchannel的EPOLLIN读事件了
     wakeupChannel_->enableReading();
 }
 
 EventLoop::~EventLoop()
 {
+    if (watchdog_)
+    {
+        watchdog_->unwatch(this);
+    }
     wakeupChannel_->disableAll();  // 使channel对所有事件均丧失兴趣
     wakeupChannel_->remove();
     ::close(wakeupFd_);
@@ -71,19 +92,73 @@ void EventLoop::loop()
 
     LOG_INFO("EventLoop %p start looping \n", this);
 
+    // busy-poll：本轮自旋的起始时间（0表示尚未开始计时）以及当前的自旋预算
+    int64_t spinStartUs = 0;
+    int spinUs = spinBudgetUs_;
+
     while(!quit_)
     {
         activeChannels_.clear();  // 清空vector<Channel*>
+
+        ++iteration_;
+        // 取出上一轮推迟下来的任务（本轮新推迟的留到下一轮），有任务时poll不能阻塞
+        std::vector<Functor> deferred;
+        deferred.swap(deferredFunctors_);
+        int timeoutMs = deferred.empty() ? kPollTimeMs : 0;
+        if (spinBudgetUs_ > 0)
+        {
+            int64_t nowUs = Timestamp::now().microSecondsSinceEpoch();
+            if (spinStartUs == 0)
+            {
+                spinStartUs = nowUs;
+            }
+            // 自旋预算内，或者仍有待执行的回调，则继续以0超时轮询
+            if (timeoutMs == 0 || nowUs - spinStartUs < spinUs || !stopSpinning())
+            {
+                timeoutMs = 0;
+            }
+            else
+            {
+                // 空闲了整个预算，下一轮的自旋预算减半
+                spinUs = std::max(spinUs / 2, std::min(kMinSpinUs, spinBudgetUs_));
+            }
+        }
 		
 	/* Poller监听哪些channel发生事件了，然后上报给EventLoop，并通知Channel处理相应的事件 */
         // 监听两类fd：一种是client的fd，一种wakeupfd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        uint64_t pollStart = FlightRecorder::enabled() ? FlightRecorder::now() : 0;
+        busySinceUs_.store(0, std::memory_order_relaxed);
+        pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        heartbeat_.store(iteration_, std::memory_order_relaxed);
+        busySinceUs_.store(pollReturnTime_.microSecondsSinceEpoch(), std::memory_order_relaxed);
+        if (pollStart != 0)
+        {
+            FlightRecorder::recordSpan(FlightRecorder::kPoll, pollStart, static_cast<int32_t>(activeChannels_.size()));
+        }
+
+        if (spinBudgetUs_ > 0 && timeoutMs != 0)
+        {
+            // 从阻塞的poll中返回，重新进入自旋阶段
+            startSpinning();
+            spinStartUs = 0;
+        }
 		
+        corking_ = autoCork_;
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生事件了，然后上报给EventLoop，通知channel处理相应的事件
+            FlightRecorder::Scope scope(FlightRecorder::kChannel, channel->fd(), channel->revents());
+            setActivity("channel", channel->fd(), nullptr);
             channel->handleEvent(pollReturnTime_);
         }
+        for (const Functor &functor : deferred)
+        {
+            FlightRecorder::Scope scope(FlightRecorder::kDeferred);
+            setActivity("deferred", -1, watchdog_ ? functor.target_type().name() : nullptr);
+            functor();
+        }
+        // auto-cork：每个在事件处理中send过数据的连接，在这里统一write一次
+        doAfterDispatchFunctors();
 		
         // 执行当前EventLoop事件循环需要处理的回调操作
         /**
@@ -91,14 +166,100 @@ void EventLoop::loop()
          * mainLoop 事先注册一个回调cb（需要subloop来执行）    
          * wakeup subloop后，执行下面的方法（即执行之前mainloop注册在pendingFunctors中的cb操作）
         */ 
-        doPendingFunctors();
+        corking_ = autoCork_;
+        bool ranFunctors = doPendingFunctors();
+        doAfterDispatchFunctors();
+
+        if (spinBudgetUs_ > 0 && timeoutMs == 0)
+        {
+            // 自旋期间有IO事件或执行了回调，说明自旋有用：重新开始计时并恢复完整的自旋预算。
+            // 阻塞的poll醒来（包括被自己的eventfd唤醒）不算，否则减半的预算每次都会被立即恢复
+            bool ioFired = false;
+            for (Channel *channel : activeChannels_)
+            {
+                if (channel != wakeupChannel_.get())
+                {
+                    ioFired = true;
+                    break;
+                }
+            }
+            if (ioFired || ranFunctors)
+            {
+                spinStartUs = 0;
+                spinUs = spinBudgetUs_;
+            }
+        }
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
 }
+
+void EventLoop::setStallWatchdog(const std::shared_ptr<StallWatchdog> &watchdog)
+{
+    if (watchdog_ == watchdog)
+    {
+        return;
+    }
+    if (watchdog_)
+    {
+        watchdog_->unwatch(this);
+    }
+    watchdog_ = watchdog;
+    if (watchdog_)
+    {
+        watchdog_->watch(this);
+    }
+}
+
+void EventLoop::setBusyPoll(int spinBudgetUs)
+{
+    spinBudgetUs_ = spinBudgetUs > 0 ? spinBudgetUs : 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    spinning_ = spinBudgetUs_ > 0;
+}
+
+/**
+ * 在mutex_保护下清除spinning_并检查任务队列：
+ * queueInLoop同样在mutex_保护下读取spinning_，故要么它看到spinning_为false而写eventfd，
+ * 要么这里看到它刚放入的回调而继续自旋，不会出现丢失唤醒的情况。
+ */
+bool EventLoop::stopSpinning()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!pendingFunctors_.empty())
+    {
+        return false;
+    }
+    spinning_ = false;
+    return true;
+}
+
+void EventLoop::startSpinning()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    spinning_ = true;
+}
+
+void EventLoop::doAfterDispatchFunctors()
+{
+    corking_ = false;
+    // 冲刷时send的数据直接write；回调中新加入的cb同样在这里执行完
+    while (!afterDispatchFunctors_.empty())
+    {
+        std::vector<Functor> functors;
+        functors.swap(afterDispatchFunctors_);
+        for (const Functor &functor : functors)
+        {
+            FlightRecorder::Scope scope(FlightRecorder::kAfterDispatch);
+            setActivity("afterDispatch", -1, watchdog_ ? functor.target_type().name() : nullptr);
+            functor();
+        }
+    }
+}
+
 // 执行回调操作：
-void EventLoop::doPendingFunctors() 
+bool EventLoop::doPendingFunctors() 
 {
     // 定义局部的functors，并与pendingFunctors_进行交换
     //，之后pendingFunctors_会变为空，mainloop可继续给其中添加cb
@@ -112,10 +273,13 @@ void EventLoop::doPendingFunctors()
 
     for (const Functor &functor : functors)
     {
+        FlightRecorder::Scope scope(FlightRecorder::kFunctor);
+        setActivity("functor", -1, watchdog_ ? functor.target_type().name() : nullptr);
         functor(); // 执行当前loop需要执行的回调操作cb
     }
 
     callingPendingFunctors_ = false;
+    return !functors.empty();
 }
 
 // 退出事件循环  1.loop在自己的线程中调用quit  2.在非loop的线程中，调用loop的quit
@@ -137,6 +301,12 @@ void EventLoop::quit()
     }
 }
 
+size_t EventLoop::queueSize() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return pendingFunctors_.size();
+}
+
 // 该函数保证了cb这个函数对象一定是在其EventLoop线程中被调用，即在当前loop中执行cb
 void EventLoop::runInLoop(Functor cb)
 {
@@ -154,20 +324,23 @@ void EventLoop::runInLoop(Functor cb)
 // 把cb放入队列中，唤醒loop所在的线程，执行cb
 void EventLoop::queueInLoop(Functor cb)
 {
+    bool spinning = false;
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        pendingFunctors_.emplace_back(std::move(cb));
+        spinning = spinning_;
     }
 
     // 唤醒相应的，需要执行上面回调操作的loop的线程了
     // callingPendingFunctors_为true表示当前loop正在执行回调，但当前loop又有了新的回调操作
-    if (!isInLoopThread() || callingPendingFunctors_) 
+    // loop处于busy-poll自旋阶段时，它很快就会检查任务队列，无需写eventfd
+    if ((!isInLoopThread() || callingPendingFunctors_) && !spinning) 
     {
         wakeup(); // 唤醒loop所在线程
     }
 }
 
-void EventLoop::handleRead()
+void EventLoop::handleRead(Timestamp)
 {
   uint64_t one = 1;
   ssize_t n = read(wakeupFd_, &one, sizeof(one));
@@ -189,6 +362,28 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 // EventLoop的这些方法，需要调用Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
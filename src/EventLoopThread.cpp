@@ -14,19 +14,37 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
 
 EventLoopThread::~EventLoopThread()
 {
-    exiting_ = true;
-    if (loop_ != nullptr)
     {
-        loop_->quit();
+        // loop_只在mutex_保护下读取：threadFunc在同一把锁下把它置空之后才析构栈上的EventLoop，
+        // 所以这里看到的非空loop_一定还活着
+        std::unique_lock<std::mutex> lock(mutex_);
+        exiting_ = true;
+        if (loop_ != nullptr)
+        {
+            loop_->quit();
+        }
+    }
+    // loop已经自己退出时（如EventLoopThreadPool::releaseLoop）loop_为空，线程可能还在收尾，同样要等它结束
+    if (thread_.started())
+    {
         thread_.join();
     }
 }
 
 EventLoop* EventLoopThread::startLoop()
+{
+    start();
+    return waitLoop();
+}
+
+void EventLoopThread::start()
 {
     // 启动底层的线程，并执行EventLoopThread::threadFunc()回调函数 
     thread_.start(); 
+}
 
+EventLoop* EventLoopThread::waitLoop()
+{
     EventLoop *loop = nullptr;
     {
         std::unique_lock<std::mutex> lock(mutex_);
@@ -50,14 +68,19 @@ void EventLoopThread::threadFunc()
         callback_(&loop);
     }
 
+    bool exiting = false;
     {
         std::unique_lock<std::mutex> lock(mutex_);
         loop_ = &loop;
+        exiting = exiting_; // 还没进入loop就已经在析构了，此时的quit()会被loop()开头重置
         cond_.notify_one();
     }
 	
     // EventLoop loop  => Poller.poll
-    loop.loop(); 
+    if (!exiting)
+    {
+        loop.loop();
+    }
 	
     // 关闭loop_，即不再进行事件循环
     std::unique_lock<std::mutex> lock(mutex_);
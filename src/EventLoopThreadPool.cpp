@@ -1,7 +1,32 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
 
+#include "EventLoop.h"
+#include "Logger.h"
+
 #include <memory>
+#include <algorithm>
+
+namespace
+{
+void destroyThread(EventLoopThread *thread)
+{
+    delete thread; // 等待线程退出
+}
+
+// 在退役的loop中执行：前面的回调又排入了新的回调时，等它们都执行完再退出，
+// 退出后由baseLoop析构EventLoopThread（此时线程已经不再处理事件，join很快返回）
+void quitWhenDrained(EventLoop *loop, EventLoop *baseLoop, EventLoopThread *thread)
+{
+    if (loop->queueSize() > 0)
+    {
+        loop->queueInLoop(std::bind(&quitWhenDrained, loop, baseLoop, thread));
+        return;
+    }
+    loop->quit();
+    baseLoop->queueInLoop(std::bind(&destroyThread, thread));
+}
+}
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
     : baseLoop_(baseLoop)
@@ -9,6 +34,7 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , started_(false)
     , numThreads_(0)
     , next_(0)
+    , nextThreadId_(0)
 {}
 
 // 底层所有loop都是创建在栈空间上的，故不需要手动释放操作
@@ -18,14 +44,20 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    threadInitCallback_ = cb;
+    nextThreadId_ = numThreads_;
 
+    // 先启动所有线程，各线程并行地创建EventLoop、执行初始化回调
     for (int i = 0; i < numThreads_; ++i)
     { 
         EventLoopThread *t = new EventLoopThread(cb, name_ + std::to_string(i));
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-		
-	// 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
-        loops_.push_back(t->startLoop()); 
+        t->start();
+    }
+    for (int i = 0; i < numThreads_; ++i)
+    {
+	// 等待线程绑定好EventLoop，并记录该loop的地址
+        loops_.push_back(threads_[i]->waitLoop()); 
     }
 
     // 此时，表明整个服务端只有一个线程，其运行着baseloop
@@ -61,6 +93,56 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
     }
     else
     {
-        loops_;
+        return loops_;
+    }
+}
+
+EventLoop* EventLoopThreadPool::addLoop()
+{
+    baseLoop_->assertInLoopThread();
+    // 线程名字继续编号，不与退役的线程重复
+    EventLoopThread *t = new EventLoopThread(threadInitCallback_, name_ + std::to_string(nextThreadId_++));
+    threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+    EventLoop *loop = t->startLoop();
+    loops_.push_back(loop);
+    LOG_INFO("EventLoopThreadPool %s add loop %p, %lu loops \n", name_.c_str(), loop, loops_.size());
+    return loop;
+}
+
+bool EventLoopThreadPool::retireLoop(EventLoop *loop)
+{
+    baseLoop_->assertInLoopThread();
+    std::vector<EventLoop*>::iterator it = std::find(loops_.begin(), loops_.end(), loop);
+    if (it == loops_.end())
+    {
+        return false;
+    }
+    size_t index = it - loops_.begin();
+    retiredLoops_.push_back(loop);
+    retiredThreads_.push_back(std::move(threads_[index]));
+    loops_.erase(it);
+    threads_.erase(threads_.begin() + index);
+    if (static_cast<size_t>(next_) >= loops_.size())
+    {
+        next_ = 0;
+    }
+    LOG_INFO("EventLoopThreadPool %s retire loop %p, %lu loops \n", name_.c_str(), loop, loops_.size());
+    return true;
+}
+
+void EventLoopThreadPool::releaseLoop(EventLoop *loop)
+{
+    baseLoop_->assertInLoopThread();
+    std::vector<EventLoop*>::iterator it = std::find(retiredLoops_.begin(), retiredLoops_.end(), loop);
+    if (it == retiredLoops_.end())
+    {
+        return;
     }
+    size_t index = it - retiredLoops_.begin();
+    // 不能在这里析构EventLoopThread：它会立即quit并join，loop中排队的回调（如connectDestroyed）可能来不及执行，
+    // baseLoop也会阻塞在join上。交给退役的loop执行完回调后自己退出，再回到baseLoop回收线程
+    EventLoopThread *thread = retiredThreads_[index].release();
+    retiredThreads_.erase(retiredThreads_.begin() + index);
+    retiredLoops_.erase(it);
+    loop->queueInLoop(std::bind(&quitWhenDrained, loop, baseLoop_, thread));
 }
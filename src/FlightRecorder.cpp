@@ -0,0 +1,327 @@
+#include "FlightRecorder.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+std::atomic_bool FlightRecorder::enabled_(false);
+
+namespace
+{
+struct Event
+{
+    uint64_t start;
+    uint64_t end;
+    int32_t arg;
+    int32_t extra;
+    int32_t type;
+};
+
+// 一个线程的环形缓冲区：只有所属线程写，导出时其他线程读
+struct Ring
+{
+    Ring(size_t capacity, int tidArg, const std::string &nameArg)
+        : events(capacity)
+        , mask(capacity - 1)
+        , next(0)
+        , tid(tidArg)
+        , name(nameArg)
+    {}
+
+    std::vector<Event> events;
+    const size_t mask;
+    std::atomic<uint64_t> next; // 已写入的事件总数，events[next & mask]是下一个要写的位置
+    const int tid;
+    const std::string name;
+};
+
+// 线程退出后最多保留的ring数：导出时仍能看到最近退出的线程最后的事件，
+// 又不会让不断创建、退出的线程（如弹性线程池）每个都占住一个ring
+const size_t kMaxRetiredRings = 8;
+
+std::mutex g_mutex; // 保护下面的变量
+std::vector<std::shared_ptr<Ring>> g_rings;   // 仍在运行的线程
+std::deque<std::shared_ptr<Ring>> g_retired;  // 已经退出的线程，按退出顺序
+size_t g_capacity = 16384;
+pthread_key_t g_ringKey;
+bool g_calibrated = false;
+uint64_t g_baseTicks = 0;  // 第一次开启时的时间戳，导出时的零点
+int64_t g_baseNanos = 0;
+
+// initial-exec：动态库中访问线程局部变量不必经过__tls_get_addr
+__thread Ring *t_ring __attribute__((tls_model("initial-exec"))) = nullptr;
+
+int64_t monotonicNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 线程退出时由pthread调用：ring移到g_retired，超出kMaxRetiredRings时释放最早退出的
+void retireThreadRing(void *arg)
+{
+    Ring *ring = static_cast<Ring*>(arg);
+    t_ring = nullptr;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::vector<std::shared_ptr<Ring>>::iterator it =
+        std::find_if(g_rings.begin(), g_rings.end(),
+                     [ring](const std::shared_ptr<Ring> &r) { return r.get() == ring; });
+    if (it == g_rings.end())
+    {
+        return;
+    }
+    g_retired.push_back(*it);
+    g_rings.erase(it);
+    while (g_retired.size() > kMaxRetiredRings)
+    {
+        g_retired.pop_front(); // 正在导出的线程持有自己的shared_ptr，不受影响
+    }
+}
+
+Ring* createThreadRing()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    ::pthread_once(&once, []() { ::pthread_key_create(&g_ringKey, retireThreadRing); });
+
+    char name[16] = "";
+    ::pthread_getname_np(::pthread_self(), name, sizeof name);
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        std::shared_ptr<Ring> ring(new Ring(g_capacity, CurrentThread::tid(), name));
+        g_rings.push_back(ring);
+        t_ring = ring.get();
+    }
+    ::pthread_setspecific(g_ringKey, t_ring);
+    return t_ring;
+}
+
+// 按JSON字符串的规则转义：线程名由用户设置，可能包含引号、反斜杠和控制字符
+void appendJsonEscaped(std::string *out, const std::string &str)
+{
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            *out += '\\';
+            *out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof escaped, "\\u%04x", static_cast<unsigned char>(c));
+            *out += escaped;
+        }
+        else
+        {
+            *out += c;
+        }
+    }
+}
+
+// 复制ring中仍然有效的事件：复制期间被覆盖（或正在被覆盖）的槽位丢弃
+std::vector<Event> snapshot(const Ring &ring)
+{
+    const uint64_t capacity = ring.events.size();
+    uint64_t end = ring.next.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity ? end - capacity : 0;
+    std::vector<Event> events;
+    events.reserve(end - begin);
+    for (uint64_t seq = begin; seq < end; ++seq)
+    {
+        events.push_back(ring.events[seq & ring.mask]);
+    }
+    uint64_t after = ring.next.load(std::memory_order_acquire);
+    if (after >= capacity && after - capacity + 1 > begin)
+    {
+        size_t drop = static_cast<size_t>(std::min<uint64_t>(after - capacity + 1 - begin, events.size()));
+        events.erase(events.begin(), events.begin() + drop);
+    }
+    return events;
+}
+
+void appendArgs(std::string *out, int type, int32_t arg, int32_t extra)
+{
+    char args[64];
+    switch (type)
+    {
+        case FlightRecorder::kPoll:
+            snprintf(args, sizeof args, ",\"args\":{\"events\":%d}", arg);
+            break;
+        case FlightRecorder::kChannel:
+            snprintf(args, sizeof args, ",\"args\":{\"fd\":%d,\"revents\":%d}", arg, extra);
+            break;
+        case FlightRecorder::kAccept:
+        case FlightRecorder::kClose:
+            snprintf(args, sizeof args, ",\"args\":{\"fd\":%d}", arg);
+            break;
+        case FlightRecorder::kStall:
+            snprintf(args, sizeof args, ",\"args\":{\"ms\":%d,\"tid\":%d}", arg, extra);
+            break;
+        default:
+            return;
+    }
+    out->append(args);
+}
+}
+
+void FlightRecorder::enable(bool on)
+{
+    if (on)
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_calibrated)
+        {
+            g_baseTicks = now();
+            g_baseNanos = monotonicNanos();
+            g_calibrated = true;
+        }
+    }
+    enabled_.store(on, std::memory_order_relaxed);
+}
+
+void FlightRecorder::setCapacity(size_t eventsPerThread)
+{
+    size_t capacity = 1;
+    while (capacity < eventsPerThread)
+    {
+        capacity <<= 1;
+    }
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_capacity = capacity;
+}
+
+uint64_t FlightRecorder::now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(monotonicNanos());
+#endif
+}
+
+void FlightRecorder::recordSpan(EventType type, uint64_t start, int32_t arg, int32_t extra)
+{
+    Ring *ring = t_ring != nullptr ? t_ring : createThreadRing();
+    uint64_t seq = ring->next.load(std::memory_order_relaxed);
+    Event &event = ring->events[seq & ring->mask];
+    event.end = now();
+    event.start = start != 0 ? start : event.end;
+    event.arg = arg;
+    event.extra = extra;
+    event.type = type;
+    ring->next.store(seq + 1, std::memory_order_release);
+}
+
+const char* FlightRecorder::typeName(EventType type)
+{
+    switch (type)
+    {
+        case kPoll: return "poll";
+        case kChannel: return "channel";
+        case kFunctor: return "functor";
+        case kDeferred: return "deferred";
+        case kAfterDispatch: return "afterDispatch";
+        case kAccept: return "accept";
+        case kClose: return "close";
+        case kStall: return "stall";
+        default: return "unknown";
+    }
+}
+
+std::string FlightRecorder::dumpChromeTrace()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint64_t baseTicks;
+    int64_t baseNanos;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        rings.assign(g_retired.begin(), g_retired.end());
+        rings.insert(rings.end(), g_rings.begin(), g_rings.end());
+        baseTicks = g_baseTicks;
+        baseNanos = g_baseNanos;
+    }
+
+    // 用开启以来的墙上时间校准TSC频率，间隔太短时误差大，至少等10ms
+    double ticksPerUs = 1e-3;
+#if defined(__x86_64__) || defined(__i386__)
+    int64_t elapsedNanos = monotonicNanos() - baseNanos;
+    if (elapsedNanos < 10 * 1000 * 1000)
+    {
+        ::usleep(static_cast<useconds_t>((10 * 1000 * 1000 - elapsedNanos) / 1000));
+    }
+    int64_t calibrationNanos = monotonicNanos();
+    uint64_t calibrationTicks = now();
+    ticksPerUs = static_cast<double>(calibrationTicks - baseTicks) / (calibrationNanos - baseNanos) * 1e3;
+#endif
+
+    const int pid = static_cast<int>(::getpid());
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+    for (const std::shared_ptr<Ring> &ring : rings)
+    {
+        snprintf(line, sizeof line,
+                 "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"",
+                 first ? "" : ",", pid, ring->tid);
+        out += line;
+        appendJsonEscaped(&out, ring->name);
+        snprintf(line, sizeof line, " %d\"}}", ring->tid);
+        out += line;
+        first = false;
+
+        for (const Event &event : snapshot(*ring))
+        {
+            if (event.start < baseTicks)
+            {
+                continue;
+            }
+            double ts = static_cast<double>(event.start - baseTicks) / ticksPerUs;
+            const char *name = typeName(static_cast<EventType>(event.type));
+            if (event.end == event.start)
+            {
+                snprintf(line, sizeof line,
+                         ",\n{\"name\":\"%s\",\"cat\":\"loop\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                         name, ts, pid, ring->tid);
+            }
+            else
+            {
+                double dur = static_cast<double>(event.end - event.start) / ticksPerUs;
+                snprintf(line, sizeof line,
+                         ",\n{\"name\":\"%s\",\"cat\":\"loop\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                         name, ts, dur, pid, ring->tid);
+            }
+            out += line;
+            appendArgs(&out, event.type, event.arg, event.extra);
+            out += '}';
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool FlightRecorder::dumpChromeTrace(const std::string &path)
+{
+    std::string trace = dumpChromeTrace();
+    FILE *fp = ::fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        LOG_ERROR("FlightRecorder::dumpChromeTrace - cannot open %s errno:%d \n", path.c_str(), errno);
+        return false;
+    }
+    bool ok = ::fwrite(trace.data(), 1, trace.size(), fp) == trace.size();
+    ::fclose(fp);
+    return ok;
+}
@@ -0,0 +1,256 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+
+#include <string.h>
+#include <algorithm>
+
+const size_t HttpContext::kMaxHeaderBytes;
+const size_t HttpContext::kMaxBodyBytes;
+
+static HttpRequest::Method toMethod(const char *begin, const char *end)
+{
+    StringPiece m(begin, end - begin);
+    if (m == "GET") return HttpRequest::kGet;
+    if (m == "POST") return HttpRequest::kPost;
+    if (m == "HEAD") return HttpRequest::kHead;
+    if (m == "PUT") return HttpRequest::kPut;
+    if (m == "DELETE") return HttpRequest::kDelete;
+    if (m == "OPTIONS") return HttpRequest::kOptions;
+    if (m == "PATCH") return HttpRequest::kPatch;
+    return HttpRequest::kInvalid;
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    scanned_ = 0;
+    lineStart_ = 0;
+    headerEnd_ = 0;
+    bodyLength_ = 0;
+    errorStatus_ = 0;
+    method_ = HttpRequest::kInvalid;
+    version_ = HttpRequest::kUnknown;
+    path_ = Span{0, 0};
+    query_ = Span{0, 0};
+    headers_.clear();
+}
+
+HttpContext::ParseResult HttpContext::parseRequest(const Buffer *buf, Timestamp receiveTime)
+{
+    const char *base = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    // 逐行解析请求行和头部
+    while (state_ != kExpectBody)
+    {
+        // 找不到时scanned_会被推进，下次只检查新到达的数据（以及末尾可能的'\r'）
+        const char *crlf = buf->findCRLF(&scanned_);
+        if (crlf == nullptr)
+        {
+            if (readable - lineStart_ > kMaxHeaderBytes || lineStart_ > kMaxHeaderBytes)
+            {
+                errorStatus_ = 431;
+                return kError;
+            }
+            return kIncomplete;
+        }
+
+        const char *lineBegin = base + lineStart_;
+        if (state_ == kExpectRequestLine)
+        {
+            // 容忍请求之间多余的空行（RFC 7230 3.5）
+            if (crlf != lineBegin)
+            {
+                if (!parseRequestLine(base, lineBegin, crlf))
+                {
+                    errorStatus_ = 400;
+                    return kError;
+                }
+                state_ = kExpectHeaders;
+            }
+        }
+        else if (crlf == lineBegin)
+        {
+            // 空行：头部结束
+            headerEnd_ = static_cast<size_t>(crlf + 2 - base);
+            if (!finishHeaders(base))
+            {
+                return kError;
+            }
+            state_ = kExpectBody;
+        }
+        else
+        {
+            const char *colon = MemSearch::findByte(lineBegin, crlf, ':');
+            if (colon == nullptr || !parseHeaderLine(base, lineBegin, colon, crlf))
+            {
+                errorStatus_ = 400;
+                return kError;
+            }
+        }
+        lineStart_ = static_cast<size_t>(crlf + 2 - base);
+        scanned_ = lineStart_;
+        if (lineStart_ > kMaxHeaderBytes)
+        {
+            errorStatus_ = 431;
+            return kError;
+        }
+    }
+
+    if (readable < headerEnd_ + bodyLength_)
+    {
+        return kIncomplete;
+    }
+    buildRequest(base, receiveTime);
+    return kComplete;
+}
+
+// METHOD SP request-target SP HTTP-version
+bool HttpContext::parseRequestLine(const char *base, const char *begin, const char *end)
+{
+    const char *space = std::find(begin, end, ' ');
+    if (space == end)
+    {
+        return false;
+    }
+    method_ = toMethod(begin, space);
+    if (method_ == HttpRequest::kInvalid)
+    {
+        return false;
+    }
+
+    const char *start = space + 1;
+    space = std::find(start, end, ' ');
+    if (space == end || space == start)
+    {
+        return false;
+    }
+    const char *question = std::find(start, space, '?');
+    path_ = Span{static_cast<size_t>(start - base), static_cast<size_t>(question - start)};
+    if (question != space)
+    {
+        query_ = Span{static_cast<size_t>(question + 1 - base), static_cast<size_t>(space - question - 1)};
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        version_ = HttpRequest::kHttp10;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// field-name ":" OWS field-value OWS
+bool HttpContext::parseHeaderLine(const char *base, const char *begin, const char *colon, const char *end)
+{
+    if (colon == begin)
+    {
+        return false;
+    }
+    const char *valueBegin = colon + 1;
+    while (valueBegin < end && (*valueBegin == ' ' || *valueBegin == '\t'))
+    {
+        ++valueBegin;
+    }
+    const char *valueEnd = end;
+    while (valueEnd > valueBegin && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+    {
+        --valueEnd;
+    }
+    headers_.emplace_back(Span{static_cast<size_t>(begin - base), static_cast<size_t>(colon - begin)},
+                          Span{static_cast<size_t>(valueBegin - base), static_cast<size_t>(valueEnd - valueBegin)});
+    return true;
+}
+
+// 根据Content-Length确定body长度，不支持分块传输的请求体。
+// 多个不一致的Content-Length、或者同时带Transfer-Encoding时，前面的代理可能按另一种长度切分请求
+// （请求走私，RFC 7230 3.3.3），一律拒绝
+bool HttpContext::finishHeaders(const char *base)
+{
+    bool hasLength = false;
+    bool chunked = false;
+    for (const std::pair<Span, Span> &header : headers_)
+    {
+        StringPiece field(base + header.first.offset, header.first.length);
+        StringPiece value(base + header.second.offset, header.second.length);
+        if (field.equalsIgnoreCase("Transfer-Encoding"))
+        {
+            chunked = true;
+        }
+        else if (field.equalsIgnoreCase("Content-Length"))
+        {
+            if (value.empty())
+            {
+                errorStatus_ = 400;
+                return false;
+            }
+            size_t length = 0;
+            for (size_t i = 0; i < value.size(); ++i)
+            {
+                if (value[i] < '0' || value[i] > '9')
+                {
+                    errorStatus_ = 400;
+                    return false;
+                }
+                length = length * 10 + (value[i] - '0');
+                if (length > kMaxBodyBytes)
+                {
+                    errorStatus_ = 413;
+                    return false;
+                }
+            }
+            if (hasLength && length != bodyLength_)
+            {
+                errorStatus_ = 400;
+                return false;
+            }
+            hasLength = true;
+            bodyLength_ = length;
+        }
+    }
+    if (chunked)
+    {
+        errorStatus_ = hasLength ? 400 : 501;
+        return false;
+    }
+    return true;
+}
+
+void HttpContext::buildRequest(const char *base, Timestamp receiveTime)
+{
+    request_.method_ = method_;
+    request_.version_ = version_;
+    request_.path_ = StringPiece(base + path_.offset, path_.length);
+    request_.query_ = StringPiece(base + query_.offset, query_.length);
+    request_.body_ = StringPiece(base + headerEnd_, bodyLength_);
+    request_.receiveTime_ = receiveTime;
+    request_.headers_.clear();
+    for (const std::pair<Span, Span> &header : headers_)
+    {
+        request_.headers_.emplace_back(StringPiece(base + header.first.offset, header.first.length),
+                                       StringPiece(base + header.second.offset, header.second.length));
+    }
+}
+
+const char* HttpRequest::methodString() const
+{
+    switch (method_)
+    {
+        case kGet: return "GET";
+        case kPost: return "POST";
+        case kHead: return "HEAD";
+        case kPut: return "PUT";
+        case kDelete: return "DELETE";
+        case kOptions: return "OPTIONS";
+        case kPatch: return "PATCH";
+        default: return "UNKNOWN";
+    }
+}
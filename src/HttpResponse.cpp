@@ -0,0 +1,90 @@
+#include "HttpResponse.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+HttpResponse::~HttpResponse()
+{
+    if (fileFd_ >= 0)
+    {
+        ::close(fileFd_);
+    }
+}
+
+bool HttpResponse::setFileBody(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    if (fileFd_ >= 0)
+    {
+        ::close(fileFd_);
+    }
+    fileFd_ = fd;
+    fileSize_ = static_cast<size_t>(st.st_size);
+    body_.clear();
+    return true;
+}
+
+int HttpResponse::releaseFile(size_t *size)
+{
+    int fd = fileFd_;
+    *size = fileSize_;
+    fileFd_ = -1;
+    fileSize_ = 0;
+    return fd;
+}
+
+void HttpResponse::appendToBuffer(Buffer *output) const
+{
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", static_cast<int>(statusCode_));
+    output->append(buf, n);
+    output->append(statusMessage_.data(), statusMessage_.size());
+    output->append("\r\n", 2);
+
+    // 1xx、204、304响应不能带body，也不发送Content-Length（RFC 7230 3.3.2）
+    const bool noBody = !allowsBody();
+    if (!noBody)
+    {
+        size_t contentLength = fileFd_ >= 0 ? fileSize_ : body_.size();
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", contentLength);
+        output->append(buf, n);
+    }
+
+    if (closeConnection_)
+    {
+        static const char kClose[] = "Connection: close\r\n";
+        output->append(kClose, sizeof kClose - 1);
+    }
+    else
+    {
+        static const char kKeepAlive[] = "Connection: Keep-Alive\r\n";
+        output->append(kKeepAlive, sizeof kKeepAlive - 1);
+    }
+
+    for (const std::pair<std::string, std::string> &header : headers_)
+    {
+        output->append(header.first.data(), header.first.size());
+        output->append(": ", 2);
+        output->append(header.second.data(), header.second.size());
+        output->append("\r\n", 2);
+    }
+
+    output->append("\r\n", 2);
+    if (!headOnly_ && !noBody)
+    {
+        output->append(body_.data(), body_.size());
+    }
+}
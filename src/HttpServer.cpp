@@ -0,0 +1,197 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Logger.h"
+
+#include <string.h>
+#include <unistd.h>
+
+// 默认的HttpCallback：404
+static void defaultHttpCallback(const HttpRequest&, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+    resp->setCloseConnection(true);
+}
+
+static const char* errorMessage(int status)
+{
+    switch (status)
+    {
+        case HttpResponse::k413PayloadTooLarge: return "Payload Too Large";
+        case HttpResponse::k431HeaderFieldsTooLarge: return "Request Header Fields Too Large";
+        case HttpResponse::k501NotImplemented: return "Not Implemented";
+        default: return "Bad Request";
+    }
+}
+
+// 根据扩展名猜测Content-Type
+static const char* guessContentType(const std::string &path)
+{
+    static const struct { const char *ext; const char *type; } kTypes[] = {
+        { ".html", "text/html" },
+        { ".htm", "text/html" },
+        { ".css", "text/css" },
+        { ".js", "application/javascript" },
+        { ".json", "application/json" },
+        { ".txt", "text/plain" },
+        { ".png", "image/png" },
+        { ".jpg", "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" },
+        { ".svg", "image/svg+xml" },
+    };
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos)
+    {
+        for (size_t i = 0; i < sizeof kTypes / sizeof kTypes[0]; ++i)
+        {
+            if (::strcasecmp(path.c_str() + dot, kTypes[i].ext) == 0)
+            {
+                return kTypes[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+                       const InetAddress &listenAddr,
+                       const std::string &name,
+                       TcpServer::Option option)
+    : loop_(loop)
+    , server_(loop, listenAddr, name, option)
+    , httpCallback_(defaultHttpCallback)
+{
+    server_.setConnectionCallback(
+        std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&HttpServer::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    LOG_INFO("HttpServer starts listening on %s \n", server_.ipPort().c_str());
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<HttpContext>());
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    if (!conn->connected())
+    {
+        // 已经决定关闭连接，丢弃之后收到的请求
+        buf->retrieveAll();
+        return;
+    }
+
+    HttpContext *context = static_cast<HttpContext*>(conn->getContext().get());
+    bool close = false;
+    // 流水线：依次处理buf中所有完整的请求
+    while (!close && buf->readableBytes() > 0)
+    {
+        HttpContext::ParseResult result = context->parseRequest(buf, receiveTime);
+        if (result == HttpContext::kIncomplete)
+        {
+            break;
+        }
+        if (result == HttpContext::kError)
+        {
+            HttpResponse resp(true);
+            resp.setStatusCode(static_cast<HttpResponse::HttpStatusCode>(context->errorStatus()));
+            resp.setStatusMessage(errorMessage(context->errorStatus()));
+            resp.appendToBuffer(conn->outputBuffer());
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+        // 只为完整的请求计数；预算用完时请求留在buf中，context仍停在kExpectBody，下一轮重新解析会直接得到kComplete
+        if (!conn->consumeMessageBudget())
+        {
+            break; // 本轮的读预算用完，剩下的请求下一轮再处理
+        }
+
+        close = onRequest(conn, context->request());
+        buf->retrieve(context->requestLength());
+        context->reset();
+    }
+
+    // 本批请求的响应一次性发送
+    conn->sendOutputBuffer();
+    if (close)
+    {
+        conn->shutdown();
+    }
+}
+
+bool HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req)
+{
+    HttpResponse resp(!req.keepAlive());
+    const bool head = req.method() == HttpRequest::kHead;
+    resp.setHeadOnly(head);
+
+    bool handled = false;
+    if (!documentRoot_.empty() && (req.method() == HttpRequest::kGet || head))
+    {
+        handled = serveStaticFile(req, &resp);
+    }
+    if (!handled)
+    {
+        httpCallback_(req, &resp);
+    }
+
+    resp.appendToBuffer(conn->outputBuffer());
+    if (resp.hasFileBody())
+    {
+        size_t size = 0;
+        int fd = resp.releaseFile(&size);
+        if (head || !resp.allowsBody())
+        {
+            ::close(fd);
+        }
+        else
+        {
+            // 先把响应头写出去，文件内容紧随其后由sendfile发送
+            conn->sendOutputBuffer();
+            conn->sendFile(fd, 0, size, true);
+        }
+    }
+    return resp.closeConnection();
+}
+
+bool HttpServer::serveStaticFile(const HttpRequest &req, HttpResponse *resp)
+{
+    const StringPiece &path = req.path();
+    if (path.empty() || path[0] != '/')
+    {
+        return false;
+    }
+    std::string relative = path.asString();
+    // 拒绝访问根目录之外的文件
+    if (relative.find("/..") != std::string::npos)
+    {
+        return false;
+    }
+    if (relative[relative.size() - 1] == '/')
+    {
+        relative += "index.html";
+    }
+    std::string fullPath = documentRoot_ + relative;
+    if (!resp->setFileBody(fullPath))
+    {
+        return false;
+    }
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType(guessContentType(fullPath));
+    return true;
+}
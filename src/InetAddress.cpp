@@ -1,33 +1,116 @@
 #include "InetAddress.h"
+#include "Logger.h"
 
 #include <arpa/inet.h> 
 #include <cstring>
+#include <stddef.h>
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    memset(&sockaddr_, 0, sizeof(sockaddr_));
-    sockaddr_.sin_family = AF_INET;
-    sockaddr_.sin_port = htons(port);
-    sockaddr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    memset(&addr_, 0, sizeof(addr_));
+    addr_.in.sin_family = AF_INET;
+    addr_.in.sin_port = htons(port);
+    addr_.in.sin_addr.s_addr = inet_addr(ip.c_str());
+    len_ = sizeof(sockaddr_in);
+}
+
+InetAddress::InetAddress(const sockaddr_in &addr)
+{
+    setSockAddr(addr);
+}
+
+InetAddress::InetAddress(const sockaddr_un &addr, socklen_t len)
+{
+    memset(&addr_, 0, sizeof(addr_));
+    len_ = len < sizeof(sockaddr_un) ? len : sizeof(sockaddr_un);
+    memcpy(&addr_.un, &addr, len_);
+    addr_.un.sun_family = AF_UNIX;
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // 文件系统路径需要留出结尾的'\0'，抽象命名空间则可以用满sun_path；超长的路径截断后会指向另一个地址，直接拒绝
+    const bool abstract = !path.empty() && path[0] == '@';
+    const size_t maxLen = abstract ? sizeof(addr.sun_path) : sizeof(addr.sun_path) - 1;
+    if (path.size() > maxLen)
+    {
+        LOG_FATAL("InetAddress::fromUnixPath - path too long (%lu > %lu): %s \n",
+                  path.size(), maxLen, path.c_str());
+    }
+    const size_t n = path.size();
+    memcpy(addr.sun_path, path.data(), n);
+    socklen_t len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n);
+    if (abstract)
+    {
+        addr.sun_path[0] = '\0'; // 抽象命名空间：长度中不包含结尾的'\0'
+    }
+    else
+    {
+        len += 1;
+    }
+    return InetAddress(addr, len);
+}
+
+InetAddress InetAddress::fromSockAddr(const sockaddr *addr, socklen_t len)
+{
+    if (addr->sa_family == AF_UNIX)
+    {
+        return InetAddress(*reinterpret_cast<const sockaddr_un*>(addr), len);
+    }
+    return InetAddress(*reinterpret_cast<const sockaddr_in*>(addr));
+}
+
+void InetAddress::setSockAddr(const sockaddr_in &addr)
+{
+    memset(&addr_, 0, sizeof(addr_));
+    addr_.in = addr;
+    len_ = sizeof(sockaddr_in);
 }
 
 std::string InetAddress::toIp() const
 { 
+    if (isUnix())
+    {
+        return "unix";
+    }
     char buf[64] = {0};
     // 网络字节序转本地字节序：大端->小端
-    ::inet_ntop(AF_INET, &sockaddr_.sin_addr, buf, sizeof(buf));
+    ::inet_ntop(AF_INET, &addr_.in.sin_addr, buf, sizeof(buf));
     return buf;  // 字符数组char[]隐式的转换为string
 }
 
 std::string InetAddress::toIpPort() const
 {
+    if (isUnix())
+    {
+        return "unix:" + toUnixPath();
+    }
     // ip : port  
     return (this->toIp() + " : " + std::to_string(this->toPort()));
 }
 
 uint16_t InetAddress::toPort() const
 {
-    return ntohs(sockaddr_.sin_port);
+    return isUnix() ? 0 : ntohs(addr_.in.sin_port);
+}
+
+std::string InetAddress::toUnixPath() const
+{
+    const size_t offset = offsetof(sockaddr_un, sun_path);
+    if (!isUnix() || len_ <= offset)
+    {
+        return std::string();
+    }
+    const char *path = addr_.un.sun_path;
+    size_t n = len_ - offset;
+    if (path[0] == '\0')
+    {
+        return "@" + std::string(path + 1, n - 1);
+    }
+    return std::string(path, strnlen(path, n));
 }
 
 /*
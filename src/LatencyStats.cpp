@@ -0,0 +1,77 @@
+#include "LatencyStats.h"
+
+#include <stdio.h>
+#include <time.h>
+
+int64_t latencyClockNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+LatencyStats::Shard* LatencyStats::shardFor(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Shard> &shard = shards_[loop];
+    if (!shard)
+    {
+        shard.reset(new Shard);
+    }
+    return shard.get();
+}
+
+HdrHistogram LatencyStats::histogram(Stage stage) const
+{
+    HdrHistogram total;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : shards_)
+    {
+        std::lock_guard<std::mutex> shardLock(entry.second->mutex_);
+        total.merge(entry.second->histograms_[stage]);
+    }
+    return total;
+}
+
+void LatencyStats::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : shards_)
+    {
+        std::lock_guard<std::mutex> shardLock(entry.second->mutex_);
+        for (int i = 0; i < kNumStages; ++i)
+        {
+            entry.second->histograms_[i].reset();
+        }
+    }
+}
+
+const char* LatencyStats::stageName(Stage stage)
+{
+    switch (stage)
+    {
+        case kKernelQueue: return "kernel-queue";
+        case kDispatch: return "dispatch";
+        case kHandler: return "handler";
+        case kWrite: return "write";
+        case kTotal: return "total";
+        default: return "unknown";
+    }
+}
+
+std::string LatencyStats::toString() const
+{
+    std::string result;
+    for (int i = 0; i < kNumStages; ++i)
+    {
+        Stage stage = static_cast<Stage>(i);
+        HdrHistogram h = histogram(stage);
+        char line[256];
+        snprintf(line, sizeof line, "%-12s count=%lld p50=%.1f p99=%.1f p999=%.1f max=%.1f (us)\n",
+                 stageName(stage), static_cast<long long>(h.count()),
+                 h.percentile(50) / 1e3, h.percentile(99) / 1e3,
+                 h.percentile(99.9) / 1e3, h.max() / 1e3);
+        result += line;
+    }
+    return result;
+}
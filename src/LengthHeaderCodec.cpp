@@ -0,0 +1,81 @@
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Crc32c.h"
+#include "Logger.h"
+
+#include <string.h>
+#include <endian.h>
+
+const int32_t LengthHeaderCodec::kHeaderLen;
+const int32_t LengthHeaderCodec::kChecksumLen;
+
+LengthHeaderCodec::LengthHeaderCodec(FrameCallback cb, bool checksum, size_t maxFrameLength)
+    : frameCallback_(std::move(cb))
+    , checksum_(checksum)
+    , maxFrameLength_(maxFrameLength)
+{
+}
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    const size_t trailer = checksum_ ? kChecksumLen : 0;
+    // 一次解出所有完整的帧
+    while (buf->readableBytes() >= static_cast<size_t>(kHeaderLen))
+    {
+        const int32_t len = buf->peekInt32();
+        if (len < static_cast<int32_t>(trailer) || static_cast<size_t>(len) > maxFrameLength_)
+        {
+            LOG_ERROR("LengthHeaderCodec - invalid length %d from %s \n", len, conn->name().c_str());
+            conn->forceClose();
+            break;
+        }
+        if (buf->readableBytes() < kHeaderLen + static_cast<size_t>(len))
+        {
+            break; // 帧还不完整，等待更多数据
+        }
+        if (!conn->consumeMessageBudget())
+        {
+            break; // 本轮的读预算用完，剩下的帧下一轮再处理
+        }
+
+        const char *body = buf->peek() + kHeaderLen;
+        const size_t bodyLen = static_cast<size_t>(len) - trailer;
+        if (checksum_)
+        {
+            uint32_t expected;
+            ::memcpy(&expected, body + bodyLen, sizeof expected);
+            if (Crc32c::value(body, bodyLen) != be32toh(expected))
+            {
+                LOG_ERROR("LengthHeaderCodec - checksum mismatch from %s \n", conn->name().c_str());
+                conn->forceClose();
+                break;
+            }
+        }
+        frameCallback_(conn, body, bodyLen, receiveTime);
+        buf->retrieve(kHeaderLen + static_cast<size_t>(len));
+    }
+}
+
+void LengthHeaderCodec::encode(Buffer *buf) const
+{
+    if (checksum_)
+    {
+        uint32_t crc = Crc32c::value(buf->peek(), buf->readableBytes());
+        buf->appendInt32(static_cast<int32_t>(crc));
+    }
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf) const
+{
+    encode(buf);
+    conn->send(buf);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const char *data, size_t len) const
+{
+    Buffer buf;
+    buf.append(data, len);
+    send(conn, &buf);
+}
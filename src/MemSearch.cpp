@@ -0,0 +1,225 @@
+#include "MemSearch.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+const char* findByteScalar(const char *begin, const char *end, char c)
+{
+    return static_cast<const char*>(::memchr(begin, c, end - begin));
+}
+
+const char* findCRLFScalar(const char *begin, const char *end)
+{
+    while (begin < end)
+    {
+        const char *cr = static_cast<const char*>(::memchr(begin, '\r', end - begin));
+        if (cr == nullptr || cr + 1 >= end)
+        {
+            return nullptr;
+        }
+        if (cr[1] == '\n')
+        {
+            return cr;
+        }
+        begin = cr + 1;
+    }
+    return nullptr;
+}
+
+// 调用者保证n >= 2
+const char* findScalar(const char *begin, const char *end, const char *needle, size_t n)
+{
+    return static_cast<const char*>(::memmem(begin, end - begin, needle, n));
+}
+
+#if defined(__x86_64__)
+// SSE2是x86_64的基线指令集，不需要运行时检测
+const char* findByteSse2(const char *begin, const char *end, char c)
+{
+    const __m128i target = _mm_set1_epi8(c);
+    const char *p = begin;
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, target));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findByteScalar(p, end, c);
+}
+
+// 同时比较p处的'\r'和p+1处的'\n'，两个掩码按位与即为"\r\n"的起始位置
+const char* findCRLFSse2(const char *begin, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    for (; end - p >= 17; p += 16)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(first, cr))
+                      & _mm_movemask_epi8(_mm_cmpeq_epi8(second, lf));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findCRLFScalar(p, end);
+}
+
+// 用needle的首尾字节过滤候选位置，再对候选位置做memcmp
+const char* findSse2(const char *begin, const char *end, const char *needle, size_t n)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    const char *p = begin;
+    for (; end - p >= static_cast<ptrdiff_t>(n + 15); p += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(blockFirst, first))
+                      & _mm_movemask_epi8(_mm_cmpeq_epi8(blockLast, last));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (::memcmp(p + bit + 1, needle + 1, n - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(p, end, needle, n);
+}
+
+__attribute__((target("avx2")))
+const char* findByteAvx2(const char *begin, const char *end, char c)
+{
+    const __m256i target = _mm256_set1_epi8(c);
+    const char *p = begin;
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, target));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findByteSse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* findCRLFAvx2(const char *begin, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for (; end - p >= 33; p += 32)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(first, cr))
+                      & _mm256_movemask_epi8(_mm256_cmpeq_epi8(second, lf));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findAvx2(const char *begin, const char *end, const char *needle, size_t n)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    const char *p = begin;
+    for (; end - p >= static_cast<ptrdiff_t>(n + 31); p += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + n - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(blockFirst, first))
+                      & _mm256_movemask_epi8(_mm256_cmpeq_epi8(blockLast, last));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (::memcmp(p + bit + 1, needle + 1, n - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSse2(p, end, needle, n);
+}
+#endif
+
+struct Kernels
+{
+    const char* (*findByte)(const char*, const char*, char);
+    const char* (*findCRLF)(const char*, const char*);
+    const char* (*find)(const char*, const char*, const char*, size_t);
+    const char *name;
+};
+
+Kernels chooseKernels()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Kernels{ findByteAvx2, findCRLFAvx2, findAvx2, "avx2" };
+    }
+    return Kernels{ findByteSse2, findCRLFSse2, findSse2, "sse2" };
+#else
+    return Kernels{ findByteScalar, findCRLFScalar, findScalar, "scalar" };
+#endif
+}
+
+const Kernels kKernels = chooseKernels();
+
+} // namespace
+
+namespace MemSearch
+{
+    const char* findByte(const char *begin, const char *end, char c)
+    {
+        return kKernels.findByte(begin, end, c);
+    }
+
+    const char* findCRLF(const char *begin, const char *end)
+    {
+        return kKernels.findCRLF(begin, end);
+    }
+
+    const char* find(const char *begin, const char *end, const char *needle, size_t n)
+    {
+        if (n == 0)
+        {
+            return begin;
+        }
+        if (n == 1)
+        {
+            return kKernels.findByte(begin, end, needle[0]);
+        }
+        if (static_cast<size_t>(end - begin) < n)
+        {
+            return nullptr;
+        }
+        return kKernels.find(begin, end, needle, n);
+    }
+
+    const char* kernelName()
+    {
+        return kKernels.name;
+    }
+}
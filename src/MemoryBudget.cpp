@@ -0,0 +1,236 @@
+#include "MemoryBudget.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TcpConnection.h"
+
+#include <functional>
+#include <vector>
+#include <stdio.h>
+
+MemoryBudget::Shard::Shard(EventLoop *loop)
+    : loop_(loop)
+    , bytes_(0)
+    , queued_(0)
+    , paused_(0)
+    , resumeScheduled_(false)
+    , recheckScheduled_(false)
+    , lastCloseIteration_(0)
+{
+}
+
+MemoryBudget::MemoryBudget(size_t limitBytes, size_t closeLimitBytes)
+    : limit_(limitBytes)
+    , closeLimit_(closeLimitBytes)
+    , resumeBytes_(static_cast<int64_t>(limitBytes / 10 * 9))
+    , pauseTimeout_(30.0)
+    , bytes_(0)
+    , queued_(0)
+    , connections_(0)
+    , pausedNow_(0)
+    , pausedCount_(0)
+    , refusedCount_(0)
+    , closedCount_(0)
+{
+}
+
+MemoryBudget::Shard* MemoryBudget::shardFor(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<Shard> &shard = shards_[loop];
+    if (!shard)
+    {
+        shard.reset(new Shard(loop));
+    }
+    return shard.get();
+}
+
+void MemoryBudget::add(Shard *shard, TcpConnection *conn)
+{
+    shard->connections_.insert(conn);
+    connections_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryBudget::remove(Shard *shard, TcpConnection *conn, int64_t bytes, int64_t queued, bool paused)
+{
+    if (shard->connections_.erase(conn) == 0)
+    {
+        return;
+    }
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+    if (paused)
+    {
+        resumed(shard, conn);
+    }
+    update(shard, -bytes, -queued);
+}
+
+void MemoryBudget::update(Shard *shard, int64_t deltaBytes, int64_t deltaQueued)
+{
+    if (deltaQueued != 0)
+    {
+        shard->queued_.fetch_add(deltaQueued, std::memory_order_relaxed);
+        queued_.fetch_add(deltaQueued, std::memory_order_relaxed);
+    }
+    if (deltaBytes == 0)
+    {
+        return;
+    }
+    shard->bytes_.fetch_add(deltaBytes, std::memory_order_relaxed);
+    int64_t total = bytes_.fetch_add(deltaBytes, std::memory_order_relaxed) + deltaBytes;
+    if (deltaBytes < 0 && total <= resumeBytes_ && pausedNow_.load(std::memory_order_relaxed) > 0)
+    {
+        // 回落到恢复线以下：让各loop恢复自己暂停的连接，每个loop同一时刻只排一个任务
+        std::shared_ptr<MemoryBudget> self = shared_from_this();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &entry : shards_)
+        {
+            Shard *s = entry.second.get();
+            if (s->paused_.load(std::memory_order_relaxed) > 0 && !s->resumeScheduled_.exchange(true))
+            {
+                s->loop_->queueInLoop(std::bind(&MemoryBudget::resumePaused, self, s));
+            }
+        }
+    }
+}
+
+bool MemoryBudget::maybePause(Shard *shard, TcpConnection *conn, int64_t bytes)
+{
+    int64_t count = connections();
+    if (count <= 0 || bytes * count <= totalBytes())
+    {
+        return false;
+    }
+    shard->paused_.fetch_add(1, std::memory_order_relaxed);
+    pausedNow_.fetch_add(1, std::memory_order_relaxed);
+    pausedCount_.fetch_add(1, std::memory_order_relaxed);
+    shard->pausedSince_[conn] = Timestamp::now();
+    scheduleRecheck(shard);
+    LOG_INFO("MemoryBudget - total %lld bytes over limit %lu, pause reading [%s] holding %lld bytes \n",
+             static_cast<long long>(totalBytes()), limit_, conn->name().c_str(), static_cast<long long>(bytes));
+    return true;
+}
+
+void MemoryBudget::resumed(Shard *shard, TcpConnection *conn)
+{
+    shard->pausedSince_.erase(conn);
+    shard->paused_.fetch_sub(1, std::memory_order_relaxed);
+    pausedNow_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryBudget::resumePaused(Shard *shard)
+{
+    shard->resumeScheduled_.store(false);
+    if (underPressure())
+    {
+        return; // 排队期间又涨回去了，等下一次回落
+    }
+    // resumeMemoryPaused可能调用回调，回调中可能关闭连接（从connections_中删除），先复制一份
+    std::vector<TcpConnectionPtr> paused;
+    for (TcpConnection *conn : shard->connections_)
+    {
+        if (conn->memoryPaused_)
+        {
+            paused.push_back(conn->shared_from_this());
+        }
+    }
+    for (const TcpConnectionPtr &conn : paused)
+    {
+        conn->resumeMemoryPaused();
+    }
+}
+
+void MemoryBudget::scheduleRecheck(Shard *shard)
+{
+    if (!shard->recheckScheduled_)
+    {
+        shard->recheckScheduled_ = true;
+        shard->loop_->runAfter(kRecheckSeconds, std::bind(&MemoryBudget::recheckPaused, shared_from_this(), shard));
+    }
+}
+
+void MemoryBudget::recheckPaused(Shard *shard)
+{
+    shard->recheckScheduled_ = false;
+    if (shard->pausedSince_.empty())
+    {
+        return;
+    }
+    if (!underPressure())
+    {
+        // 总量是被暂停的连接以外的方式降下来的（如inputBuffer_被取走），update不会通知到
+        resumePaused(shard);
+        return;
+    }
+    if (pauseTimeout_ > 0)
+    {
+        Timestamp deadline = addTime(Timestamp::now(), -pauseTimeout_);
+        std::vector<TcpConnectionPtr> expired;
+        for (const auto &entry : shard->pausedSince_)
+        {
+            if (entry.second < deadline && entry.first->connected())
+            {
+                expired.push_back(entry.first->shared_from_this());
+            }
+        }
+        for (const TcpConnectionPtr &conn : expired)
+        {
+            closedCount_.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("MemoryBudget - [%s] paused for more than %.1fs with total %lld bytes over limit, closing \n",
+                      conn->name().c_str(), pauseTimeout_, static_cast<long long>(totalBytes()));
+            conn->forceClose();
+        }
+    }
+    // 关闭的连接在connectDestroyed时才从pausedSince_中删除
+    if (!shard->pausedSince_.empty())
+    {
+        scheduleRecheck(shard);
+    }
+}
+
+void MemoryBudget::closeHeaviest(Shard *shard)
+{
+    uint64_t iteration = shard->loop_->iteration();
+    if (shard->lastCloseIteration_ == iteration)
+    {
+        return;
+    }
+    TcpConnection *heaviest = nullptr;
+    for (TcpConnection *conn : shard->connections_)
+    {
+        if (conn->connected() && (heaviest == nullptr || conn->accountedBytes_ > heaviest->accountedBytes_))
+        {
+            heaviest = conn;
+        }
+    }
+    if (heaviest == nullptr)
+    {
+        return;
+    }
+    shard->lastCloseIteration_ = iteration;
+    closedCount_.fetch_add(1, std::memory_order_relaxed);
+    LOG_ERROR("MemoryBudget - total %lld bytes over close limit %lu, closing [%s] holding %lld bytes \n",
+              static_cast<long long>(totalBytes()), closeLimit_, heaviest->name().c_str(),
+              static_cast<long long>(heaviest->accountedBytes_));
+    heaviest->forceClose();
+}
+
+std::string MemoryBudget::toString() const
+{
+    char line[256];
+    snprintf(line, sizeof line,
+             "memory %lld/%lu bytes, queued %lld, connections %lld, paused %lld (total %lld), refused %lld, closed %lld",
+             static_cast<long long>(totalBytes()), limit_, static_cast<long long>(queuedBytes()),
+             static_cast<long long>(connections()), static_cast<long long>(pausedConnections()),
+             static_cast<long long>(pausedCount()), static_cast<long long>(refusedCount()),
+             static_cast<long long>(closedCount()));
+    std::string result = line;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : shards_)
+    {
+        snprintf(line, sizeof line, "\n  loop %p: %lld bytes, queued %lld",
+                 entry.first, static_cast<long long>(entry.second->bytes()),
+                 static_cast<long long>(entry.second->queuedBytes()));
+        result += line;
+    }
+    return result;
+}
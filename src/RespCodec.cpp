@@ -0,0 +1,409 @@
+#include "RespCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "MemSearch.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <math.h>
+
+const size_t RespCodec::kMaxInlineLength;
+
+namespace
+{
+
+// 头部行（类型字节 + 整数）的最大长度，超过仍找不到CRLF即为协议错误
+const ptrdiff_t kMaxHeaderLine = 32;
+// 聚合类型的最大嵌套深度
+const int kMaxDepth = 32;
+
+// 解析[begin, end)中的十进制整数，只允许可选的负号和数字
+bool parseInt(const char *begin, const char *end, int64_t *value)
+{
+    bool negative = false;
+    if (begin < end && *begin == '-')
+    {
+        negative = true;
+        ++begin;
+    }
+    if (begin == end || end - begin > 18)
+    {
+        return false;
+    }
+    int64_t v = 0;
+    for (; begin < end; ++begin)
+    {
+        if (*begin < '0' || *begin > '9')
+        {
+            return false;
+        }
+        v = v * 10 + (*begin - '0');
+    }
+    *value = negative ? -v : v;
+    return true;
+}
+
+// 在[begin, end)中查找头部行的结尾：返回CRLF的位置；不完整时返回nullptr并把*error置为false，行过长时置为true
+const char* findHeaderEnd(const char *begin, const char *end, bool *error)
+{
+    const char *limit = end - begin > kMaxHeaderLine ? begin + kMaxHeaderLine : end;
+    const char *crlf = MemSearch::findCRLF(begin, limit);
+    *error = crlf == nullptr && limit != end;
+    return crlf;
+}
+
+// 写入"<type><integer>\r\n"
+void appendTypedInteger(Buffer *buf, char type, int64_t value)
+{
+    char tmp[32];
+    int n = snprintf(tmp, sizeof tmp, "%c%lld\r\n", type, static_cast<long long>(value));
+    buf->append(tmp, n);
+}
+
+ssize_t valueLengthAt(const char *begin, const char *end, int depth)
+{
+    if (begin >= end)
+    {
+        return 0;
+    }
+    if (depth > kMaxDepth)
+    {
+        return -1;
+    }
+    const char type = *begin;
+    bool error = false;
+    const char *crlf = nullptr;
+    if (type == '+' || type == '-')
+    {
+        // 简单字符串和错误不限长度
+        crlf = MemSearch::findCRLF(begin + 1, end);
+    }
+    else
+    {
+        crlf = findHeaderEnd(begin + 1, end, &error);
+    }
+    if (crlf == nullptr)
+    {
+        return error ? -1 : 0;
+    }
+    const ssize_t headerLen = crlf + 2 - begin;
+
+    int64_t n = 0;
+    size_t elements = 0;
+    switch (type)
+    {
+        case '+': case '-': case ':': case '_': case '#': case ',': case '(':
+            return headerLen;
+        case '$': case '!': case '=':
+            if (!parseInt(begin + 1, crlf, &n) || n < -1 || (n == -1 && type != '$'))
+            {
+                return -1;
+            }
+            if (n == -1)
+            {
+                return headerLen; // RESP2的null批量字符串
+            }
+            if (end - begin < headerLen + n + 2)
+            {
+                return 0;
+            }
+            if (begin[headerLen + n] != '\r' || begin[headerLen + n + 1] != '\n')
+            {
+                return -1;
+            }
+            return headerLen + n + 2;
+        case '*': case '~': case '>':
+            if (!parseInt(begin + 1, crlf, &n) || n < -1 || (n == -1 && type != '*'))
+            {
+                return -1;
+            }
+            elements = n < 0 ? 0 : static_cast<size_t>(n);
+            break;
+        case '%': case '|':
+            if (!parseInt(begin + 1, crlf, &n) || n < 0)
+            {
+                return -1;
+            }
+            elements = static_cast<size_t>(n) * 2;
+            break;
+        default:
+            return -1;
+    }
+
+    const char *p = begin + headerLen;
+    for (size_t i = 0; i < elements; ++i)
+    {
+        ssize_t len = valueLengthAt(p, end, depth + 1);
+        if (len <= 0)
+        {
+            return len;
+        }
+        p += len;
+    }
+    if (type == '|')
+    {
+        // 属性之后紧跟着它所修饰的值
+        ssize_t len = valueLengthAt(p, end, depth + 1);
+        if (len <= 0)
+        {
+            return len;
+        }
+        p += len;
+    }
+    return p - begin;
+}
+
+// inline命令：一行以空白分隔的参数
+ssize_t parseInline(const char *begin, const char *end, RespCodec::Command *args)
+{
+    const size_t searchLen = std::min(static_cast<size_t>(end - begin), RespCodec::kMaxInlineLength);
+    const char *eol = MemSearch::findEOL(begin, begin + searchLen);
+    if (eol == nullptr)
+    {
+        return searchLen == RespCodec::kMaxInlineLength ? -1 : 0;
+    }
+    const char *lineEnd = (eol > begin && eol[-1] == '\r') ? eol - 1 : eol;
+    const char *p = begin;
+    while (p < lineEnd)
+    {
+        while (p < lineEnd && (*p == ' ' || *p == '\t'))
+        {
+            ++p;
+        }
+        const char *start = p;
+        while (p < lineEnd && *p != ' ' && *p != '\t')
+        {
+            ++p;
+        }
+        if (p > start)
+        {
+            args->push_back(StringPiece(start, p - start));
+        }
+    }
+    return eol + 1 - begin;
+}
+
+} // namespace
+
+RespCodec::RespCodec(CommandBatchCallback cb, size_t maxBulkLength, size_t maxArgs)
+    : commandBatchCallback_(std::move(cb))
+    , maxBulkLength_(maxBulkLength)
+    , maxArgs_(maxArgs)
+{
+}
+
+ssize_t RespCodec::parseCommand(const char *begin, const char *end, Command *args,
+                                size_t maxBulkLength, size_t maxArgs)
+{
+    args->clear();
+    if (begin >= end)
+    {
+        return 0;
+    }
+    if (*begin != '*')
+    {
+        return parseInline(begin, end, args);
+    }
+
+    bool error = false;
+    const char *crlf = findHeaderEnd(begin + 1, end, &error);
+    if (crlf == nullptr)
+    {
+        return error ? -1 : 0;
+    }
+    int64_t argc = 0;
+    if (!parseInt(begin + 1, crlf, &argc) || argc > static_cast<int64_t>(maxArgs))
+    {
+        return -1;
+    }
+
+    const char *p = crlf + 2;
+    for (int64_t i = 0; i < argc; ++i)
+    {
+        if (p >= end)
+        {
+            return 0;
+        }
+        if (*p != '$')
+        {
+            return -1;
+        }
+        crlf = findHeaderEnd(p + 1, end, &error);
+        if (crlf == nullptr)
+        {
+            return error ? -1 : 0;
+        }
+        int64_t len = 0;
+        if (!parseInt(p + 1, crlf, &len) || len < 0 || static_cast<uint64_t>(len) > maxBulkLength)
+        {
+            return -1;
+        }
+        p = crlf + 2;
+        if (end - p < len + 2)
+        {
+            return 0;
+        }
+        if (p[len] != '\r' || p[len + 1] != '\n')
+        {
+            return -1;
+        }
+        args->push_back(StringPiece(p, static_cast<size_t>(len)));
+        p += len + 2;
+    }
+    return p - begin;
+}
+
+ssize_t RespCodec::valueLength(const char *begin, const char *end)
+{
+    return valueLengthAt(begin, end, 0);
+}
+
+void RespCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    // 每个IO线程复用自己的命令数组，参数数组的容量在批次之间保留
+    static thread_local std::vector<Command> t_commands;
+
+    const char *begin = buf->peek();
+    const char *end = buf->beginWrite();
+    const char *p = begin;
+    size_t n = 0;
+    bool error = false;
+    while (p < end)
+    {
+        if (n == t_commands.size())
+        {
+            t_commands.emplace_back();
+        }
+        ssize_t len = parseCommand(p, end, &t_commands[n], maxBulkLength_, maxArgs_);
+        if (len < 0)
+        {
+            error = true;
+            break;
+        }
+        if (len == 0)
+        {
+            break; // 命令还不完整，等待更多数据
+        }
+        if (!t_commands[n].empty() && !conn->consumeMessageBudget())
+        {
+            break; // 本轮的读预算用完，这条命令下一轮重新解析
+        }
+        p += len;
+        if (!t_commands[n].empty())
+        {
+            ++n;
+        }
+    }
+
+    if (n > 0)
+    {
+        commandBatchCallback_(conn, t_commands.data(), n, receiveTime);
+    }
+    buf->retrieve(p - begin);
+
+    if (error)
+    {
+        LOG_ERROR("RespCodec - protocol error from %s \n", conn->name().c_str());
+        Buffer reply;
+        appendError(&reply, "ERR Protocol error");
+        conn->send(&reply);
+        conn->shutdown();
+        buf->retrieveAll();
+    }
+}
+
+void RespCodec::appendSimpleString(Buffer *buf, const StringPiece &str)
+{
+    buf->append("+", 1);
+    buf->append(str.data(), str.size());
+    buf->append("\r\n", 2);
+}
+
+void RespCodec::appendError(Buffer *buf, const StringPiece &msg)
+{
+    buf->append("-", 1);
+    buf->append(msg.data(), msg.size());
+    buf->append("\r\n", 2);
+}
+
+void RespCodec::appendInteger(Buffer *buf, int64_t value)
+{
+    appendTypedInteger(buf, ':', value);
+}
+
+void RespCodec::appendBulkString(Buffer *buf, const StringPiece &str)
+{
+    appendTypedInteger(buf, '$', static_cast<int64_t>(str.size()));
+    buf->append(str.data(), str.size());
+    buf->append("\r\n", 2);
+}
+
+void RespCodec::appendArrayHeader(Buffer *buf, size_t n)
+{
+    appendTypedInteger(buf, '*', static_cast<int64_t>(n));
+}
+
+void RespCodec::appendNull(Buffer *buf, int protover)
+{
+    if (protover >= 3)
+    {
+        buf->append("_\r\n", 3);
+    }
+    else
+    {
+        buf->append("$-1\r\n", 5);
+    }
+}
+
+void RespCodec::appendMapHeader(Buffer *buf, size_t n, int protover)
+{
+    if (protover >= 3)
+    {
+        appendTypedInteger(buf, '%', static_cast<int64_t>(n));
+    }
+    else
+    {
+        appendArrayHeader(buf, n * 2);
+    }
+}
+
+void RespCodec::appendBoolean(Buffer *buf, bool value, int protover)
+{
+    if (protover >= 3)
+    {
+        buf->append(value ? "#t\r\n" : "#f\r\n", 4);
+    }
+    else
+    {
+        appendInteger(buf, value ? 1 : 0);
+    }
+}
+
+void RespCodec::appendDouble(Buffer *buf, double value, int protover)
+{
+    char tmp[64];
+    int n = 0;
+    if (isinf(value))
+    {
+        n = snprintf(tmp, sizeof tmp, "%s", value > 0 ? "inf" : "-inf");
+    }
+    else if (isnan(value))
+    {
+        n = snprintf(tmp, sizeof tmp, "nan");
+    }
+    else
+    {
+        n = snprintf(tmp, sizeof tmp, "%.17g", value);
+    }
+
+    if (protover >= 3)
+    {
+        buf->append(",", 1);
+        buf->append(tmp, n);
+        buf->append("\r\n", 2);
+    }
+    else
+    {
+        appendBulkString(buf, StringPiece(tmp, n));
+    }
+}
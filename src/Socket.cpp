@@ -9,7 +9,7 @@ Socket::~Socket()
 // abort if address in use
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (0 != ::bind(sockfd_, (sockaddr*)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if (0 != ::bind(sockfd_, localaddr.sockAddr(), localaddr.sockAddrLen()))
     {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
@@ -33,13 +33,13 @@ int Socket::accept(InetAddress *peeraddr)
      * poller + non-blocking IO
      * 注意：对返回的connfd没有设置非阻塞
     */ 
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof(addr);
     memset(&addr, 0, sizeof(addr));
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        *peeraddr = InetAddress::fromSockAddr((sockaddr*)&addr, len);
     }
     return connfd;
 }
@@ -59,6 +59,13 @@ void Socket::setTcpNoDelay(bool on)
     ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
 }
 
+void Socket::setTcpCork(bool on)
+{
+    int optval = on ? 1 : 0;
+    // TCP_CORK：开启后内核攒满一个MSS才发出，关闭时立即发出剩余的数据
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+}
+
 /* SOL_SOCKET：表示选项属于套接字本身，适用于所有协议族 */
 void Socket::setReuseAddr(bool on)
 {
@@ -80,3 +87,36 @@ void Socket::setKeepAlive(bool on)
     // SO_KEEPALIVE：启用TCP心跳机制，属于SOL_SOCKET层
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
 }
+
+void Socket::setReceiveTimestamps(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPNS, &optval, sizeof(optval)) < 0)
+    {
+        LOG_ERROR("Socket::setReceiveTimestamps fd=%d errno:%d \n", sockfd_, errno);
+    }
+}
+
+InetAddress Socket::localAddress(int sockfd)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    if (::getsockname(sockfd, (sockaddr*)&addr, &len) < 0)
+    {
+        LOG_ERROR("Socket::localAddress() is error.\n");
+    }
+    return InetAddress::fromSockAddr((sockaddr*)&addr, len);
+}
+
+InetAddress Socket::peerAddress(int sockfd)
+{
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    if (::getpeername(sockfd, (sockaddr*)&addr, &len) < 0)
+    {
+        LOG_ERROR("Socket::peerAddress() is error.\n");
+    }
+    return InetAddress::fromSockAddr((sockaddr*)&addr, len);
+}
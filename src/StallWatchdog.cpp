@@ -0,0 +1,312 @@
+#include "StallWatchdog.h"
+#include "EventLoop.h"
+#include "FlightRecorder.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cxxabi.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+const int kMaxFrames = 64;
+// 信号处理函数本身和内核的信号返回桩，不属于被打断的调用栈
+const int kSkipFrames = 2;
+// 等待loop线程执行信号处理函数的最长时间
+const int kCaptureTimeoutMs = 100;
+
+// 同一时刻只抓取一个线程的调用栈（多个看门狗之间也互斥）
+std::mutex g_captureMutex;
+int g_lastSeq = 0; // 受g_captureMutex保护
+void *g_frames[kMaxFrames];
+std::atomic<int> g_frameCount(-1);
+// 正在等待结果的那次抓取的序号，0表示没有。信号处理函数通过CAS把它从自己的序号改成0，
+// 抢到的才能写g_frames：超时后才到达的信号（序号已经过期）不会覆盖下一次抓取的结果
+std::atomic<int> g_openSeq(0);
+
+void backtraceHandler(int, siginfo_t *info, void *)
+{
+    int savedErrno = errno;
+    void *frames[kMaxFrames];
+    int count = ::backtrace(frames, kMaxFrames);
+    int seq = info->si_value.sival_int;
+    if (seq != 0 && g_openSeq.compare_exchange_strong(seq, 0, std::memory_order_acq_rel))
+    {
+        ::memcpy(g_frames, frames, sizeof(void*) * count);
+        g_frameCount.store(count, std::memory_order_release);
+    }
+    errno = savedErrno;
+}
+
+void installBacktraceHandler()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        // backtrace第一次调用时会加载libgcc，先在普通上下文中调用一次，信号处理函数中就不会再分配内存
+        void *frame;
+        ::backtrace(&frame, 1);
+
+        struct sigaction sa;
+        ::memset(&sa, 0, sizeof sa);
+        sa.sa_sigaction = backtraceHandler;
+        sa.sa_flags = SA_RESTART | SA_SIGINFO;
+        ::sigemptyset(&sa.sa_mask);
+        if (::sigaction(StallWatchdog::backtraceSignal(), &sa, nullptr) < 0)
+        {
+            LOG_ERROR("StallWatchdog - sigaction errno:%d \n", errno);
+        }
+    });
+}
+
+// "lib.so(_ZN3Foo3barEv+0x1f) [0x...]"中的符号还原成可读的名字
+std::string demangleFrame(const char *symbol)
+{
+    std::string frame(symbol);
+    std::string::size_type begin = frame.find('(');
+    std::string::size_type end = frame.find('+', begin);
+    if (begin == std::string::npos || end == std::string::npos || end == begin + 1)
+    {
+        return frame;
+    }
+    std::string mangled = frame.substr(begin + 1, end - begin - 1);
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    if (status == 0 && demangled != nullptr)
+    {
+        frame.replace(begin + 1, end - begin - 1, demangled);
+    }
+    ::free(demangled);
+    return frame;
+}
+
+std::string demangleType(const char *name)
+{
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    std::string result = status == 0 && demangled != nullptr ? demangled : name;
+    ::free(demangled);
+    return result;
+}
+
+// 向tid线程发信号（附带本次抓取的序号），在它的上下文中抓取调用栈
+std::vector<std::string> captureBacktrace(pid_t tid)
+{
+    std::vector<std::string> frames;
+    std::lock_guard<std::mutex> lock(g_captureMutex);
+    int seq = g_lastSeq = g_lastSeq == INT_MAX ? 1 : g_lastSeq + 1;
+    g_frameCount.store(-1, std::memory_order_relaxed);
+    g_openSeq.store(seq, std::memory_order_release);
+
+    siginfo_t info;
+    ::memset(&info, 0, sizeof info);
+    info.si_signo = StallWatchdog::backtraceSignal();
+    info.si_code = SI_QUEUE;
+    info.si_pid = ::getpid();
+    info.si_uid = ::getuid();
+    info.si_value.sival_int = seq;
+    if (::syscall(SYS_rt_tgsigqueueinfo, ::getpid(), tid, info.si_signo, &info) < 0)
+    {
+        LOG_ERROR("StallWatchdog - rt_tgsigqueueinfo tid=%d errno:%d \n", tid, errno);
+        g_openSeq.store(0, std::memory_order_relaxed);
+        return frames;
+    }
+    int count = -1;
+    for (int waited = 0; waited < kCaptureTimeoutMs; ++waited)
+    {
+        count = g_frameCount.load(std::memory_order_acquire);
+        if (count >= 0)
+        {
+            break;
+        }
+        ::usleep(1000);
+    }
+    if (count < 0)
+    {
+        int expected = seq;
+        if (g_openSeq.compare_exchange_strong(expected, 0, std::memory_order_acq_rel))
+        {
+            return frames; // loop线程没有及时响应（如屏蔽了信号），之后到达的信号会被忽略
+        }
+        // 信号处理函数恰好已经抢到了这次抓取，正在复制调用栈，等它写完
+        while ((count = g_frameCount.load(std::memory_order_acquire)) < 0)
+        {
+            ::sched_yield();
+        }
+    }
+    char **symbols = ::backtrace_symbols(g_frames, count);
+    if (symbols == nullptr)
+    {
+        return frames;
+    }
+    for (int i = kSkipFrames; i < count; ++i)
+    {
+        frames.push_back(demangleFrame(symbols[i]));
+    }
+    ::free(symbols);
+    return frames;
+}
+}
+
+StallWatchdog::StallWatchdog(double thresholdSeconds)
+    : thresholdUs_(static_cast<int64_t>(thresholdSeconds * Timestamp::kMicroSecondsPerSecond))
+    , running_(false)
+    , stallCount_(0)
+    , thread_(std::bind(&StallWatchdog::threadFunc, this), "StallWatchdog")
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+}
+
+int StallWatchdog::backtraceSignal()
+{
+    return SIGRTMIN + 4;
+}
+
+void StallWatchdog::start()
+{
+    installBacktraceHandler();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = true;
+    }
+    thread_.start();
+}
+
+void StallWatchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void StallWatchdog::watch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Watched watched = { loop, 0, 0 };
+    loops_.push_back(watched);
+}
+
+void StallWatchdog::unwatch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+                                [loop](const Watched &w) { return w.loop == loop; }),
+                 loops_.end());
+}
+
+void StallWatchdog::threadFunc()
+{
+    const int64_t intervalUs = std::max<int64_t>(thresholdUs_ / 4, 1000);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, std::chrono::microseconds(intervalUs));
+        if (!running_)
+        {
+            break;
+        }
+        std::vector<StallReport> stalls;
+        checkLoops(&stalls);
+        if (!stalls.empty())
+        {
+            // 抓调用栈最多要等kCaptureTimeoutMs，导出trace也要写文件，都不能阻塞unwatch
+            lock.unlock();
+            for (StallReport &stall : stalls)
+            {
+                report(&stall);
+            }
+            lock.lock();
+        }
+    }
+}
+
+// 持有mutex_调用：只在这里访问各loop，把卡顿的loop的信息复制到stalls中
+void StallWatchdog::checkLoops(std::vector<StallReport> *stalls)
+{
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    for (Watched &watched : loops_)
+    {
+        EventLoop *loop = watched.loop;
+        uint64_t iteration = loop->heartbeat();
+        int64_t busySince = loop->busySince();
+        if (busySince == 0 || iteration == watched.reportedIteration
+            || now - busySince < thresholdUs_ || loop->heartbeat() != iteration)
+        {
+            continue;
+        }
+        watched.reportedIteration = iteration;
+        ++watched.stalls;
+        stallCount_.fetch_add(1, std::memory_order_relaxed);
+
+        StallReport report;
+        report.loop = loop;
+        report.tid = loop->threadId();
+        report.iteration = iteration;
+        report.stalledMs = (now - busySince) / 1000;
+        report.loopStalls = watched.stalls;
+
+        int fd = -1;
+        const char *detail = nullptr;
+        const char *kind = loop->activity(&fd, &detail);
+        report.activity = kind != nullptr ? kind : "unknown";
+        if (fd >= 0)
+        {
+            report.activity += " fd=" + std::to_string(fd);
+        }
+        if (detail != nullptr)
+        {
+            report.activity += " " + demangleType(detail);
+        }
+        stalls->push_back(std::move(report));
+    }
+}
+
+// 不持有mutex_调用，不再访问loop
+void StallWatchdog::report(StallReport *stall)
+{
+    StallReport &report = *stall;
+    report.backtrace = captureBacktrace(report.tid);
+
+    if (FlightRecorder::enabled())
+    {
+        FlightRecorder::recordInstant(FlightRecorder::kStall, static_cast<int32_t>(report.stalledMs), report.tid);
+        if (!traceDumpPath_.empty())
+        {
+            FlightRecorder::dumpChromeTrace(traceDumpPath_);
+        }
+    }
+
+    if (stallCallback_)
+    {
+        stallCallback_(report);
+        return;
+    }
+    LOG_ERROR("StallWatchdog - loop %p (tid %d) stalled %lldms in iteration %llu, running %s, stalls=%lld \n",
+              report.loop, report.tid, static_cast<long long>(report.stalledMs),
+              static_cast<unsigned long long>(report.iteration), report.activity.c_str(),
+              static_cast<long long>(report.loopStalls));
+    for (const std::string &frame : report.backtrace)
+    {
+        LOG_ERROR("    %s \n", frame.c_str());
+    }
+}
@@ -0,0 +1,138 @@
+#include "TcpClient.h"
+#include "Connector.h"
+#include "EventLoop.h"
+#include "Socket.h"
+#include "Logger.h"
+
+#include <functional>
+
+// TcpClient对象中，loop_不能为空
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d TcpClient Loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+// TcpClient析构后，连接关闭时不能再回调TcpClient::removeConnection
+static void removeConnection(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_(defaultConnectionCallback)
+    , messageCallback_(defaultMessageCallback)
+    , retry_(false)
+    , connect_(true)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unique = connection_.unique();
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接还在：替换掉指向this的closeCallback_
+        CloseCallback cb = std::bind(&::removeConnection, loop_, std::placeholders::_1);
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s \n", name_.c_str(),
+             connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (connection_)
+        {
+            connection_->shutdown();
+        }
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    loop_->assertInLoopThread();
+    InetAddress peerAddr(Socket::peerAddress(sockfd));
+    InetAddress localAddr(Socket::localAddress(sockfd));
+    std::string connName = name_ + ":" + peerAddr.toIpPort() + "#" + std::to_string(nextConnId_);
+    ++nextConnId_;
+
+    TcpConnectionPtr conn(new TcpConnection(loop_,
+                                            connName,
+                                            sockfd,
+                                            localAddr,
+                                            peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_, tlsServerName_);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    loop_->assertInLoopThread();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - Reconnecting to %s \n", name_.c_str(),
+                 connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
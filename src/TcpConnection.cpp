@@ -3,6 +3,9 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "TlsContext.h"
+#include "ConnectionFilter.h"
+#include "FlightRecorder.h"
 
 #include <functional>
 #include <errno.h>
@@ -11,6 +14,12 @@
 #include <strings.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
 #include <string>
 
 // TcpConnection对象中，loop_不能为空
@@ -23,33 +32,66 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+void defaultConnectionCallback(const TcpConnectionPtr &conn)
+{
+    (void)conn; // 没有定义MUDEBUG时LOG_DEBUG为空
+    LOG_DEBUG("%s -> %s is %s \n", conn->localAddress().toIpPort().c_str(),
+              conn->peerAddress().toIpPort().c_str(),
+              (conn->connected() ? "UP" : "DOWN"));
+}
+
+void defaultMessageCallback(const TcpConnectionPtr&, Buffer *buffer, Timestamp)
+{
+    buffer->retrieveAll();
+}
+
+// 新连接在设置回调之前共用的一份空回调
+static const std::shared_ptr<TcpConnection::Callbacks>& emptyCallbacks()
+{
+    static const std::shared_ptr<TcpConnection::Callbacks> callbacks = std::make_shared<TcpConnection::Callbacks>();
+    return callbacks;
+}
+
 TcpConnection::TcpConnection(EventLoop *loop, 
                 const std::string &nameArg, 
                 int sockfd,
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
+    , compact_(false)
+    , corkPending_(false)
+    , sourcePaused_(false)
     , channel_(new Channel(loop, sockfd))
-    , localAddr_(localAddr) , peerAddr_(peerAddr)
+    , socket_(new Socket(sockfd))
+    , callbacks_(emptyCallbacks())
     , highWaterMark_(64*1024*1024) // 高水位标志：64M
+    , maxBytesPerRound_(0)
+    , maxMessagesPerRound_(0)
+    , messageBudget_(0)
+    , lastDispatchIteration_(0)
+    , budgetExhausted_(false)
+    , carryOverPending_(false)
+    , receiveFds_(false)
+    , latencyReplied_(false)
+    , memoryPaused_(false)
+    , name_(nameArg)
+    , localAddr_(localAddr) , peerAddr_(peerAddr)
+    , backpressureHigh_(0)
+    , backpressureLow_(0)
+    , nextOffloadTicket_(0)
+    , nextDeliveryTicket_(0)
+    , latencyShard_(nullptr)
+    , kernelReceiveNs_(0)
+    , replyOriginNs_(0)
+    , replyHandlerEndNs_(0)
+    , memoryShard_(nullptr)
+    , accountedBytes_(0)
+    , accountedQueued_(0)
 {
-    // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
-    );
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this)
-    );
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this)
-    );
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this)
-    );
+    // poller给channel通知感兴趣的事件发生了，channel调用本对象的handleRead/handleWrite/handleClose/handleError
+    channel_->setHandler(this);
 
     LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
     socket_->setKeepAlive(true);
@@ -59,6 +101,22 @@ TcpConnection::TcpConnection(EventLoop *loop,
 TcpConnection::~TcpConnection()
 {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%s.\n", name_.c_str(), channel_->fd(), stateToString());
+    for (const std::unique_ptr<PendingSegment> &segment : pendingSegments_)
+    {
+        if (segment->closeWhenDone)
+        {
+            ::close(segment->fd);
+        }
+        for (int fd : segment->passFds)
+        {
+            ::close(fd);
+        }
+    }
+    discardBufferedFiles();
+    for (int fd : receivedFds_)
+    {
+        ::close(fd);
+    }
 }
 
 // 发送消息
@@ -77,12 +135,193 @@ void TcpConnection::send(const std::string& msg)
     }
 }
 
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            // 跨线程：数据必须拷贝一份，随回调一起交给loop线程
+            std::shared_ptr<std::string> msg = std::make_shared<std::string>(buf->retrieveAllAsString());
+            TcpConnectionPtr self(shared_from_this());
+            loop_->runInLoop([self, msg]() { self->sendInLoop(msg->data(), msg->size()); });
+        }
+    }
+}
+
+void TcpConnection::send(const struct iovec *iov, int iovcnt)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendvInLoop(iov, iovcnt);
+        }
+        else
+        {
+            // 跨线程：各段的内存不归我们所有，只能拼成一条消息随回调交给loop线程
+            std::shared_ptr<std::string> msg = std::make_shared<std::string>();
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                msg->append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            }
+            TcpConnectionPtr self(shared_from_this());
+            loop_->runInLoop([self, msg]() { self->sendInLoop(msg->data(), msg->size()); });
+        }
+    }
+}
+
+void TcpConnection::sendv(std::initializer_list<StringPiece> pieces)
+{
+    struct iovec vec[16];
+    std::vector<struct iovec> heap;
+    struct iovec *iov = vec;
+    if (pieces.size() > sizeof vec / sizeof vec[0])
+    {
+        heap.resize(pieces.size());
+        iov = heap.data();
+    }
+    int iovcnt = 0;
+    for (const StringPiece &piece : pieces)
+    {
+        if (piece.size() > 0)
+        {
+            iov[iovcnt].iov_base = const_cast<char*>(piece.data());
+            iov[iovcnt].iov_len = piece.size();
+            ++iovcnt;
+        }
+    }
+    send(iov, iovcnt);
+}
+
 // 由于应用层写的快，内核发送数据慢，故需要将待发送的数据先写入缓冲区，且设置了水位回调
 void TcpConnection::sendInLoop(const void* data, size_t len)
+{
+    struct iovec vec;
+    vec.iov_base = const_cast<void*>(data);
+    vec.iov_len = len;
+    sendvInLoop(&vec, 1);
+}
+
+void TcpConnection::sendvInLoop(const struct iovec *iov, int iovcnt)
+{
+    loop_->assertInLoopThread();
+    // 还有读文件再send的文件没发完，数据只能排在该文件之后
+    if (!bufferedFiles_.empty())
+    {
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing!");
+            return;
+        }
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            bufferedFiles_.back()->tail.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        return;
+    }
+    filterAndSendInLoop(iov, iovcnt);
+}
+
+void TcpConnection::filterAndSendInLoop(const struct iovec *iov, int iovcnt)
+{
+    if (filters_)
+    {
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing!");
+            return;
+        }
+        flushFilterStaging(); // 用户在outputBuffer()中构造、还没有发送的数据排在前面
+        Buffer *encoded = filters_->encode(iov, iovcnt);
+        struct iovec vec;
+        vec.iov_base = const_cast<char*>(encoded->peek());
+        vec.iov_len = encoded->readableBytes();
+        sendFilteredInLoop(&vec, 1);
+        encoded->retrieveAll();
+        return;
+    }
+    sendFilteredInLoop(iov, iovcnt);
+}
+
+void TcpConnection::flushFilterStaging()
+{
+    Buffer *staging = filters_->staging();
+    if (staging->readableBytes() == 0)
+    {
+        return;
+    }
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(staging->peek());
+    vec.iov_len = staging->readableBytes();
+    Buffer *encoded = filters_->encode(&vec, 1);
+    staging->retrieveAll();
+    vec.iov_base = const_cast<char*>(encoded->peek());
+    vec.iov_len = encoded->readableBytes();
+    sendFilteredInLoop(&vec, 1);
+    encoded->retrieveAll();
+}
+
+void TcpConnection::addFilter(std::unique_ptr<ConnectionFilter> filter)
+{
+    loop_->assertInLoopThread();
+    if (!filters_)
+    {
+        filters_.reset(new FilterChain);
+    }
+    filters_->add(std::move(filter));
+}
+
+bool TcpConnection::decodeFilterInput()
+{
+    if (!filters_->decode(&inputBuffer_))
+    {
+        LOG_ERROR("TcpConnection::decodeFilterInput [%s] - invalid input, closing \n", name_.c_str());
+        handleClose();
+        return false;
+    }
+    return true;
+}
+
+void TcpConnection::sendFilteredInLoop(const struct iovec *iov, int iovcnt)
+{
+    if (tls_ && !tls_->kernelSend())
+    {
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing!");
+            return;
+        }
+        if (!tls_->established())
+        {
+            // 握手完成后再加密发送
+            Buffer *plain = tls_->plainOutput();
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                plain->append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            }
+            return;
+        }
+        // 用户在outputBuffer()中构造、还没有发送的明文排在前面
+        if (flushTlsPlaintext())
+        {
+            encryptAndWriteInLoop(iov, iovcnt);
+        }
+        return;
+    }
+    writeRawInLoop(iov, iovcnt);
+}
+
+void TcpConnection::writeRawInLoop(const struct iovec *iov, int iovcnt)
 {
 	loop_->assertInLoopThread();
     ssize_t nwrote = 0;
-    size_t remaining = len;
+    size_t len = 0;
     bool faultError = false;
 
     // 之前调用过该connection的shutdown，不能再进行发送了
@@ -91,19 +330,40 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         LOG_ERROR("disconnected, give up writing!");
         return;
     }
+
+    // 还有文件在等待发送，数据只能排在该文件之后（此时channel_已经注册了写事件）
+    if (!pendingSegments_.empty())
+    {
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            pendingSegments_.back()->tail.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        return;
+    }
+
+    latencyReplied_ = true;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
+    size_t remaining = len;
+    // auto-cork：事件分发期间先把数据攒在outputBuffer_里，分发结束后统一write
+    bool cork = corkPending_ || (loop_->corking() && !channel_->isWriting());
  
 	// if no thing in output queue, try writing directly
     // 此时，channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!cork && !channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        // 超过IOV_MAX的部分放进outputBuffer_，等可写事件再发
+        nwrote = iovcnt == 1 ? ::write(channel_->fd(), iov[0].iov_base, iov[0].iov_len)
+                             : ::writev(channel_->fd(), iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
         if (nwrote >= 0)   // 成功发送了
         {
             remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
+            if (remaining == 0 && callbacks_->writeComplete)
             {
                 // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了，这样epoll_wait就不用监听可写事件并且执行handleWrite了，算是提高效率了！！！
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
             }
         }
         else // nwrote < 0
@@ -130,21 +390,80 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         size_t oldLen = outputBuffer_.readableBytes();
         if (oldLen + remaining >= highWaterMark_
             && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+            && callbacks_->highWaterMark)
+        {
+            loop_->queueInLoop(std::bind(callbacks_->highWaterMark, shared_from_this(), oldLen+remaining));
+        }
+		// 跳过已经写出的nwrote个字节，其余各段依次写入到outputbuffer_中
+        outputBuffer_.ensureWriteableBytes(remaining);
+        size_t skip = static_cast<size_t>(nwrote);
+        for (int i = 0; i < iovcnt; ++i)
         {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining));
+            if (skip >= iov[i].iov_len)
+            {
+                skip -= iov[i].iov_len;
+                continue;
+            }
+            outputBuffer_.append(static_cast<const char*>(iov[i].iov_base) + skip, iov[i].iov_len - skip);
+            skip = 0;
         }
-		// 将message[nwrote, nwrote+remaining]的数据，写入到outputbuffer_中
-        outputBuffer_.append((char*)data + nwrote, remaining);
 		
 		// 向poller注册channel的写事件，否则poller不会给channel通知epollout
-        if (!channel_->isWriting())
+        if (cork)
+        {
+            scheduleCorkFlush();
+        }
+        else if (!channel_->isWriting())
         {
             channel_->enableWriting();  
         }
+        updateBackpressure();
     }
 } 
 
+void TcpConnection::scheduleCorkFlush()
+{
+    if (!corkPending_)
+    {
+        corkPending_ = true;
+        loop_->runAfterDispatch(std::bind(&TcpConnection::flushCorked, shared_from_this()));
+    }
+}
+
+void TcpConnection::flushCorked()
+{
+    corkPending_ = false;
+    // 期间改走了写事件（如排入了sendFile），交给handleWrite发送
+    if (state_ == kDisconnected || channel_->isWriting() || outputBuffer_.readableBytes() == 0)
+    {
+        return;
+    }
+    int savedErrno = 0;
+    ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+    if (n > 0)
+    {
+        outputBuffer_.retrieve(n);
+        updateBackpressure();
+    }
+    else if (savedErrno != EWOULDBLOCK)
+    {
+        LOG_ERROR("TcpConnection::flushCorked errno:%d \n", savedErrno);
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            return;
+        }
+    }
+
+    if (outputBuffer_.readableBytes() > 0)
+    {
+        channel_->enableWriting();
+    }
+    else
+    {
+        writeCompleted();
+    }
+}
+
 // 关闭连接
 void TcpConnection::shutdown()
 {
@@ -157,12 +476,148 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    if (!bufferedFiles_.empty())
+    {
+        return; // 文件发完之后再关闭（见writeCompleted），否则close_notify会截断文件
+    }
+    if (tls_)
+    {
+        if (!tls_->established())
+        {
+            return; // 握手完成、暂存的数据发出之后再关闭（见tlsEstablishedInLoop）
+        }
+        if (!tls_->closeNotifySent())
+        {
+            tls_->shutdown();
+            flushTlsOutput();
+        }
+    }
+    if (!channel_->isWriting() && !corkPending_) // 说明outputBuffer中的数据已经全部发送完成
     {
         socket_->shutdownWrite(); // 关闭写端
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    loop_->assertInLoopThread();
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        // as if we received 0 byte in handleRead();
+        handleClose();
+    }
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_->setTcpNoDelay(on);
+}
+
+void TcpConnection::setTcpCork(bool on)
+{
+    socket_->setTcpCork(on);
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    loop_->assertInLoopThread();
+    if (memoryPaused_)
+    {
+        // 背压等途径不能绕过内存预算的暂停：只记下想读，总量回落、resumeMemoryPaused时再开启
+        reading_ = true;
+        return;
+    }
+    if (state_ == kConnected && (!reading_ || !channel_->isReading()))
+    {
+        channel_->enableReading();
+        reading_ = true;
+        // 暂停期间没处理完的消息，不必等socket上有新数据
+        if (budgetExhausted_ && inputBuffer_.readableBytes() > 0 && !carryOverPending_)
+        {
+            carryOverPending_ = true;
+            loop_->deferToNextIteration(std::bind(&TcpConnection::handleCarryOver, shared_from_this()));
+        }
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    loop_->assertInLoopThread();
+    if ((state_ == kConnected || state_ == kDisconnecting) && (reading_ || channel_->isReading()))
+    {
+        channel_->disableReading();
+        reading_ = false;
+    }
+}
+
+void TcpConnection::setBackpressureSource(const TcpConnectionPtr &source, size_t highMark, size_t lowMark)
+{
+    loop_->assertInLoopThread();
+    releaseBackpressure();
+    backpressureSource_ = source;
+    backpressureHigh_ = highMark;
+    backpressureLow_ = lowMark < highMark ? lowMark : highMark / 2;
+    updateBackpressure();
+}
+
+void TcpConnection::updateBackpressure()
+{
+    updateMemoryUsage();
+    if (backpressureHigh_ == 0)
+    {
+        return;
+    }
+    size_t pending = outputBuffer_.readableBytes();
+    if (!sourcePaused_ && pending >= backpressureHigh_)
+    {
+        TcpConnectionPtr source = backpressureSource_.lock();
+        if (source)
+        {
+            LOG_DEBUG("TcpConnection[%s] output %lu bytes, pause reading %s \n",
+                      name_.c_str(), pending, source->name().c_str());
+            sourcePaused_ = true;
+            source->stopRead();
+        }
+    }
+    else if (sourcePaused_ && pending <= backpressureLow_)
+    {
+        releaseBackpressure();
+    }
+}
+
+// 恢复source的读（本连接关闭时也要调用，避免source永远停在暂停状态）
+void TcpConnection::releaseBackpressure()
+{
+    if (sourcePaused_)
+    {
+        sourcePaused_ = false;
+        TcpConnectionPtr source = backpressureSource_.lock();
+        if (source)
+        {
+            source->startRead();
+        }
+    }
+}
+
 /* This two functions should be called only once. */
 // Called me when tcpServer accepts a new connection 
 void TcpConnection::connectEstablished()  // 连接建立
@@ -170,9 +625,20 @@ void TcpConnection::connectEstablished()  // 连接建立
     setState(kConnected);
     channel_->tie(shared_from_this());
     channel_->enableReading(); // 向poller注册channel的epollin事件
+    if (memoryShard_)
+    {
+        memoryBudget_->add(memoryShard_, this);
+        updateMemoryUsage();
+    }
 
     // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    callbacks_->connection(shared_from_this());
+
+    // 客户端发出ClientHello；服务端此时没有数据，等待可读事件
+    if (tls_ && state_ == kConnected)
+    {
+        handleTlsResult(tls_->handshake(), false);
+    }
 }
 // Called me when TcpServer has remove me from its map 
 void TcpConnection::connectDestroyed()  // 连接销毁
@@ -181,20 +647,56 @@ void TcpConnection::connectDestroyed()  // 连接销毁
     {
         setState(kDisconnected);
         channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());  // 新连接建立，执行回调
+        callbacks_->connection(shared_from_this());  // 新连接建立，执行回调
     }
     channel_->remove(); // 把channel从subEventLoop的poller中删除掉
+    if (memoryShard_)
+    {
+        memoryBudget_->remove(memoryShard_, this, accountedBytes_, accountedQueued_, memoryPaused_);
+        memoryShard_ = nullptr;
+    }
 }
 
-void TcpConnection::handleRead(TimeStamp receiveTime)
+void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    // 上一轮因为预算用完还剩下完整的消息：先处理它们，暂不从socket读（LT模式下剩余的数据下一轮还会触发）
+    if (budgetExhausted_ && inputBuffer_.readableBytes() > 0)
+    {
+        dispatchMessages(receiveTime);
+        return;
+    }
+    if (tls_)
+    {
+        handleTlsRead(receiveTime);
+        return;
+    }
+
     int savedErrno = 0;   // 保存读取拷贝的过程中发生的错误
-    // 已建立连接的用户，有可读事件发生了，并将Tcp接收缓冲区数据拷贝到用户定义的缓冲区inputBuffer_中
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);  
+    const size_t maxBytes = maxBytesPerRound_ > 0 ? maxBytesPerRound_ : SIZE_MAX;
+    // 已建立连接的用户，有可读事件发生了，并将Tcp接收缓冲区数据拷贝到用户定义的缓冲区inputBuffer_中（有filter时先放在filter的输入缓冲区）
+    Buffer *input = filters_ ? filters_->input() : &inputBuffer_;
+    const size_t oldReadable = inputBuffer_.readableBytes();
+    ssize_t n;
+    if (latencyShard_)
+    {
+        n = input->recvMsg(channel_->fd(), &savedErrno, receiveFds_ ? &receivedFds_ : nullptr, &kernelReceiveNs_, maxBytes);
+    }
+    else
+    {
+        n = receiveFds_ ? input->readFd(channel_->fd(), &savedErrno, &receivedFds_, maxBytes)
+                        : input->readFd(channel_->fd(), &savedErrno, maxBytes);
+    }
     if(n > 0) 
     {
+        if (filters_ && !decodeFilterInput())
+        {
+            return;
+        }
         // 从fd读到了数据，并且放在了inputBuffer_上，接着调用messageCallback_
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        if (inputBuffer_.readableBytes() > oldReadable)
+        {
+            dispatchMessages(receiveTime);
+        }
     }
     else if(n == 0)
     {
@@ -211,33 +713,406 @@ void TcpConnection::handleRead(TimeStamp receiveTime)
     }
 }
 
-void TcpConnection::handleWrite()
+void TcpConnection::handleTlsRead(Timestamp receiveTime)
 {
-    if (channel_->isWriting())
+    int savedErrno = 0;
+    const size_t maxBytes = maxBytesPerRound_ > 0 ? maxBytesPerRound_ : SIZE_MAX;
+    const size_t oldReadable = inputBuffer_.readableBytes();
+    bool wasEstablished = tls_->established();
+    int result = tls_->read(channel_->fd(), filters_ ? filters_->input() : &inputBuffer_, maxBytes, &savedErrno);
+    if (result == TlsSession::kError && savedErrno != 0)
     {
-        int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
-        {
-            outputBuffer_.retrieve(n);
-	    // 此时，buffer_中的数据已经全部通过channel_->fd()被发送给了客户端
-            if (outputBuffer_.readableBytes() == 0)
-            {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
-            }
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleTlsRead");
+        handleError();
+        return;
+    }
+    if (!handleTlsResult(result, wasEstablished))
+    {
+        return;
+    }
+    if (filters_ && !decodeFilterInput())
+    {
+        return;
+    }
+    if (inputBuffer_.readableBytes() > oldReadable)
+    {
+        dispatchMessages(receiveTime);
+    }
+    if (result == TlsSession::kClosed && state_ != kDisconnected)
+    {
+        handleClose();
+    }
+}
+
+// 每次调用OpenSSL之后：发出它产生的密文，处理握手完成和错误。返回false表示连接已经关闭
+bool TcpConnection::handleTlsResult(int result, bool wasEstablished)
+{
+    flushTlsOutput();
+    if (result == TlsSession::kError)
+    {
+        LOG_ERROR("TcpConnection::handleTlsResult [%s] - TLS failed, closing \n", name_.c_str());
+        handleClose();
+        return false;
+    }
+    if (result == TlsSession::kWantWrite && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+    if (!wasEstablished && tls_->established())
+    {
+        tlsEstablishedInLoop();
+    }
+    return true;
+}
+
+void TcpConnection::tlsEstablishedInLoop()
+{
+    LOG_INFO("TcpConnection[%s] TLS established: %s %s%s%s \n", name_.c_str(), tls_->version(), tls_->cipher(),
+             tls_->resumed() ? " resumed" : "", tls_->kernelSend() ? " kTLS" : "");
+    if (!flushTlsPlaintext())
+    {
+        return;
+    }
+    if (!bufferedFiles_.empty() && !pumpBufferedFiles())
+    {
+        return;
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::flushTlsOutput()
+{
+    Buffer *cipher = tls_->cipherOutput();
+    tls_->drainOutput(cipher);
+    if (cipher->readableBytes() > 0)
+    {
+        struct iovec vec;
+        vec.iov_base = const_cast<char*>(cipher->peek());
+        vec.iov_len = cipher->readableBytes();
+        writeRawInLoop(&vec, 1);
+        cipher->retrieveAll();
+    }
+}
+
+// 发送暂存在plainOutput()中的明文，握手完成后才能调用
+bool TcpConnection::flushTlsPlaintext()
+{
+    Buffer *plain = tls_->plainOutput();
+    if (plain->readableBytes() == 0)
+    {
+        return true;
+    }
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(plain->peek());
+    vec.iov_len = plain->readableBytes();
+    bool ok = true;
+    if (tls_->kernelSend())
+    {
+        writeRawInLoop(&vec, 1);
+    }
+    else
+    {
+        ok = encryptAndWriteInLoop(&vec, 1);
+    }
+    plain->retrieveAll();
+    return ok;
+}
+
+bool TcpConnection::encryptAndWriteInLoop(const struct iovec *iov, int iovcnt)
+{
+    Buffer *cipher = tls_->cipherOutput();
+    const bool ok = tls_->encrypt(iov, iovcnt, cipher);
+    if (ok)
+    {
+        struct iovec vec;
+        vec.iov_base = const_cast<char*>(cipher->peek());
+        vec.iov_len = cipher->readableBytes();
+        writeRawInLoop(&vec, 1);
+    }
+    cipher->retrieveAll();
+    if (!ok)
+    {
+        // 丢掉这段明文之后对端收到的数据就不完整了，与握手/读出错一样直接关闭连接
+        LOG_ERROR("TcpConnection::encryptAndWriteInLoop [%s] - TLS encrypt failed, closing \n", name_.c_str());
+        if (state_ != kDisconnected)
+        {
+            handleClose();
         }
-        else
+    }
+    return ok;
+}
+
+void TcpConnection::startTls(const std::shared_ptr<TlsContext> &context, const std::string &serverName)
+{
+    tls_.reset(new TlsSession(context, channel_->fd(), serverName,
+                              serverName.empty() ? peerAddr_.toIpPort() : serverName));
+}
+
+bool TcpConnection::tlsEstablished() const
+{
+    return tls_ && tls_->established();
+}
+
+void TcpConnection::dispatchMessages(Timestamp receiveTime)
+{
+    lastDispatchIteration_ = loop_->iteration();
+    messageBudget_ = maxMessagesPerRound_;
+    budgetExhausted_ = false;
+    int64_t dispatchStartNs = 0;
+    if (latencyShard_)
+    {
+        dispatchStartNs = latencyClockNanos();
+        latencyReplied_ = false;
+    }
+    callbacks_->message(shared_from_this(), &inputBuffer_, receiveTime);
+    if (latencyShard_)
+    {
+        recordDispatchLatency(receiveTime, dispatchStartNs);
+    }
+
+    if (budgetExhausted_ && inputBuffer_.readableBytes() > 0 && !carryOverPending_)
+    {
+        carryOverPending_ = true;
+        carryOverTime_ = receiveTime;
+        loop_->deferToNextIteration(std::bind(&TcpConnection::handleCarryOver, shared_from_this()));
+    }
+    if (compact_)
+    {
+        inputBuffer_.releaseIfEmpty();
+    }
+    updateMemoryUsage();
+}
+
+void TcpConnection::recordDispatchLatency(Timestamp receiveTime, int64_t dispatchStartNs)
+{
+    int64_t handlerEndNs = latencyClockNanos();
+    // receiveTime是poll返回的时间（推迟处理的数据为最初读到时的poll时间）
+    int64_t pollNs = receiveTime.microSecondsSinceEpoch() * 1000;
+    int64_t originNs = pollNs;
+    if (kernelReceiveNs_ > 0)
+    {
+        latencyShard_->record(LatencyStats::kKernelQueue, pollNs - kernelReceiveNs_);
+        originNs = kernelReceiveNs_;
+        kernelReceiveNs_ = 0; // 推迟处理的部分不再重复统计
+    }
+    latencyShard_->record(LatencyStats::kDispatch, dispatchStartNs - pollNs);
+    latencyShard_->record(LatencyStats::kHandler, handlerEndNs - dispatchStartNs);
+    if (!latencyReplied_)
+    {
+        return;
+    }
+    if (outputBuffer_.readableBytes() == 0 && pendingSegments_.empty() && !corkPending_)
+    {
+        // 回复在回调中已经全部写出
+        latencyShard_->record(LatencyStats::kWrite, 0);
+        latencyShard_->record(LatencyStats::kTotal, handlerEndNs - originNs);
+    }
+    else if (replyOriginNs_ == 0) // 之前的回复还没写完时，按较早的请求计算
+    {
+        replyOriginNs_ = originNs;
+        replyHandlerEndNs_ = handlerEndNs;
+    }
+}
+
+void TcpConnection::setLatencyStats(const std::shared_ptr<LatencyStats> &stats)
+{
+    latencyStats_ = stats;
+    latencyShard_ = stats ? stats->shardFor(loop_) : nullptr;
+    socket_->setReceiveTimestamps(stats != nullptr);
+}
+
+TcpConnection::Callbacks* TcpConnection::ownCallbacks()
+{
+    if (callbacks_.use_count() > 1)
+    {
+        callbacks_ = std::make_shared<Callbacks>(*callbacks_);
+    }
+    return callbacks_.get();
+}
+
+void TcpConnection::setCompactMode(bool on)
+{
+    compact_ = on;
+    if (compact_)
+    {
+        inputBuffer_.releaseIfEmpty();
+        outputBuffer_.releaseIfEmpty();
+    }
+}
+
+void TcpConnection::setMemoryBudget(const std::shared_ptr<MemoryBudget> &budget)
+{
+    memoryBudget_ = budget;
+    memoryShard_ = budget ? budget->shardFor(loop_) : nullptr;
+}
+
+void TcpConnection::updateMemoryUsage()
+{
+    // inputBuffer_只在回调返回之后释放（dispatchMessages），回调中可能还持有指向其中数据的指针
+    if (compact_)
+    {
+        outputBuffer_.releaseIfEmpty();
+    }
+    if (!memoryShard_)
+    {
+        return;
+    }
+    // 超过预算时，空闲下来的大缓冲区先还回去
+    if (memoryBudget_->underPressure())
+    {
+        if (inputBuffer_.readableBytes() == 0 && inputBuffer_.internalCapacity() > MemoryBudget::kShrinkThreshold)
+        {
+            inputBuffer_.shrink(0);
+        }
+        if (outputBuffer_.readableBytes() == 0 && outputBuffer_.internalCapacity() > MemoryBudget::kShrinkThreshold)
+        {
+            outputBuffer_.shrink(0);
+        }
+    }
+    int64_t bytes = static_cast<int64_t>(inputBuffer_.internalCapacity() + outputBuffer_.internalCapacity());
+    int64_t queued = static_cast<int64_t>(outputBuffer_.readableBytes());
+    if (bytes == accountedBytes_ && queued == accountedQueued_)
+    {
+        return;
+    }
+    const int64_t grown = bytes - accountedBytes_;
+    memoryBudget_->update(memoryShard_, grown, queued - accountedQueued_);
+    accountedBytes_ = bytes;
+    accountedQueued_ = queued;
+    if (state_ != kConnected || grown <= 0)
+    {
+        return;
+    }
+    if (memoryBudget_->overCloseLimit())
+    {
+        memoryBudget_->closeHeaviest(memoryShard_);
+    }
+    else if (!memoryPaused_ && memoryBudget_->overLimit() && channel_->isReading()
+             && memoryBudget_->maybePause(memoryShard_, this, bytes))
+    {
+        memoryPaused_ = true;
+        channel_->disableReading();
+    }
+}
+
+void TcpConnection::resumeMemoryPaused()
+{
+    if (!memoryPaused_)
+    {
+        return;
+    }
+    memoryPaused_ = false;
+    memoryBudget_->resumed(memoryShard_, this);
+    if (state_ == kConnected && reading_ && !channel_->isReading())
+    {
+        startReadInLoop();
+    }
+}
+
+void TcpConnection::handleCarryOver()
+{
+    carryOverPending_ = false;
+    if ((state_ != kConnected && state_ != kDisconnecting) || !reading_
+        || !budgetExhausted_ || inputBuffer_.readableBytes() == 0)
+    {
+        return;
+    }
+    if (lastDispatchIteration_ == loop_->iteration())
+    {
+        // 本轮已经通过handleRead处理过一次了，再等一轮
+        carryOverPending_ = true;
+        loop_->deferToNextIteration(std::bind(&TcpConnection::handleCarryOver, shared_from_this()));
+        return;
+    }
+    dispatchMessages(carryOverTime_);
+}
+
+void TcpConnection::setReadBudget(size_t maxBytes, size_t maxMessages)
+{
+    maxBytesPerRound_ = maxBytes;
+    maxMessagesPerRound_ = maxMessages;
+}
+
+uint64_t TcpConnection::beginOffload()
+{
+    loop_->assertInLoopThread();
+    return nextOffloadTicket_++;
+}
+
+void TcpConnection::completeOffload(uint64_t ticket, const std::function<void()> &done)
+{
+    loop_->assertInLoopThread();
+    if (ticket != nextDeliveryTicket_)
+    {
+        completedOffloads_[ticket] = done;
+        return;
+    }
+    if (done)
+    {
+        done();
+    }
+    ++nextDeliveryTicket_;
+    // 交付之前已经完成、排在后面的结果
+    std::map<uint64_t, std::function<void()>>::iterator it = completedOffloads_.begin();
+    while (it != completedOffloads_.end() && it->first == nextDeliveryTicket_)
+    {
+        std::function<void()> next;
+        next.swap(it->second);
+        completedOffloads_.erase(it);
+        if (next)
+        {
+            next();
+        }
+        ++nextDeliveryTicket_;
+        it = completedOffloads_.begin();
+    }
+}
+
+void TcpConnection::handleWrite()
+{
+    if (channel_->isWriting())
+    {
+        if (tls_ && tls_->socketBio() && !tls_->established())
+        {
+            // kTLS模式下握手消息直接写socket，写满时等可写事件继续握手
+            channel_->disableWriting();
+            handleTlsResult(tls_->handshake(), false);
+            return;
+        }
+        if (outputBuffer_.readableBytes() > 0)
+        {
+            int savedErrno = 0;
+            ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n);
+                updateBackpressure();
+            }
+            else
+            {
+                LOG_ERROR("TcpConnection::handleWrite errno:%d \n", savedErrno);
+                return;
+            }
+        }
+
+        // outputBuffer_发送完了，再发送排在后面的文件
+        if (outputBuffer_.readableBytes() == 0 && !pendingSegments_.empty())
+        {
+            if (!sendPendingSegments())
+            {
+                return;
+            }
+        }
+
+	    // 此时，所有数据已经全部通过channel_->fd()被发送给了客户端
+        if (outputBuffer_.readableBytes() == 0 && pendingSegments_.empty())
         {
-            LOG_ERROR("TcpConnection::handleWrite");
+            channel_->disableWriting();
+            writeCompleted();
         }
     }
     else
@@ -246,17 +1121,419 @@ void TcpConnection::handleWrite()
     }
 }
 
+void TcpConnection::writeCompleted()
+{
+    // 读文件再send的文件：接着发下一块，全部发完之后才算写完
+    if (!bufferedFiles_.empty())
+    {
+        if (!pumpBufferedFiles() || !bufferedFiles_.empty()
+            || outputBuffer_.readableBytes() > 0 || corkPending_)
+        {
+            return;
+        }
+    }
+    if (replyOriginNs_ > 0)
+    {
+        int64_t now = latencyClockNanos();
+        latencyShard_->record(LatencyStats::kWrite, now - replyHandlerEndNs_);
+        latencyShard_->record(LatencyStats::kTotal, now - replyOriginNs_);
+        replyOriginNs_ = 0;
+    }
+    if (callbacks_->writeComplete)
+    {
+        // 唤醒loop_对应的thread线程，执行回调
+        loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+// 依次发送各段输出：先sendfile文件，再把描述符随tail的第一个字节发出，之后把tail移入outputBuffer_
+bool TcpConnection::sendPendingSegments()
+{
+    while (!pendingSegments_.empty() && outputBuffer_.readableBytes() == 0)
+    {
+        PendingSegment &segment = *pendingSegments_.front();
+        while (segment.remaining > 0)
+        {
+            ssize_t n = ::sendfile(channel_->fd(), segment.fd, &segment.offset, segment.remaining);
+            if (n > 0)
+            {
+                segment.remaining -= n;
+            }
+            else if (n == 0)
+            {
+                // 文件比预期的短，已经没有更多数据了
+                LOG_ERROR("TcpConnection::sendPendingSegments file fd=%d truncated \n", segment.fd);
+                segment.remaining = 0;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return true; // socket发送缓冲区满了，等待下一次可写事件
+            }
+            else
+            {
+                LOG_ERROR("TcpConnection::sendPendingSegments sendfile errno:%d \n", errno);
+                return false;
+            }
+        }
+        if (segment.closeWhenDone)
+        {
+            ::close(segment.fd);
+            segment.closeWhenDone = false;
+        }
+        if (!segment.passFds.empty())
+        {
+            ssize_t n = writeWithFds(segment.tail.peek(), segment.tail.readableBytes(), segment.passFds);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return true;
+                }
+                LOG_ERROR("TcpConnection::sendPendingSegments sendmsg errno:%d \n", errno);
+                return false;
+            }
+            // 描述符已经随第一个字节发出，剩下的数据按普通数据发送
+            for (int fd : segment.passFds)
+            {
+                ::close(fd);
+            }
+            segment.passFds.clear();
+            segment.tail.retrieve(n);
+        }
+        outputBuffer_.swap(segment.tail);
+        pendingSegments_.pop_front();
+        if (outputBuffer_.readableBytes() > 0)
+        {
+            int savedErrno = 0;
+            ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n);
+            }
+            else if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::sendPendingSegments write errno:%d \n", savedErrno);
+                return false;
+            }
+            updateBackpressure();
+        }
+    }
+    return true;
+}
+
+ssize_t TcpConnection::writeWithFds(const char *data, size_t len, const std::vector<int> &fds)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = len;
+
+    std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)));
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+    return ::sendmsg(channel_->fd(), &msg, 0);
+}
+
+void TcpConnection::sendWithFds(const char *data, size_t len, const int *fds, size_t nfds)
+{
+    loop_->assertInLoopThread();
+    if (state_ != kConnected || len == 0)
+    {
+        LOG_ERROR("TcpConnection::sendWithFds - disconnected or empty data, give up sending \n");
+        return;
+    }
+    if (tls_ || filters_)
+    {
+        LOG_ERROR("TcpConnection::sendWithFds - cannot pass fds over TLS or filters \n");
+        return;
+    }
+
+    std::unique_ptr<PendingSegment> segment(new PendingSegment);
+    segment->fd = -1;
+    segment->offset = 0;
+    segment->remaining = 0;
+    segment->closeWhenDone = false;
+    for (size_t i = 0; i < nfds; ++i)
+    {
+        int fd = ::fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendWithFds - dup fd=%d errno:%d \n", fds[i], errno);
+            for (int dupFd : segment->passFds)
+            {
+                ::close(dupFd);
+            }
+            return;
+        }
+        segment->passFds.push_back(fd);
+    }
+    segment->tail.append(data, len);
+
+    bool idle = !channel_->isWriting() && outputBuffer_.readableBytes() == 0 && pendingSegments_.empty();
+    pendingSegments_.push_back(std::move(segment));
+    if (idle)
+    {
+        if (!sendPendingSegments())
+        {
+            return;
+        }
+        if (pendingSegments_.empty() && outputBuffer_.readableBytes() == 0)
+        {
+            writeCompleted();
+            return;
+        }
+    }
+    if (!channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+std::vector<int> TcpConnection::takeReceivedFds()
+{
+    loop_->assertInLoopThread();
+    std::vector<int> fds;
+    fds.swap(receivedFds_);
+    return fds;
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t count, bool closeWhenDone)
+{
+    loop_->assertInLoopThread();
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        LOG_ERROR("disconnected, give up sending file!");
+        if (closeWhenDone)
+        {
+            ::close(fd);
+        }
+        return;
+    }
+    latencyReplied_ = true;
+    if ((tls_ && !tls_->kernelSend()) || filters_)
+    {
+        sendFileBuffered(fd, offset, count, closeWhenDone);
+        return;
+    }
+
+    std::unique_ptr<PendingSegment> file(new PendingSegment);
+    file->fd = fd;
+    file->offset = offset;
+    file->remaining = count;
+    file->closeWhenDone = closeWhenDone;
+    bool idle = !channel_->isWriting() && outputBuffer_.readableBytes() == 0 && pendingSegments_.empty();
+    pendingSegments_.push_back(std::move(file));
+
+    // 没有排队的数据，直接尝试发送
+    if (idle)
+    {
+        if (sendPendingSegments() && pendingSegments_.empty() && outputBuffer_.readableBytes() == 0)
+        {
+            writeCompleted();
+            return;
+        }
+    }
+    if (!channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+void TcpConnection::sendFileBuffered(int fd, off_t offset, size_t count, bool closeWhenDone)
+{
+    std::unique_ptr<PendingSegment> file(new PendingSegment);
+    file->fd = fd;
+    file->offset = offset;
+    file->remaining = count;
+    file->closeWhenDone = closeWhenDone;
+    bufferedFiles_.push_back(std::move(file));
+    if (bufferedFiles_.size() == 1)
+    {
+        pumpBufferedFiles();
+    }
+}
+
+bool TcpConnection::pumpBufferedFiles()
+{
+    const size_t kChunkSize = 64 * 1024;
+    const int kMaxChunksPerRound = 4;
+    int chunks = 0;
+    // outputBuffer_里还有数据时等它写空（writeCompleted）再读下一块，这样排队的文件数据最多一块，
+    // 高水位和背压照常起作用；TLS握手完成前不发送（见tlsEstablishedInLoop）
+    while (!bufferedFiles_.empty() && state_ != kDisconnected
+           && outputBuffer_.readableBytes() == 0 && !corkPending_ && !channel_->isWriting()
+           && (!tls_ || tls_->established()))
+    {
+        PendingSegment &file = *bufferedFiles_.front();
+        if (file.remaining > 0)
+        {
+            if (chunks++ == kMaxChunksPerRound)
+            {
+                // socket一直可写：借下一次可写事件继续，不在一轮循环里读完整个文件
+                channel_->enableWriting();
+                return true;
+            }
+            char chunk[kChunkSize];
+            ssize_t n = ::pread(file.fd, chunk, file.remaining < kChunkSize ? file.remaining : kChunkSize, file.offset);
+            if (n < 0 && errno == EINTR)
+            {
+                --chunks;
+                continue;
+            }
+            if (n <= 0)
+            {
+                // 文件长度可能已经告诉了对端（如Content-Length），少发的数据无法补齐，只能断开
+                LOG_ERROR("TcpConnection::pumpBufferedFiles [%s] - file fd=%d read failed errno:%d, closing \n",
+                          name_.c_str(), file.fd, n == 0 ? 0 : errno);
+                discardBufferedFiles();
+                forceClose();
+                return false;
+            }
+            file.offset += n;
+            file.remaining -= n;
+            struct iovec vec;
+            vec.iov_base = chunk;
+            vec.iov_len = n;
+            filterAndSendInLoop(&vec, 1);
+            continue;
+        }
+
+        // 文件发完了，再发排在它之后的数据
+        if (file.closeWhenDone)
+        {
+            ::close(file.fd);
+        }
+        std::unique_ptr<PendingSegment> done(std::move(bufferedFiles_.front()));
+        bufferedFiles_.pop_front();
+        if (done->tail.readableBytes() > 0)
+        {
+            struct iovec vec;
+            vec.iov_base = const_cast<char*>(done->tail.peek());
+            vec.iov_len = done->tail.readableBytes();
+            filterAndSendInLoop(&vec, 1);
+        }
+    }
+    return true;
+}
+
+void TcpConnection::discardBufferedFiles()
+{
+    for (const std::unique_ptr<PendingSegment> &file : bufferedFiles_)
+    {
+        if (file->closeWhenDone)
+        {
+            ::close(file->fd);
+        }
+    }
+    bufferedFiles_.clear();
+}
+
+Buffer* TcpConnection::outputBuffer()
+{
+    loop_->assertInLoopThread();
+    if (!bufferedFiles_.empty())
+    {
+        return &bufferedFiles_.back()->tail;
+    }
+    if (filters_)
+    {
+        return filters_->staging();
+    }
+    if (tls_ && !tls_->kernelSend())
+    {
+        return tls_->plainOutput();
+    }
+    return pendingSegments_.empty() ? &outputBuffer_ : &pendingSegments_.back()->tail;
+}
+
+void TcpConnection::sendOutputBuffer()
+{
+    loop_->assertInLoopThread();
+    if (!bufferedFiles_.empty())
+    {
+        return; // 数据已经在文件之后排队，随文件发出
+    }
+    if (filters_)
+    {
+        if (state_ != kDisconnected)
+        {
+            flushFilterStaging();
+        }
+        return;
+    }
+    if (tls_ && !tls_->kernelSend())
+    {
+        // 握手完成前先暂存，完成后统一加密发送
+        if (state_ != kDisconnected && tls_->established())
+        {
+            flushTlsPlaintext();
+        }
+        return;
+    }
+    if (state_ == kDisconnected || outputBuffer_.readableBytes() == 0 || !pendingSegments_.empty())
+    {
+        return;
+    }
+    latencyReplied_ = true;
+    // auto-cork：留到本轮事件分发结束后再write
+    if (!channel_->isWriting() && (corkPending_ || loop_->corking()))
+    {
+        scheduleCorkFlush();
+    }
+    // 没有注册写事件，说明之前的数据都已发送完毕，直接从outputBuffer_写socket
+    else if (!channel_->isWriting())
+    {
+        int savedErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        if (n > 0)
+        {
+            outputBuffer_.retrieve(n);
+            if (outputBuffer_.readableBytes() == 0)
+            {
+                writeCompleted();
+                return;
+            }
+        }
+        else if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendOutputBuffer errno:%d \n", savedErrno);
+            return;
+        }
+        channel_->enableWriting();
+    }
+    updateBackpressure();
+}
+
 // poller => channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose()
 {
     LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    if (FlightRecorder::enabled())
+    {
+        FlightRecorder::recordInstant(FlightRecorder::kClose, channel_->fd());
+    }
     setState(kDisconnected);
     channel_->disableAll();
+    releaseBackpressure();
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // // 调用用户自定义的连接事件处理函数（可有可无），执行连接关闭的回调
+    callbacks_->connection(connPtr); // // 调用用户自定义的连接事件处理函数（可有可无），执行连接关闭的回调
     // must be the last line
-    closeCallback_(connPtr); // 执行关闭连接的回调，本质上执行的是TcpServer::removeConnection回调方法
+    callbacks_->close(connPtr); // 执行关闭连接的回调，本质上执行的是TcpServer::removeConnection回调方法
 }
 
 void TcpConnection::handleError()
@@ -288,4 +1565,5 @@ const char* TcpConnection::stateToString() const
         case kConnecting:
             return "kConnecting";
     }
+    return "unknown state";
 }
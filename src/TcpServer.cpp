@@ -3,6 +3,7 @@
 #include "TcpConnection.h"
 
 #include <strings.h>
+#include <unistd.h>
 #include <functional>
 
 // TcpServer对象中，loop_不能为空
@@ -24,8 +25,11 @@ TcpServer::TcpServer(EventLoop *loop,
                 , name_(nameArg)
                 , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
                 , threadPool_(new EventLoopThreadPool(loop, name_))
-                , connectionCallback_()
-                , messageCallback_()
+                , connectionCallback_(defaultConnectionCallback)
+                , messageCallback_(defaultMessageCallback)
+                , readBudgetBytes_(0)
+                , readBudgetMessages_(0)
+                , compactMode_(false)
                 , nextConnId_(1)
                 , started_(0)
 {
@@ -36,6 +40,10 @@ TcpServer::TcpServer(EventLoop *loop,
 /* 彻底删除一个TcpConnection对象，必须要调用该对象的connecDestroyed()方法，执行完后才能释放该对象的堆内存。*/
 TcpServer::~TcpServer()
 {  
+    for (const std::pair<EventLoop* const, RetiringLoop> &item : retiringLoops_)
+    {
+        loop_->cancel(item.second.drainTimer);
+    }
     for(auto &item : connections_)  // connections_类型为unordered_map<string, TcpConnectionPtr>，其中TcpConnectionPtr是指向TcpConnection的shared_ptr共享智能指针。
     {
         // 这个局部的shared_ptr智能指针对象，出右括号则会自动释放，即引用计数减一。
@@ -63,7 +71,23 @@ void TcpServer::start()
     if (started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         // 启动底层的loop线程池
-        threadPool_->start(threadInitCallback_); 
+        if (stallWatchdog_)
+        {
+            loop_->setStallWatchdog(stallWatchdog_);
+            std::shared_ptr<StallWatchdog> watchdog = stallWatchdog_;
+            ThreadInitCallback init = threadInitCallback_;
+            threadPool_->start([watchdog, init](EventLoop *ioLoop) {
+                ioLoop->setStallWatchdog(watchdog);
+                if (init)
+                {
+                    init(ioLoop);
+                }
+            });
+        }
+        else
+        {
+            threadPool_->start(threadInitCallback_);
+        }
 		
 	// 在当前loop中，执行Acceptor::listen()回调函数
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
@@ -74,6 +98,15 @@ void TcpServer::start()
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
 	loop_->assertInLoopThread();
+    if (memoryBudget_ && memoryBudget_->overLimit())
+    {
+        // 缓冲区内存已经超过预算，再接新连接只会雪上加霜
+        memoryBudget_->refusedCount_.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR("TcpServer::newConnection [%s] - memory over budget (%lld bytes), refuse connection from %s \n",
+                  name_.c_str(), static_cast<long long>(memoryBudget_->totalBytes()), peerAddr.toIpPort().c_str());
+        ::close(sockfd);
+        return;
+    }
     /*
         根据“轮询算法”选择一个subloop（又称ioloop），
         1）唤醒subloop
@@ -86,14 +119,7 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 			name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取其绑定的本机的ip地址和端口信息组成的InetAddress数据结构
-    sockaddr_in local;
-    memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    } 
-    InetAddress localAddr(local);
+    InetAddress localAddr(Socket::localAddress(sockfd));
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象
     TcpConnectionPtr conn(new TcpConnection(
@@ -106,12 +132,33 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 	
     // 给该连接设置各种的回调函数：
     // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    // 设置关闭连接的回调   conn->shutDown()
-    conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    if (!connCallbacks_)
+    {
+        connCallbacks_ = std::make_shared<TcpConnection::Callbacks>();
+        connCallbacks_->connection = connectionCallback_;
+        connCallbacks_->message = messageCallback_;
+        connCallbacks_->writeComplete = writeCompleteCallback_;
+        // 设置关闭连接的回调   conn->shutDown()
+        connCallbacks_->close = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
+    }
+    conn->setCallbacks(connCallbacks_);
+    conn->setReadBudget(readBudgetBytes_, readBudgetMessages_);
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_);
+    }
+    if (latencyStats_)
+    {
+        conn->setLatencyStats(latencyStats_);
+    }
+    if (memoryBudget_)
+    {
+        conn->setMemoryBudget(memoryBudget_);
+    }
+    if (compactMode_)
+    {
+        conn->setCompactMode(true);
+    }
 
     // 直接调用TcpConnection::connectEstablished
     ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
@@ -132,4 +179,75 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     EventLoop *ioLoop = conn->getLoop(); 
     // 在该TcpConnection所属的subEventLoop中执行connectDestroyed
     ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+
+    // 退役loop上的最后一个连接关闭了，回收该loop的线程
+    std::map<EventLoop*, RetiringLoop>::iterator it = retiringLoops_.find(ioLoop);
+    if (it != retiringLoops_.end() && --it->second.connections == 0)
+    {
+        loop_->cancel(it->second.drainTimer);
+        retiringLoops_.erase(it);
+        threadPool_->releaseLoop(ioLoop);
+    }
+}
+
+void TcpServer::resizeThreadPool(int numThreads, double drainTimeout)
+{
+    loop_->runInLoop(std::bind(&TcpServer::resizeThreadPoolInLoop, this, numThreads, drainTimeout));
+}
+
+void TcpServer::resizeThreadPoolInLoop(int numThreads, double drainTimeout)
+{
+    loop_->assertInLoopThread();
+    if (numThreads < 0)
+    {
+        numThreads = 0;
+    }
+    while (threadPool_->numLoops() < static_cast<size_t>(numThreads))
+    {
+        threadPool_->addLoop();
+    }
+    while (threadPool_->numLoops() > static_cast<size_t>(numThreads))
+    {
+        EventLoop *ioLoop = threadPool_->getAllLoops().back();
+        threadPool_->retireLoop(ioLoop);
+
+        size_t count = 0;
+        for (const ConnectionMap::value_type &item : connections_)
+        {
+            if (item.second->getLoop() == ioLoop)
+            {
+                ++count;
+            }
+        }
+        if (count == 0)
+        {
+            threadPool_->releaseLoop(ioLoop);
+            continue;
+        }
+        LOG_INFO("TcpServer::resizeThreadPool [%s] - draining %lu connections of loop %p \n",
+                 name_.c_str(), count, ioLoop);
+        RetiringLoop &retiring = retiringLoops_[ioLoop];
+        retiring.connections = count;
+        if (drainTimeout >= 0)
+        {
+            retiring.drainTimer = loop_->runAfter(drainTimeout, std::bind(&TcpServer::forceCloseRetiring, this, ioLoop));
+        }
+    }
+}
+
+void TcpServer::forceCloseRetiring(EventLoop *ioLoop)
+{
+    std::map<EventLoop*, RetiringLoop>::iterator it = retiringLoops_.find(ioLoop);
+    if (it == retiringLoops_.end())
+    {
+        return;
+    }
+    it->second.drainTimer = TimerId();
+    for (const ConnectionMap::value_type &item : connections_)
+    {
+        if (item.second->getLoop() == ioLoop)
+        {
+            item.second->forceClose();
+        }
+    }
 }
@@ -2,6 +2,7 @@
 #include "CurrentThread.h"
 
 #include <semaphore.h>
+#include <pthread.h>
 
 // 初始化总线程数为0
 std::atomic_int Thread::numCreated_(0);
@@ -38,6 +39,8 @@ void Thread::start()  // 一个Thread对象，记录的就是一个新线程的
     thread_ = std::shared_ptr<std::thread>(new std::thread([&](){
         // 获取线程的tid值
         tid_ = CurrentThread::tid();
+        // 线程名（最多15个字符）会出现在top -H、perf以及FlightRecorder的trace中
+        ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
 		
 	// 这里会对信号量加一，主线程会收到信号量的变化
         sem_post(&sem);
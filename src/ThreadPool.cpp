@@ -0,0 +1,169 @@
+#include "ThreadPool.h"
+#include "Thread.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <thread>
+
+namespace
+{
+// 当前线程所属的线程池以及在池中的下标，用来把工作线程提交的任务放进它自己的队列
+__thread ThreadPool *t_pool = nullptr;
+__thread size_t t_workerIndex = 0;
+}
+
+ThreadPool::ThreadPool(const std::string &nameArg)
+    : name_(nameArg)
+    , numThreads_(0)
+    , running_(false)
+    , next_(0)
+    , pending_(0)
+    , idle_(0)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+void ThreadPool::start()
+{
+    int numThreads = numThreads_ > 0 ? numThreads_ : static_cast<int>(std::thread::hardware_concurrency());
+    if (numThreads <= 0)
+    {
+        numThreads = 1;
+    }
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+    running_ = true; // 队列都建好后才开始接受任务
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads_.emplace_back(new Thread(std::bind(&ThreadPool::runInThread, this, static_cast<size_t>(i)),
+                                         name_ + std::to_string(i)));
+        threads_.back()->start();
+    }
+    LOG_INFO("ThreadPool %s started with %d threads \n", name_.c_str(), numThreads);
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    notEmpty_.notify_all();
+    for (const std::unique_ptr<Thread> &thread : threads_)
+    {
+        thread->join();
+    }
+    threads_.clear();
+}
+
+void ThreadPool::run(Task task)
+{
+    // 先计数再检查running_（都是seq_cst）：工作线程先看到running_为false、再看到pending_为0才退出，
+    // 所以这里看到running_为true时，入队的任务一定会被执行。先计数也保证取走任务后的--pending_不会先于++pending_
+    ++pending_;
+    if (!running_)
+    {
+        // 还没有start()或者已经stop()：直接在当前线程中执行，submit的结果照样按顺序交付
+        --pending_;
+        task();
+        return;
+    }
+
+    size_t index = t_pool == this ? t_workerIndex : next_++ % workers_.size();
+    {
+        Worker &worker = *workers_[index];
+        std::unique_lock<std::mutex> workerLock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    // 与工作线程配对（Dekker）：这边先++pending_再读idle_，那边先++idle_再读pending_，
+    // 至少有一方能看到对方的修改，不会丢失唤醒。只有确实有线程在睡眠时才需要加锁通知
+    if (idle_ > 0)
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        notEmpty_.notify_one();
+    }
+}
+
+void ThreadPool::submit(const TcpConnectionPtr &conn, Work work)
+{
+    uint64_t ticket = conn->beginOffload();
+    TcpConnectionPtr guard(conn);
+    run([guard, ticket, work]() {
+        Task done = work();
+        guard->getLoop()->runInLoop(std::bind(&TcpConnection::completeOffload, guard, ticket, done));
+    });
+}
+
+// 先取自己队列的尾部，再从其他队列的头部窃取
+bool ThreadPool::take(size_t index, Task *task)
+{
+    {
+        Worker &self = *workers_[index];
+        std::unique_lock<std::mutex> lock(self.mutex);
+        if (!self.tasks.empty())
+        {
+            *task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runInThread(size_t index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+
+    while (true)
+    {
+        Task task;
+        if (take(index, &task))
+        {
+            --pending_;
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        // 先读running_再读pending_，见run()
+        if (!running_)
+        {
+            if (pending_ == 0)
+            {
+                break; // 已提交的任务都执行完了
+            }
+            continue; // 任务已经（或即将）入队，只是还没被取走
+        }
+        ++idle_;
+        if (pending_ == 0)
+        {
+            // stop()在sleepMutex_下修改running_，run()在sleepMutex_下通知，都不会落在检查和wait之间
+            notEmpty_.wait(lock);
+        }
+        --idle_;
+    }
+    t_pool = nullptr;
+}
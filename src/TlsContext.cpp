@@ -0,0 +1,492 @@
+#include "TlsContext.h"
+#include "Logger.h"
+#include "Socket.h"
+#include "InetAddress.h"
+
+#ifdef MYMUDUO_WITH_OPENSSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
+namespace
+{
+// TLS记录的最大明文长度
+const size_t kMaxRecordSize = 16 * 1024;
+
+void logSslError(const char *what, int err)
+{
+    unsigned long code = ERR_get_error();
+    char msg[256] = "";
+    if (code != 0)
+    {
+        ERR_error_string_n(code, msg, sizeof msg);
+    }
+    LOG_ERROR("TLS %s failed: ssl_error=%d errno=%d %s \n", what, err, errno, msg);
+    ERR_clear_error();
+}
+
+bool isIpAddress(const std::string &host)
+{
+    unsigned char addr[sizeof(struct in6_addr)];
+    return ::inet_pton(AF_INET, host.c_str(), addr) == 1 || ::inet_pton(AF_INET6, host.c_str(), addr) == 1;
+}
+}
+
+TlsContext::TlsContext(Role role)
+    : role_(role)
+    , ctx_(SSL_CTX_new(role == kServer ? TLS_server_method() : TLS_client_method()))
+    , kernelTls_(false)
+    , handshakes_(0)
+    , resumed_(0)
+{
+    if (ctx_ == nullptr)
+    {
+        LOG_FATAL("TlsContext SSL_CTX_new failed \n");
+    }
+    SSL_CTX_set_app_data(ctx_, this);
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_COMPRESSION);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // 对端不发close_notify直接断开时按普通EOF处理
+    SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    if (role == kServer)
+    {
+        static const unsigned char kSessionIdContext[] = "mymuduo";
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_set_session_id_context(ctx_, kSessionIdContext, sizeof kSessionIdContext - 1);
+    }
+    else
+    {
+        // 会话由我们按serverName缓存，OpenSSL内部不再保存一份
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx_, &TlsContext::onNewSession);
+        SSL_CTX_set_default_verify_paths(ctx_);
+        SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+    }
+}
+
+TlsContext::~TlsContext()
+{
+    for (const auto &item : sessions_)
+    {
+        SSL_SESSION_free(item.second);
+    }
+    SSL_CTX_free(ctx_);
+}
+
+bool TlsContext::useCertificate(const std::string &certFile, const std::string &keyFile)
+{
+    if (SSL_CTX_use_certificate_chain_file(ctx_, certFile.c_str()) != 1)
+    {
+        logSslError("load certificate", 0);
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx_, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        logSslError("load private key", 0);
+        return false;
+    }
+    return true;
+}
+
+void TlsContext::setVerifyPeer(bool on, const std::string &caFile)
+{
+    if (!caFile.empty() && SSL_CTX_load_verify_locations(ctx_, caFile.c_str(), nullptr) != 1)
+    {
+        logSslError("load CA file", 0);
+    }
+    SSL_CTX_set_verify(ctx_, on ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+}
+
+void TlsContext::setKernelTls(bool on)
+{
+    kernelTls_ = on;
+#ifdef SSL_OP_ENABLE_KTLS
+    if (on)
+    {
+        SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+    else
+    {
+        SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+#else
+    if (on)
+    {
+        LOG_ERROR("TlsContext::setKernelTls - OpenSSL built without kTLS, using userspace encryption \n");
+    }
+#endif
+}
+
+SSL_SESSION* TlsContext::findSession(const std::string &key)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::map<std::string, SSL_SESSION*>::iterator it = sessions_.find(key);
+    if (it == sessions_.end())
+    {
+        return nullptr;
+    }
+    SSL_SESSION_up_ref(it->second);
+    return it->second;
+}
+
+void TlsContext::storeSession(const std::string &key, SSL_SESSION *session)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    SSL_SESSION *&slot = sessions_[key];
+    if (slot != nullptr)
+    {
+        SSL_SESSION_free(slot);
+    }
+    slot = session;
+}
+
+// 客户端收到新会话（TLS 1.3下是握手之后的会话票据）
+int TlsContext::onNewSession(SSL *ssl, SSL_SESSION *session)
+{
+    TlsSession *tls = static_cast<TlsSession*>(SSL_get_app_data(ssl));
+    if (tls == nullptr || tls->sessionKey_.empty())
+    {
+        return 0;
+    }
+    tls->context_->storeSession(tls->sessionKey_, session);
+    return 1; // 我们持有了session的引用
+}
+
+TlsSession::TlsSession(const std::shared_ptr<TlsContext> &context, int sockfd,
+                       const std::string &serverName, const std::string &sessionKey)
+    : context_(context)
+    , ssl_(SSL_new(context->nativeHandle()))
+    , rbio_(nullptr)
+    , wbio_(nullptr)
+    , sessionKey_(sessionKey)
+    , socketBio_(context->kernelTls())
+    , established_(false)
+    , kernelSend_(false)
+    , closeNotifySent_(false)
+{
+    if (ssl_ == nullptr)
+    {
+        LOG_FATAL("TlsSession SSL_new failed \n");
+    }
+    SSL_set_app_data(ssl_, this);
+    if (socketBio_)
+    {
+        SSL_set_fd(ssl_, sockfd);
+    }
+    else
+    {
+        rbio_ = BIO_new(BIO_s_mem());
+        wbio_ = BIO_new(BIO_s_mem());
+        // 内存BIO读空时表示“等待更多数据”，而不是EOF
+        BIO_set_mem_eof_return(rbio_, -1);
+        SSL_set_bio(ssl_, rbio_, wbio_);
+    }
+
+    if (context->role() == TlsContext::kServer)
+    {
+        SSL_set_accept_state(ssl_);
+        return;
+    }
+
+    SSL_set_connect_state(ssl_);
+    bool verifyPeer = (SSL_get_verify_mode(ssl_) & SSL_VERIFY_PEER) != 0;
+    std::string verifyName(serverName);
+    if (verifyName.empty() && verifyPeer)
+    {
+        // 没有主机名时证书必须签发给对端IP，否则任何受信CA签发的证书都能通过校验（中间人）
+        verifyName = InetAddress(Socket::peerAddress(sockfd)).toIp();
+    }
+    if (!verifyName.empty())
+    {
+        bool ip = isIpAddress(verifyName);
+        if (!ip)
+        {
+            SSL_set_tlsext_host_name(ssl_, verifyName.c_str());
+        }
+        if (verifyPeer)
+        {
+            X509_VERIFY_PARAM *param = SSL_get0_param(ssl_);
+            if (ip)
+            {
+                X509_VERIFY_PARAM_set1_ip_asc(param, verifyName.c_str());
+            }
+            else
+            {
+                X509_VERIFY_PARAM_set1_host(param, verifyName.c_str(), 0);
+            }
+        }
+    }
+    SSL_SESSION *session = sessionKey_.empty() ? nullptr : context->findSession(sessionKey_);
+    if (session != nullptr)
+    {
+        SSL_set_session(ssl_, session);
+        SSL_SESSION_free(session);
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    // 没有互发close_notify的连接（如对端直接断开）在SSL_free时会被当作异常断开，
+    // 它的会话随之失效，客户端缓存的会话就无法复用。出错时OpenSSL已经在发送告警时让会话失效
+    if (established_)
+    {
+        SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+    SSL_free(ssl_); // 同时释放rbio_/wbio_
+}
+
+TlsSession::Result TlsSession::handshake()
+{
+    if (established_)
+    {
+        return kOk;
+    }
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+        onEstablished();
+        return kOk;
+    }
+    return checkError(ret, "handshake");
+}
+
+void TlsSession::onEstablished()
+{
+    established_ = true;
+    if (socketBio_)
+    {
+#ifdef BIO_get_ktls_send
+        kernelSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#endif
+        if (!kernelSend_)
+        {
+            // 内核没有接管发送：之后的加密结果交给TcpConnection的输出缓冲区发送
+            wbio_ = BIO_new(BIO_s_mem());
+            SSL_set0_wbio(ssl_, wbio_);
+        }
+    }
+    ++context_->handshakes_;
+    if (SSL_session_reused(ssl_))
+    {
+        ++context_->resumed_;
+    }
+}
+
+TlsSession::Result TlsSession::checkError(int ret, const char *what)
+{
+    int err = SSL_get_error(ssl_, ret);
+    switch (err)
+    {
+        case SSL_ERROR_WANT_READ:
+            return kOk;
+        case SSL_ERROR_WANT_WRITE:
+            return kWantWrite;
+        case SSL_ERROR_ZERO_RETURN:
+            return kClosed;
+        case SSL_ERROR_SYSCALL:
+            if (ERR_peek_error() == 0 && (ret == 0 || errno == 0))
+            {
+                return kClosed;
+            }
+            break;
+        default:
+            break;
+    }
+    logSslError(what, err);
+    return kError;
+}
+
+TlsSession::Result TlsSession::read(int fd, Buffer *plain, size_t maxBytes, int *savedErrno)
+{
+    if (!socketBio_)
+    {
+        ssize_t n = rawInput_.readFd(fd, savedErrno, maxBytes);
+        if (n == 0)
+        {
+            return kClosed;
+        }
+        if (n < 0)
+        {
+            return kError;
+        }
+        // 内存BIO总是一次写完
+        BIO_write(rbio_, rawInput_.peek(), static_cast<int>(rawInput_.readableBytes()));
+        rawInput_.retrieveAll();
+    }
+
+    if (!established_)
+    {
+        Result result = handshake();
+        if (result != kOk || !established_)
+        {
+            return result;
+        }
+    }
+    // 内存BIO中的密文必须全部解密，否则没有新的可读事件再触发；socket模式下剩余的记录还在内核中
+    return decrypt(plain, socketBio_ ? maxBytes : SIZE_MAX);
+}
+
+TlsSession::Result TlsSession::decrypt(Buffer *plain, size_t maxBytes)
+{
+    size_t total = 0;
+    while (total < maxBytes)
+    {
+        plain->ensureWriteableBytes(kMaxRecordSize);
+        size_t room = plain->writableBytes() < INT_MAX ? plain->writableBytes() : INT_MAX;
+        ERR_clear_error();
+        int n = SSL_read(ssl_, plain->beginWrite(), static_cast<int>(room));
+        if (n <= 0)
+        {
+            return checkError(n, "read");
+        }
+        plain->hasWritten(n);
+        total += n;
+    }
+    return kOk;
+}
+
+bool TlsSession::encrypt(const struct iovec *iov, int iovcnt, Buffer *cipher)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        total += iov[i].iov_len;
+    }
+
+    struct iovec gathered;
+    if (iovcnt > 1 && total <= kMaxRecordSize)
+    {
+        // 多个小块（如响应头+正文）合并成一条记录，少一次加密和记录头开销
+        gather_.retrieveAll();
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            gather_.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        gathered.iov_base = const_cast<char*>(gather_.peek());
+        gathered.iov_len = total;
+        iov = &gathered;
+        iovcnt = 1;
+    }
+
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        const char *data = static_cast<const char*>(iov[i].iov_base);
+        size_t len = iov[i].iov_len;
+        while (len > 0)
+        {
+            ERR_clear_error();
+            int n = SSL_write(ssl_, data, static_cast<int>(len < INT_MAX ? len : INT_MAX));
+            if (n <= 0)
+            {
+                checkError(n, "write");
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+    drainOutput(cipher);
+    return true;
+}
+
+void TlsSession::drainOutput(Buffer *cipher)
+{
+    if (wbio_ == nullptr)
+    {
+        return;
+    }
+    size_t pending = BIO_ctrl_pending(wbio_);
+    if (pending == 0)
+    {
+        return;
+    }
+    cipher->ensureWriteableBytes(pending);
+    int n = BIO_read(wbio_, cipher->beginWrite(), static_cast<int>(pending));
+    if (n > 0)
+    {
+        cipher->hasWritten(n);
+    }
+}
+
+void TlsSession::shutdown()
+{
+    if (closeNotifySent_ || !established_)
+    {
+        return;
+    }
+    closeNotifySent_ = true;
+    ERR_clear_error();
+    SSL_shutdown(ssl_); // 只发送close_notify，不等待对端的回应
+}
+
+bool TlsSession::resumed() const
+{
+    return SSL_session_reused(ssl_) == 1;
+}
+
+const char* TlsSession::version() const
+{
+    return SSL_get_version(ssl_);
+}
+
+const char* TlsSession::cipher() const
+{
+    return SSL_get_cipher_name(ssl_);
+}
+
+#else // !MYMUDUO_WITH_OPENSSL
+
+// 编译时没有找到OpenSSL：保留接口，使用时报错退出
+
+TlsContext::TlsContext(Role role)
+    : role_(role)
+    , ctx_(nullptr)
+    , kernelTls_(false)
+    , handshakes_(0)
+    , resumed_(0)
+{
+    LOG_FATAL("TlsContext - mymuduo was built without OpenSSL \n");
+}
+
+TlsContext::~TlsContext() {}
+bool TlsContext::useCertificate(const std::string&, const std::string&) { return false; }
+void TlsContext::setVerifyPeer(bool, const std::string&) {}
+void TlsContext::setKernelTls(bool on) { kernelTls_ = on; }
+ssl_session_st* TlsContext::findSession(const std::string&) { return nullptr; }
+void TlsContext::storeSession(const std::string&, ssl_session_st*) {}
+int TlsContext::onNewSession(ssl_st*, ssl_session_st*) { return 0; }
+
+TlsSession::TlsSession(const std::shared_ptr<TlsContext> &context, int, const std::string&, const std::string&)
+    : context_(context)
+    , ssl_(nullptr)
+    , rbio_(nullptr)
+    , wbio_(nullptr)
+    , socketBio_(false)
+    , established_(false)
+    , kernelSend_(false)
+    , closeNotifySent_(false)
+{
+    LOG_FATAL("TlsSession - mymuduo was built without OpenSSL \n");
+}
+
+TlsSession::~TlsSession() {}
+TlsSession::Result TlsSession::handshake() { return kError; }
+TlsSession::Result TlsSession::read(int, Buffer*, size_t, int*) { return kError; }
+bool TlsSession::encrypt(const struct iovec*, int, Buffer*) { return false; }
+void TlsSession::drainOutput(Buffer*) {}
+void TlsSession::shutdown() {}
+bool TlsSession::resumed() const { return false; }
+const char* TlsSession::version() const { return ""; }
+const char* TlsSession::cipher() const { return ""; }
+
+#endif // MYMUDUO_WITH_OPENSSL
@@ -0,0 +1,359 @@
+#include "UdpChannel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/udp.h>
+
+const int UdpChannel::kBatchSize;
+const int UdpChannel::kGroBatchSize;
+const size_t UdpChannel::kMaxPendingSends;
+
+namespace
+{
+
+const int kMaxReadRounds = 4;             // 一次可读事件最多recvmmsg的次数，避免一个socket独占loop
+const size_t kGroSlotSize = 65536;        // GRO合并后的数据报最大64K
+const size_t kMaxGsoSegments = 64;        // 一个GSO消息最多的分段数（UDP_MAX_SEGMENTS）
+const size_t kMaxGsoBytes = 65507;        // 一个GSO消息最大的负载
+const size_t kRecvControlSpace = CMSG_SPACE(sizeof(int));
+const size_t kSendControlSpace = CMSG_SPACE(sizeof(uint16_t));
+
+int createNonblockingUdp()
+{
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+} // namespace
+
+UdpChannel::UdpChannel(EventLoop *loop, const InetAddress &localAddr, bool reusePort, size_t maxDatagramSize)
+    : loop_(loop)
+    , socket_(createNonblockingUdp())
+    , channel_(loop, socket_.fd())
+    , maxDatagramSize_(maxDatagramSize)
+    , gro_(false)
+    , gso_(false)
+    , inCallback_(false)
+    , recvBatch_(0)
+    , slotSize_(0)
+    , pending_()
+    , pendingCount_(0)
+    , sentIndex_(0)
+    , sendMsgs_(kBatchSize)
+    , sendIovecs_(kBatchSize * kMaxGsoSegments)
+    , sendCovers_(kBatchSize)
+    , sendControl_(kBatchSize * kSendControlSpace)
+    , received_(0)
+    , sent_(0)
+    , dropped_(0)
+{
+    socket_.setReuseAddr(true);
+    socket_.setReusePort(reusePort);
+    socket_.bindAddress(localAddr);
+
+    channel_.setReadCallback(std::bind(&UdpChannel::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpChannel::handleWrite, this));
+    setupReceiveBuffers();
+}
+
+UdpChannel::~UdpChannel()
+{
+    channel_.disableAll();
+    channel_.remove();
+}
+
+bool UdpChannel::setGro(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("UdpChannel::setGro - UDP_GRO not supported, errno:%d \n", errno);
+        return false;
+    }
+    gro_ = on;
+    setupReceiveBuffers();
+    return true;
+}
+
+void UdpChannel::setReceiveBufferSize(int bytes)
+{
+    if (::setsockopt(socket_.fd(), SOL_SOCKET, SO_RCVBUF, &bytes, sizeof bytes) < 0)
+    {
+        LOG_ERROR("UdpChannel::setReceiveBufferSize - SO_RCVBUF err:%d \n", errno);
+    }
+}
+
+void UdpChannel::setupReceiveBuffers()
+{
+    recvBatch_ = gro_ ? kGroBatchSize : kBatchSize;
+    slotSize_ = gro_ ? kGroSlotSize : maxDatagramSize_;
+    recvArena_.assign(recvBatch_ * slotSize_, 0);
+    recvMsgs_.assign(recvBatch_, mmsghdr());
+    recvIovecs_.assign(recvBatch_, iovec());
+    recvAddrs_.assign(recvBatch_, sockaddr_in());
+    recvControl_.assign(gro_ ? recvBatch_ * kRecvControlSpace : 0, 0);
+    for (int i = 0; i < recvBatch_; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvArena_[i * slotSize_];
+        recvIovecs_[i].iov_len = slotSize_;
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        hdr.msg_name = &recvAddrs_[i];
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_iov = &recvIovecs_[i];
+        hdr.msg_iovlen = 1;
+    }
+    // 开启GRO后，一个缓冲区最多拆成kMaxGsoSegments个数据报
+    datagrams_.reserve(gro_ ? recvBatch_ * kMaxGsoSegments : recvBatch_);
+}
+
+void UdpChannel::start()
+{
+    loop_->assertInLoopThread();
+    channel_.enableReading();
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    for (int round = 0; round < kMaxReadRounds; ++round)
+    {
+        for (int i = 0; i < recvBatch_; ++i)
+        {
+            // 内核会改写namelen和controllen，每次都要复位
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            if (gro_)
+            {
+                hdr.msg_control = &recvControl_[i * kRecvControlSpace];
+                hdr.msg_controllen = kRecvControlSpace;
+            }
+        }
+
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), recvBatch_, MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpChannel::handleRead - recvmmsg err:%d \n", errno);
+            }
+            break;
+        }
+
+        datagrams_.clear();
+        for (int i = 0; i < n; ++i)
+        {
+            const msghdr &hdr = recvMsgs_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed); // 超过maxDatagramSize_
+                continue;
+            }
+            const char *data = &recvArena_[i * slotSize_];
+            const size_t len = recvMsgs_[i].msg_len;
+            size_t segment = len;
+            if (gro_)
+            {
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+                     cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cmsg))
+                {
+                    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                    {
+                        int gsoSize = 0;
+                        ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof gsoSize);
+                        if (gsoSize > 0)
+                        {
+                            segment = static_cast<size_t>(gsoSize);
+                        }
+                    }
+                }
+            }
+
+            InetAddress peer(recvAddrs_[i]);
+            if (len == 0)
+            {
+                datagrams_.push_back(UdpDatagram{ data, 0, peer });
+            }
+            for (size_t offset = 0; offset < len; offset += segment)
+            {
+                datagrams_.push_back(UdpDatagram{ data + offset, std::min(segment, len - offset), peer });
+            }
+        }
+        received_.fetch_add(datagrams_.size(), std::memory_order_relaxed);
+
+        if (!datagrams_.empty() && messageCallback_)
+        {
+            // 回调中的sendTo先放入队列，回调返回后一次发出
+            inCallback_ = true;
+            messageCallback_(this, datagrams_.data(), datagrams_.size(), receiveTime);
+            inCallback_ = false;
+        }
+        if (!channel_.isWriting())
+        {
+            flushSends();
+        }
+
+        if (n < recvBatch_)
+        {
+            break; // 已经收空了
+        }
+    }
+}
+
+void UdpChannel::handleWrite()
+{
+    flushSends();
+}
+
+void UdpChannel::sendTo(const InetAddress &peer, const char *data, size_t len)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(*peer.getSockAddr(), data, len);
+    }
+    else
+    {
+        loop_->runInLoop(std::bind(&UdpChannel::sendCopyInLoop, this, peer, std::string(data, len)));
+    }
+}
+
+void UdpChannel::sendCopyInLoop(const InetAddress &peer, const std::string &data)
+{
+    sendInLoop(*peer.getSockAddr(), data.data(), data.size());
+}
+
+void UdpChannel::sendInLoop(const sockaddr_in &peer, const char *data, size_t len)
+{
+    if (pendingCount_ >= kMaxPendingSends)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (pendingCount_ == pending_.size())
+    {
+        pending_.emplace_back();
+    }
+    PendingSend &send = pending_[pendingCount_++];
+    send.peer = peer;
+    send.data.assign(data, len);
+
+    if (!inCallback_ && !channel_.isWriting())
+    {
+        flushSends();
+    }
+}
+
+size_t UdpChannel::coalesce(size_t first) const
+{
+    const PendingSend &head = pending_[first];
+    const size_t segment = head.data.size();
+    if (segment == 0)
+    {
+        return 1;
+    }
+    size_t count = 1;
+    size_t total = segment;
+    for (size_t i = first + 1; i < pendingCount_ && count < kMaxGsoSegments; ++i)
+    {
+        const PendingSend &send = pending_[i];
+        if (send.peer.sin_addr.s_addr != head.peer.sin_addr.s_addr
+            || send.peer.sin_port != head.peer.sin_port
+            || send.data.empty()
+            || send.data.size() > segment
+            || total + send.data.size() > kMaxGsoBytes)
+        {
+            break;
+        }
+        ++count;
+        total += send.data.size();
+        if (send.data.size() < segment)
+        {
+            break; // 只有最后一段可以比gso_size短
+        }
+    }
+    return count;
+}
+
+void UdpChannel::flushSends()
+{
+    while (sentIndex_ < pendingCount_)
+    {
+        int msgs = 0;
+        size_t iovs = 0;
+        size_t index = sentIndex_;
+        while (msgs < kBatchSize && index < pendingCount_)
+        {
+            const size_t count = gso_ ? coalesce(index) : 1;
+            msghdr &hdr = sendMsgs_[msgs].msg_hdr;
+            ::memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = &pending_[index].peer;
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &sendIovecs_[iovs];
+            hdr.msg_iovlen = count;
+            for (size_t k = 0; k < count; ++k)
+            {
+                std::string &data = pending_[index + k].data;
+                sendIovecs_[iovs].iov_base = &data[0];
+                sendIovecs_[iovs].iov_len = data.size();
+                ++iovs;
+            }
+            if (count > 1)
+            {
+                // 由内核按gso_size把负载切成多个数据报
+                hdr.msg_control = &sendControl_[msgs * kSendControlSpace];
+                hdr.msg_controllen = kSendControlSpace;
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gsoSize = static_cast<uint16_t>(pending_[index].data.size());
+                ::memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof gsoSize);
+            }
+            sendCovers_[msgs] = count;
+            index += count;
+            ++msgs;
+        }
+
+        int n = ::sendmmsg(socket_.fd(), sendMsgs_.data(), msgs, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // socket发送缓冲区满了，等可写时再发
+                if (!channel_.isWriting())
+                {
+                    channel_.enableWriting();
+                }
+                return;
+            }
+            if (sendCovers_[0] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT))
+            {
+                LOG_ERROR("UdpChannel::flushSends - UDP GSO not supported (err:%d), disabled \n", errno);
+                gso_ = false;
+                continue;
+            }
+            // 第一个消息发送失败（例如EMSGSIZE、ECONNREFUSED），丢弃后继续发送后面的
+            LOG_ERROR("UdpChannel::flushSends - sendmmsg err:%d \n", errno);
+            dropped_.fetch_add(sendCovers_[0], std::memory_order_relaxed);
+            sentIndex_ += sendCovers_[0];
+            continue;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            sent_.fetch_add(sendCovers_[i], std::memory_order_relaxed);
+            sentIndex_ += sendCovers_[i];
+        }
+    }
+
+    pendingCount_ = 0;
+    sentIndex_ = 0;
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+}
@@ -0,0 +1,85 @@
+#include "UdpServer.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "Logger.h"
+
+#include <mutex>
+#include <condition_variable>
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name)
+    : loop_(loop)
+    , listenAddr_(listenAddr)
+    , name_(name)
+    , threadPool_(new EventLoopThreadPool(loop, name))
+    , maxDatagramSize_(2048)
+    , gro_(false)
+    , gso_(false)
+    , receiveBufferSize_(0)
+    , started_(false)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainLoop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+}
+
+UdpServer::~UdpServer()
+{
+    // UdpChannel要在所属的loop中析构，并且要等它完成：之后threadPool_析构会退出各loop线程，
+    // 队列中还没执行的回调会被丢掉，channel和socket就泄漏了
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t remaining = channels_.size();
+    for (std::unique_ptr<UdpChannel> &channel : channels_)
+    {
+        UdpChannel *ch = channel.release();
+        ch->getLoop()->runInLoop([ch, &mutex, &cond, &remaining]() {
+            delete ch;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0)
+            {
+                cond.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    while (remaining > 0)
+    {
+        cond.wait(lock);
+    }
+}
+
+void UdpServer::setThreadNum(int numThreads)
+{
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start()
+{
+    if (started_)
+    {
+        return;
+    }
+    started_ = true;
+    threadPool_->start(threadInitCallback_);
+
+    // 每个loop一个socket，都以SO_REUSEPORT绑定同一个地址
+    for (EventLoop *ioLoop : threadPool_->getAllLoops())
+    {
+        std::unique_ptr<UdpChannel> channel(new UdpChannel(ioLoop, listenAddr_, true, maxDatagramSize_));
+        channel->setMessageCallback(messageCallback_);
+        if (gro_)
+        {
+            channel->setGro(true);
+        }
+        channel->setGso(gso_);
+        if (receiveBufferSize_ > 0)
+        {
+            channel->setReceiveBufferSize(receiveBufferSize_);
+        }
+        ioLoop->runInLoop(std::bind(&UdpChannel::start, channel.get()));
+        channels_.push_back(std::move(channel));
+    }
+    LOG_INFO("UdpServer[%s] started on %s with %d sockets \n",
+        name_.c_str(), listenAddr_.toIpPort().c_str(), static_cast<int>(channels_.size()));
+}
@@ -0,0 +1,251 @@
+#include "UpstreamPool.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <functional>
+
+UpstreamPool::UpstreamPool(EventLoop *loop,
+                           const InetAddress &serverAddr,
+                           const std::string &nameArg,
+                           int numConnections,
+                           int maxPipelineDepth)
+    : loop_(loop)
+    , name_(nameArg)
+    , maxPipelineDepth_(maxPipelineDepth > 0 ? maxPipelineDepth : 1)
+    , maxBacklog_(10000)
+    , stopped_(false)
+    , upstreams_(numConnections > 0 ? numConnections : 1)
+{
+    for (size_t i = 0; i < upstreams_.size(); ++i)
+    {
+        TcpClient *client = new TcpClient(loop, serverAddr, name_ + "-" + std::to_string(i));
+        client->setConnectionCallback(
+            std::bind(&UpstreamPool::onConnection, this, static_cast<int>(i), std::placeholders::_1));
+        client->setMessageCallback(
+            std::bind(&UpstreamPool::onMessage, this, static_cast<int>(i),
+                      std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        // 上游断开后自动重连
+        client->enableRetry();
+        upstreams_[i].client.reset(client);
+    }
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    stopped_ = true;
+    failAll();
+    // 各连接的回调都绑定了this：~TcpClient只替换closeCallback，之后forceClose排队的关闭
+    // 仍会调用onConnection，所以先把回调换成默认的，再断开连接
+    for (Upstream &upstream : upstreams_)
+    {
+        TcpClient *client = upstream.client.get();
+        client->stop();
+        client->setConnectionCallback(defaultConnectionCallback);
+        client->setMessageCallback(defaultMessageCallback);
+        TcpConnectionPtr conn = client->connection();
+        if (conn)
+        {
+            conn->setConnectionCallback(defaultConnectionCallback);
+            conn->setMessageCallback(defaultMessageCallback);
+        }
+        client->disconnect();
+    }
+}
+
+void UpstreamPool::start()
+{
+    loop_->assertInLoopThread();
+    for (Upstream &upstream : upstreams_)
+    {
+        upstream.client->connect();
+    }
+}
+
+void UpstreamPool::stop()
+{
+    loop_->assertInLoopThread();
+    stopped_ = true;
+    for (Upstream &upstream : upstreams_)
+    {
+        upstream.client->stop();
+        upstream.client->disconnect();
+    }
+    // 已经停止重连，没有机会再发出或收到响应了
+    failAll();
+}
+
+void UpstreamPool::send(const std::string &request, ResponseCallback cb)
+{
+    loop_->assertInLoopThread();
+    if (stopped_)
+    {
+        cb(nullptr, 0);
+        return;
+    }
+    int index = backlog_.empty() ? pickUpstream() : -1;
+    if (index >= 0)
+    {
+        sendTo(index, request, std::move(cb));
+    }
+    else if (backlog_.size() >= maxBacklog_)
+    {
+        LOG_ERROR("UpstreamPool[%s] - backlog full (%lu requests), request failed \n", name_.c_str(), backlog_.size());
+        cb(nullptr, 0);
+    }
+    else
+    {
+        backlog_.emplace_back(request, std::move(cb));
+    }
+}
+
+size_t UpstreamPool::inflight() const
+{
+    size_t n = 0;
+    for (const Upstream &upstream : upstreams_)
+    {
+        n += upstream.pending.size();
+    }
+    return n;
+}
+
+int UpstreamPool::connectedCount() const
+{
+    int n = 0;
+    for (const Upstream &upstream : upstreams_)
+    {
+        if (upstream.conn)
+        {
+            ++n;
+        }
+    }
+    return n;
+}
+
+int UpstreamPool::pickUpstream() const
+{
+    int best = -1;
+    for (size_t i = 0; i < upstreams_.size(); ++i)
+    {
+        const Upstream &upstream = upstreams_[i];
+        if (upstream.conn && upstream.pending.size() < maxPipelineDepth_
+            && (best < 0 || upstream.pending.size() < upstreams_[best].pending.size()))
+        {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+void UpstreamPool::sendTo(int index, const std::string &request, ResponseCallback cb)
+{
+    Upstream &upstream = upstreams_[index];
+    upstream.pending.push_back(std::move(cb));
+    // 与上游连接在同一个loop中，send会直接尝试write，不会发生跨线程的拷贝
+    upstream.conn->send(request);
+}
+
+void UpstreamPool::drainBacklog()
+{
+    while (!backlog_.empty())
+    {
+        int index = pickUpstream();
+        if (index < 0)
+        {
+            break;
+        }
+        std::pair<std::string, ResponseCallback> item(std::move(backlog_.front()));
+        backlog_.pop_front();
+        sendTo(index, item.first, std::move(item.second));
+    }
+}
+
+void UpstreamPool::failBacklog()
+{
+    // 回调中可能再次send，先换出来
+    std::deque<std::pair<std::string, ResponseCallback>> backlog;
+    backlog.swap(backlog_);
+    for (const std::pair<std::string, ResponseCallback> &item : backlog)
+    {
+        item.second(nullptr, 0);
+    }
+}
+
+void UpstreamPool::failAll()
+{
+    for (Upstream &upstream : upstreams_)
+    {
+        std::deque<ResponseCallback> pending;
+        pending.swap(upstream.pending);
+        for (const ResponseCallback &cb : pending)
+        {
+            cb(nullptr, 0);
+        }
+    }
+    failBacklog();
+}
+
+void UpstreamPool::onConnection(int index, const TcpConnectionPtr &conn)
+{
+    Upstream &upstream = upstreams_[index];
+    if (conn->connected())
+    {
+        LOG_INFO("UpstreamPool[%s] - upstream #%d UP \n", name_.c_str(), index);
+        upstream.conn = conn;
+        drainBacklog();
+    }
+    else
+    {
+        LOG_INFO("UpstreamPool[%s] - upstream #%d DOWN, %lu requests failed \n",
+                 name_.c_str(), index, upstream.pending.size());
+        upstream.conn.reset();
+        // 已发出的请求无法确定是否被处理，直接以失败回调
+        std::deque<ResponseCallback> pending;
+        pending.swap(upstream.pending);
+        for (const ResponseCallback &cb : pending)
+        {
+            cb(nullptr, 0);
+        }
+        // 没有可用的上游了：暂存的请求不知道要等多久，直接失败
+        if (connectedCount() == 0)
+        {
+            failBacklog();
+        }
+    }
+}
+
+void UpstreamPool::onMessage(int index, const TcpConnectionPtr&, Buffer *buf, Timestamp)
+{
+    Upstream &upstream = upstreams_[index];
+    if (!framer_)
+    {
+        LOG_ERROR("UpstreamPool[%s] - no ResponseFramer set \n", name_.c_str());
+        buf->retrieveAll();
+        return;
+    }
+
+    // 一次处理完buf中所有完整的响应，按FIFO顺序匹配请求
+    while (!upstream.pending.empty())
+    {
+        size_t len = framer_(buf);
+        if (len == 0 || len > buf->readableBytes())
+        {
+            break;
+        }
+        ResponseCallback cb(std::move(upstream.pending.front()));
+        upstream.pending.pop_front();
+        cb(buf->peek(), len);
+        buf->retrieve(len);
+    }
+
+    size_t unexpected = upstream.pending.empty() ? buf->readableBytes() : 0;
+    if (unexpected > 0)
+    {
+        LOG_ERROR("UpstreamPool[%s] - unexpected %lu bytes from upstream #%d \n",
+                  name_.c_str(), unexpected, index);
+        buf->retrieveAll();
+    }
+
+    drainBacklog();
+}